@@ -0,0 +1,292 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <masternodes/masternodes.h>
+#include <masternodes/mn_checks.h>
+#include <masternodes/undo.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <streams.h>
+#include <util/system.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Counts heap allocations of the bench binary, ApplyCustomTxMix reports them per tx (to stderr, not to break the printers)
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+// Synthetic DeFi state: N tokens, M pools between them and K liquidity providers.
+// Everything lives in an in-memory leveldb, so the numbers reflect the storage layers, not the disk.
+namespace {
+
+static const int BLOCK_TXS = 100; // txs applied to the same layer before it gets discarded
+
+template<typename T>
+CTransactionRef CreateCustomTx(CustomTxType type, T const & msg, COutPoint const & auth)
+{
+    CDataStream metadata(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
+    metadata << static_cast<unsigned char>(type) << msg;
+
+    CMutableTransaction rawTx;
+    rawTx.vin = { CTxIn(auth) };
+    rawTx.vout = { CTxOut(0, CScript() << OP_RETURN << ToByteVector(metadata)) };
+    return MakeTransactionRef(std::move(rawTx));
+}
+
+struct DeFiState {
+    CStorageLevelDB db;
+    CCustomCSView view;
+    Consensus::Params consensus;
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins;
+    std::vector<std::pair<DCT_ID, CPoolPair>> pools;
+    std::vector<CScript> providers;
+    std::vector<COutPoint> auths;
+
+    DeFiState(int tokensCount, int poolsCount, int providersCount)
+        : db(fs::path("defi_bench_state"), 8 << 20, true)
+        , view(db)
+        , consensus(CreateChainParams(CBaseChainParams::REGTEST)->GetConsensus())
+        , coins(&coinsDummy)
+    {
+        consensus.AMKHeight = consensus.BayfrontHeight = consensus.BayfrontMarinaHeight = consensus.BayfrontGardensHeight = 0;
+
+        // pools between every pair of tokens, LP tokens go after the regular ones
+        for (uint32_t a = 0; a < (uint32_t) tokensCount && (int) pools.size() < poolsCount; ++a) {
+            for (uint32_t b = a + 1; b < (uint32_t) tokensCount && (int) pools.size() < poolsCount; ++b) {
+                CPoolPair pool;
+                pool.idTokenA = DCT_ID{a};
+                pool.idTokenB = DCT_ID{b};
+                pool.commission = COIN / 1000;
+                pool.rewardPct = COIN / poolsCount;
+                pool.blockCommissionA = pool.blockCommissionB = COIN;
+                pool.swapEvent = true;
+                DCT_ID const poolId{(uint32_t) (tokensCount + pools.size())};
+                pools.emplace_back(poolId, pool);
+            }
+        }
+
+        for (int i = 0; i < providersCount; ++i) {
+            CScript const provider = CScript(i + 1);
+            providers.push_back(provider);
+            auths.emplace_back(ArithToUint256(i + 1), 0);
+            coins.AddCoin(auths.back(), Coin(CTxOut(1, provider), 1, false), false);
+
+            for (int t = 0; t < tokensCount; ++t) {
+                view.AddBalance(provider, {DCT_ID{(uint32_t) t}, 1000 * COIN});
+            }
+            for (auto & pool : pools) {
+                view.AddBalance(provider, {pool.first, 100 * COIN});
+                view.SetShare(pool.first, provider);
+                pool.second.totalLiquidity += 100 * COIN;
+                pool.second.reserveA += 100 * COIN;
+                pool.second.reserveB += 100 * COIN;
+            }
+        }
+        for (auto & pool : pools) {
+            pool.second.totalLiquidity += CPoolPair::MINIMUM_LIQUIDITY;
+            view.SetPoolPair(pool.first, pool.second);
+        }
+        view.SetLastHeight(1);
+    }
+
+    // swaps dominate, then liquidity adding and removal
+    std::vector<CTransactionRef> CreateTxMix(int count)
+    {
+        FastRandomContext rand(true);
+        std::vector<CTransactionRef> txs;
+        for (int i = 0; i < count; ++i) {
+            auto const provider = rand.randrange(providers.size());
+            auto const & pool = pools[rand.randrange(pools.size())];
+            auto const kind = rand.randrange(10);
+            if (kind < 7) {
+                CPoolSwapMessage msg;
+                msg.from = msg.to = providers[provider];
+                msg.idTokenFrom = kind % 2 ? pool.second.idTokenA : pool.second.idTokenB;
+                msg.idTokenTo = kind % 2 ? pool.second.idTokenB : pool.second.idTokenA;
+                msg.amountFrom = 1 + rand.randrange(COIN);
+                msg.maxPrice = {std::numeric_limits<int64_t>::max() / CPoolPair::PRECISION, 0};
+                txs.push_back(CreateCustomTx(CustomTxType::PoolSwap, msg, auths[provider]));
+            } else if (kind < 9) {
+                CLiquidityMessage msg;
+                CAmount const amount = 1 + rand.randrange(COIN);
+                msg.from[providers[provider]] = CBalances{{{pool.second.idTokenA, amount}, {pool.second.idTokenB, amount}}};
+                msg.shareAddress = providers[provider];
+                txs.push_back(CreateCustomTx(CustomTxType::AddPoolLiquidity, msg, auths[provider]));
+            } else {
+                CRemoveLiquidityMessage msg;
+                msg.from = providers[provider];
+                msg.amount = {pool.first, 1 + (CAmount) rand.randrange(COIN)};
+                txs.push_back(CreateCustomTx(CustomTxType::RemovePoolLiquidity, msg, auths[provider]));
+            }
+        }
+        return txs;
+    }
+};
+
+} // namespace
+
+// Writes through a flushable layer and merges it into the parent, as ConnectBlock does per tx
+static void FlushableStorageWrite(benchmark::State& state)
+{
+    DeFiState defi(2, 1, 1);
+    CScript const owner = CScript(1);
+    uint32_t i = 0;
+    while (state.KeepRunning()) {
+        CCustomCSView cache(defi.view);
+        for (uint32_t j = 0; j < 100; ++j, ++i) {
+            cache.AddBalance(owner, {DCT_ID{i % 1000}, 1});
+        }
+        cache.Flush();
+    }
+}
+
+// Ordered iteration merging a dirty layer with the disk
+static void FlushableStorageIterate(benchmark::State& state)
+{
+    DeFiState defi(10, 10, 1000);
+    CCustomCSView cache(defi.view);
+    cache.AddBalance(defi.providers.front(), {DCT_ID{0}, COIN});
+    while (state.KeepRunning()) {
+        uint64_t count = 0;
+        cache.ForEachBalance([&] (CScript const &, CTokenAmount const &) {
+            ++count;
+            return true;
+        });
+        assert(count > 0);
+    }
+}
+
+static void UndoConstructRevert(benchmark::State& state)
+{
+    DeFiState defi(10, 10, 100);
+    while (state.KeepRunning()) {
+        CCustomCSView cache(defi.view);
+        for (auto const & provider : defi.providers) {
+            cache.AddBalance(provider, {DCT_ID{0}, 1});
+        }
+        auto& flushable = dynamic_cast<CFlushableStorageKV&>(cache.GetRaw());
+        auto undo = CUndo::Construct(defi.view.GetRaw(), flushable.GetRaw());
+        CUndo::Revert(flushable, undo);
+    }
+}
+
+// Pure pool math, no storage
+static void PoolPairSwap(benchmark::State& state)
+{
+    CPoolPair pool;
+    pool.idTokenA = DCT_ID{0};
+    pool.idTokenB = DCT_ID{1};
+    pool.commission = COIN / 1000;
+    pool.reserveA = pool.reserveB = 1000000 * COIN;
+    PoolPrice const maxPrice{std::numeric_limits<int64_t>::max() / CPoolPair::PRECISION, 0};
+    bool forward = true;
+    while (state.KeepRunning()) {
+        pool.Swap({forward ? pool.idTokenA : pool.idTokenB, COIN}, maxPrice, [] (CTokenAmount const &) {
+            return Res::Ok();
+        });
+        forward = !forward;
+    }
+}
+
+// Pre-BayfrontGardens swap of 10% of the pool, slides through ~100 chunks
+static void PoolPairSwapLegacy(benchmark::State& state)
+{
+    CPoolPair pool;
+    pool.idTokenA = DCT_ID{0};
+    pool.idTokenB = DCT_ID{1};
+    pool.commission = COIN / 1000;
+    pool.reserveA = pool.reserveB = 1000000 * COIN;
+    PoolPrice const maxPrice{std::numeric_limits<int64_t>::max() / CPoolPair::PRECISION, 0};
+    bool forward = true;
+    while (state.KeepRunning()) {
+        pool.Swap({forward ? pool.idTokenA : pool.idTokenB, 100000 * COIN}, maxPrice, [] (CTokenAmount const &) {
+            return Res::Ok();
+        }, false);
+        forward = !forward;
+    }
+}
+
+static void DistributeRewards(benchmark::State& state, int poolsCount, int providersCount)
+{
+    DeFiState defi(poolsCount + 1, poolsCount, providersCount);
+    while (state.KeepRunning()) {
+        CCustomCSView cache(defi.view);
+        cache.DistributeRewards(100 * COIN,
+            [&cache] (CScript const & owner, DCT_ID tokenID) {
+                return cache.GetBalance(owner, tokenID);
+            },
+            [&cache] (CScript const & to, CTokenAmount amount) {
+                return cache.AddBalance(to, amount);
+            },
+            true
+        );
+    }
+}
+
+// One op is one tx applied with undo construction (and history tracking if requested), as in ConnectBlock
+static void ApplyCustomTxMix(benchmark::State& state, int tokensCount, int poolsCount, int providersCount, bool history)
+{
+    DeFiState defi(tokensCount, poolsCount, providersCount);
+    auto const txs = defi.CreateTxMix(BLOCK_TXS * 10);
+    if (history) {
+        gArgs.ForceSetArg("-acindex", "1");
+    }
+
+    std::unique_ptr<CCustomCSView> cache;
+    size_t i = 0;
+    uint64_t const allocationsBefore = g_allocations;
+    while (state.KeepRunning()) {
+        if (i % BLOCK_TXS == 0) {
+            cache = MakeUnique<CCustomCSView>(defi.view);
+        }
+        auto const & tx = *txs[i % txs.size()];
+        ApplyCustomTx(*cache, defi.coins, tx, defi.consensus, 2, i % BLOCK_TXS, false);
+        ++i;
+    }
+    if (i > 0) {
+        std::cerr << strprintf("# %s: %.1f allocations per tx\n", state.m_name, double(g_allocations - allocationsBefore) / i);
+    }
+
+    if (history) {
+        gArgs.ForceSetArg("-acindex", "0");
+    }
+}
+
+static void DistributeRewards10x100(benchmark::State& state) { DistributeRewards(state, 10, 100); }
+static void DistributeRewards50x1000(benchmark::State& state) { DistributeRewards(state, 50, 1000); }
+static void ApplyCustomTxMixSmall(benchmark::State& state) { ApplyCustomTxMix(state, 5, 4, 100, false); }
+static void ApplyCustomTxMixLarge(benchmark::State& state) { ApplyCustomTxMix(state, 30, 100, 5000, false); }
+static void ApplyCustomTxMixHistory(benchmark::State& state) { ApplyCustomTxMix(state, 5, 4, 100, true); }
+
+BENCHMARK(FlushableStorageWrite, 500);
+BENCHMARK(FlushableStorageIterate, 20);
+BENCHMARK(UndoConstructRevert, 500);
+BENCHMARK(PoolPairSwap, 500000);
+BENCHMARK(PoolPairSwapLegacy, 5000);
+BENCHMARK(DistributeRewards10x100, 50);
+BENCHMARK(DistributeRewards50x1000, 2);
+BENCHMARK(ApplyCustomTxMixSmall, 5000);
+BENCHMARK(ApplyCustomTxMixLarge, 5000);
+BENCHMARK(ApplyCustomTxMixHistory, 5000);
@@ -0,0 +1,53 @@
+// Copyright (c) 2020 The DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <masternodes/masternodes.h>
+
+// Per-block cost of pool incentive rewards and trading fees distribution depending on liquidity providers count.
+// One pool with rewards and swap event, every provider holds the same amount of LP tokens.
+static void DistributePoolRewards(benchmark::State& state, int providersCount)
+{
+    CStorageLevelDB db(fs::path("pool_rewards"), 8 << 20, true);
+    CCustomCSView mnview(db);
+
+    DCT_ID const idPool{1};
+    CPoolPair pool;
+    pool.idTokenA = DCT_ID{128};
+    pool.idTokenB = DCT_ID{0};
+    pool.rewardPct = COIN / 2;
+    pool.blockCommissionA = 10 * COIN;
+    pool.blockCommissionB = 20 * COIN;
+    pool.swapEvent = true;
+
+    for (int i = 0; i < providersCount; ++i) {
+        CScript const provider = CScript(i + 1);
+        mnview.SetShare(idPool, provider);
+        mnview.AddBalance(provider, {idPool, COIN});
+        pool.totalLiquidity += COIN;
+    }
+    pool.totalLiquidity += CPoolPair::MINIMUM_LIQUIDITY;
+    mnview.SetPoolPair(idPool, pool);
+
+    while (state.KeepRunning()) {
+        CCustomCSView cache(mnview);
+        cache.DistributeRewards(100 * COIN,
+            [&cache] (CScript const & owner, DCT_ID tokenID) {
+                return cache.GetBalance(owner, tokenID);
+            },
+            [&cache] (CScript const & to, CTokenAmount amount) {
+                return cache.AddBalance(to, amount);
+            },
+            true
+        );
+    }
+}
+
+static void DistributePoolRewards100(benchmark::State& state) { DistributePoolRewards(state, 100); }
+static void DistributePoolRewards1000(benchmark::State& state) { DistributePoolRewards(state, 1000); }
+static void DistributePoolRewards10000(benchmark::State& state) { DistributePoolRewards(state, 10000); }
+
+BENCHMARK(DistributePoolRewards100, 500);
+BENCHMARK(DistributePoolRewards1000, 50);
+BENCHMARK(DistributePoolRewards10000, 5);
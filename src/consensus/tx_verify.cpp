@@ -216,8 +216,7 @@ bool Consensus::CheckTxInputs(const CTransaction& tx, CValidationState& state, c
     }
 
     // check for tokens values
-    std::vector<unsigned char> dummy;
-    const auto txType = GuessCustomTxType(tx, dummy);
+    const auto txType = customTxDecodeCache.Decode(tx)->type;
 
     if (NotAllowedToFail(txType)) {
         auto res = ApplyCustomTx(const_cast<CCustomCSView&>(*mnview), inputs, tx, Params(), nSpendHeight, 0, true); // note for 'isCheck == true' here; 'zero' for txn is dummy value
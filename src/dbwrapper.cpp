@@ -238,6 +238,23 @@ bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::Next() { piter->Next(); }
 
+Span<const unsigned char> CDBIterator::GetValueBytes(std::vector<unsigned char>& buffer) const
+{
+    leveldb::Slice slValue = piter->value();
+    auto const data = reinterpret_cast<const unsigned char*>(slValue.data());
+    auto const & key = dbwrapper_private::GetObfuscateKey(parent);
+    if (std::all_of(key.begin(), key.end(), [](unsigned char c) { return c == 0; })) {
+        return Span<const unsigned char>(data, slValue.size());
+    }
+    buffer.assign(data, data + slValue.size());
+    for (size_t i = 0, j = 0; i != buffer.size(); i++) {
+        buffer[i] ^= key[j++];
+        if (j == key.size())
+            j = 0;
+    }
+    return Span<const unsigned char>(buffer.data(), buffer.size());
+}
+
 namespace dbwrapper_private {
 
 void HandleError(const leveldb::Status& status)
@@ -8,6 +8,7 @@
 #include <clientversion.h>
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
 #include <streams.h>
 #include <util/system.h>
 #include <util/strencodings.h>
@@ -187,6 +188,15 @@ public:
         return piter->value().size();
     }
 
+    //! Raw key bytes, valid until the iterator moves
+    Span<const unsigned char> GetKeyBytes() const {
+        leveldb::Slice slKey = piter->key();
+        return Span<const unsigned char>(reinterpret_cast<const unsigned char*>(slKey.data()), slKey.size());
+    }
+
+    //! Raw value bytes, valid until the iterator moves. Values of obfuscated db are decoded into 'buffer'
+    Span<const unsigned char> GetValueBytes(std::vector<unsigned char>& buffer) const;
+
 };
 
 //template<>
@@ -259,6 +269,13 @@ public:
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
+    {
+        return Read(key, value, nullptr);
+    }
+
+    //! read the state of the 'snapshot' (current state if nullptr)
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -266,8 +283,10 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 //        leveldb::Slice slKey(SliceKey(key));
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -293,7 +312,7 @@ public:
     }
 
     template <typename K>
-    bool Exists(const K& key) const
+    bool Exists(const K& key, const leveldb::Snapshot* snapshot = nullptr) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -301,8 +320,10 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 //        leveldb::Slice slKey(SliceKey(key));
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -337,9 +358,22 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot = nullptr)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
+    //! consistent point-in-time state of the database, has to be released by ReleaseSnapshot
+    const leveldb::Snapshot* GetSnapshot()
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot* snapshot)
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        pdb->ReleaseSnapshot(snapshot);
     }
 
     /**
@@ -10,8 +10,193 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <list>
+#include <mutex>
+#include <set>
+
 using TBytes = std::vector<unsigned char>;
-using MapKV = std::map<TBytes, boost::optional<TBytes>>;
+
+// Sorted write buffer of the flushable storage layer (key -> value or "erased" mark).
+// Small layers (most of per-tx views) live in the flat sorted vector: binary search over contiguous memory
+// and no per-node allocations. Once the layer grows over FLAT_LIMIT (block caches, tip view) it falls back to the tree.
+// Mimics the read-only part of std::map interface, so it could be used as the former 'std::map<TBytes, boost::optional<TBytes>>'.
+// Cleared flat entries are kept as spares, the next insertions reuse their key and value buffers.
+// @attention inserting of a new key invalidates iterators in flat mode, check Version() to detect this
+class CStorageKVWriteBuffer {
+public:
+    using Value = boost::optional<TBytes>;
+    static const size_t FLAT_LIMIT = 128;
+
+private:
+    using Flat = std::vector<std::pair<TBytes, Value>>;
+    using Tree = std::map<TBytes, Value>;
+
+public:
+    // (key, value) pair of references, imitates std::map::value_type
+    struct Entry {
+        TBytes const & first;
+        Value const & second;
+    };
+
+    class const_iterator {
+    public:
+        const_iterator() : flat(nullptr), pos(0) {}
+        const_iterator(Flat const * flat_, size_t pos_) : flat(flat_), pos(pos_) {}
+        explicit const_iterator(Tree::const_iterator it_) : flat(nullptr), pos(0), it(it_) {}
+
+        Entry operator*() const {
+            if (flat) {
+                auto const & kv = (*flat)[pos];
+                return Entry{kv.first, kv.second};
+            }
+            return Entry{it->first, it->second};
+        }
+        struct Arrow {
+            Entry entry;
+            Entry const * operator->() const { return &entry; }
+        };
+        Arrow operator->() const { return Arrow{**this}; }
+
+        const_iterator& operator++() {
+            if (flat) {
+                ++pos;
+            } else {
+                ++it;
+            }
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto result = *this;
+            ++(*this);
+            return result;
+        }
+        bool operator==(const_iterator const & other) const {
+            return flat ? (flat == other.flat && pos == other.pos) : (!other.flat && it == other.it);
+        }
+        bool operator!=(const_iterator const & other) const {
+            return !(*this == other);
+        }
+    private:
+        Flat const * flat;
+        size_t pos;
+        Tree::const_iterator it;
+    };
+    using iterator = const_iterator;
+
+    CStorageKVWriteBuffer() : used(0), version(0) {}
+
+    bool empty() const { return used == 0 && tree.empty(); }
+    size_t size() const { return used + tree.size(); }
+    // changes on every insertion of a new key (and on clear), but not on overwriting of existing one
+    uint64_t Version() const { return version; }
+
+    const_iterator begin() const { return IsFlat() ? const_iterator{&flat, 0} : const_iterator{tree.begin()}; }
+    const_iterator end() const { return IsFlat() ? const_iterator{&flat, used} : const_iterator{tree.end()}; }
+
+    const_iterator lower_bound(TBytes const & key) const {
+        return IsFlat() ? const_iterator{&flat, FlatLowerBound(key)} : const_iterator{tree.lower_bound(key)};
+    }
+    const_iterator upper_bound(TBytes const & key) const {
+        if (IsFlat()) {
+            auto pos = FlatLowerBound(key);
+            return const_iterator{&flat, pos < used && flat[pos].first == key ? pos + 1 : pos};
+        }
+        return const_iterator{tree.upper_bound(key)};
+    }
+    const_iterator find(TBytes const & key) const {
+        if (IsFlat()) {
+            auto pos = FlatLowerBound(key);
+            return const_iterator{&flat, pos < used && flat[pos].first == key ? pos : used};
+        }
+        return const_iterator{tree.find(key)};
+    }
+
+    // inserts "erased" mark for the new key, as std::map::operator[]
+    Value& operator[](TBytes const & key) {
+        bool inserted;
+        auto& value = Slot(key, inserted);
+        if (inserted) {
+            value = boost::none;
+        }
+        return value;
+    }
+
+    // the same as operator[](key) = value, but reuses the buffer of the previous (or spare) value
+    void Set(TBytes const & key, TBytes const & value) {
+        bool inserted;
+        auto& slot = Slot(key, inserted);
+        if (slot) {
+            slot->assign(value.begin(), value.end());
+        } else {
+            slot = value;
+        }
+    }
+
+    void SetErased(TBytes const & key) {
+        bool inserted;
+        Slot(key, inserted) = boost::none;
+    }
+
+    // O(1) while flat, the entries are kept as spares for the next round; after the fallback it frees every tree node
+    void clear() {
+        ++version;
+        used = 0;
+        tree.clear();
+    }
+
+private:
+    bool IsFlat() const { return tree.empty(); }
+
+    size_t FlatLowerBound(TBytes const & key) const {
+        return std::lower_bound(flat.begin(), flat.begin() + used, key, [] (Flat::value_type const & kv, TBytes const & key) {
+            return kv.first < key;
+        }) - flat.begin();
+    }
+
+    // value of the key, the new key gets the spare (or empty) value
+    Value& Slot(TBytes const & key, bool & inserted) {
+        inserted = false;
+        if (!IsFlat()) {
+            auto it = tree.lower_bound(key);
+            if (it == tree.end() || it->first != key) {
+                ++version;
+                inserted = true;
+                it = tree.emplace_hint(it, key, Value{});
+            }
+            return it->second;
+        }
+        auto pos = FlatLowerBound(key);
+        if (pos < used && flat[pos].first == key) {
+            return flat[pos].second;
+        }
+        ++version;
+        inserted = true;
+        if (used < FLAT_LIMIT) {
+            if (used == flat.size()) {
+                flat.emplace_back();
+            }
+            // move the spare into its place
+            std::rotate(flat.begin() + pos, flat.begin() + used, flat.begin() + used + 1);
+            ++used;
+            flat[pos].first.assign(key.begin(), key.end());
+            return flat[pos].second;
+        }
+        // fallback to the tree, flat vector is already sorted
+        for (size_t i = 0; i < used; ++i) {
+            tree.emplace_hint(tree.end(), std::move(flat[i].first), std::move(flat[i].second));
+        }
+        flat.clear();
+        used = 0;
+        return tree.emplace(key, Value{}).first->second;
+    }
+
+    Flat flat;
+    size_t used; // live entries of 'flat', the rest are spares
+    Tree tree;
+    uint64_t version;
+};
+
+using MapKV = CStorageKVWriteBuffer;
 
 template<typename T>
 static TBytes DbTypeToBytes(const T& value) {
@@ -31,6 +216,24 @@ static void BytesToDbType(const TBytes& bytes, T& value) {
     }
 }
 
+// non-owning view of the key or value bytes
+using TBytesSpan = Span<const unsigned char>;
+
+inline TBytesSpan ToSpan(TBytes const & bytes) {
+    return TBytesSpan(bytes.data(), bytes.size());
+}
+
+// decodes right from the memory of iterator (no copying)
+template<typename T>
+static void BytesToDbType(TBytesSpan bytes, T& value) {
+    try {
+        SpanReader stream(SER_DISK, CLIENT_VERSION, bytes);
+        stream >> value;
+    }
+    catch (std::ios_base::failure&) {
+    }
+}
+
 // Key-Value storage iterator interface
 class CStorageKVIterator {
 public:
@@ -38,8 +241,18 @@ public:
     virtual void Seek(const TBytes& key) = 0;
     virtual void Next() = 0;
     virtual bool Valid() = 0;
-    virtual TBytes Key() = 0;
-    virtual TBytes Value() = 0;
+    // zero-copy access, valid until the iterator moves (or the underlying layer is modified)
+    virtual TBytesSpan KeySpan() = 0;
+    virtual TBytesSpan ValueSpan() = 0;
+    // owning copies
+    TBytes Key() {
+        auto key = KeySpan();
+        return TBytes(key.begin(), key.end());
+    }
+    TBytes Value() {
+        auto value = ValueSpan();
+        return TBytes(value.begin(), value.end());
+    }
 };
 
 // Key-Value storage interface
@@ -52,6 +265,8 @@ public:
     virtual bool Read(const TBytes& key, TBytes& value) const = 0;
     virtual std::unique_ptr<CStorageKVIterator> NewIterator() = 0;
     virtual bool Flush() = 0;
+    // read-only point-in-time copy of the storage, not affected by later writes (nullptr if not supported)
+    virtual std::shared_ptr<CStorageKV> Snapshot() { return {}; }
 };
 
 // doesn't serialize/deserialize vector size
@@ -91,23 +306,128 @@ public:
     bool Valid() override {
         return it->Valid();
     }
-    TBytes Key() override {
-        TBytes result;
-        RawTBytes raw{result};
-        return (it->GetKey(raw)) ? result : TBytes{};
+    TBytesSpan KeySpan() override {
+        return it->GetKeyBytes();
     }
-    TBytes Value() override {
-        TBytes result;
-        RawTBytes raw{result};
-        return (it->GetValue(raw)) ? result : TBytes{};
+    TBytesSpan ValueSpan() override {
+        return it->GetValueBytes(buffer);
     }
 private:
     std::unique_ptr<CDBIterator> it;
+    TBytes buffer; // for obfuscated values only
     // No copying allowed
     CStorageLevelDBIterator(const CStorageLevelDBIterator&);
     void operator=(const CStorageLevelDBIterator&);
 };
 
+// Read-only LevelDB snapshot, doesn't see anything written after its creation (including not yet committed batch)
+class CStorageLevelDBSnapshot : public CStorageKV {
+public:
+    explicit CStorageLevelDBSnapshot(CDBWrapper& db_) : db(db_), snapshot(db_.GetSnapshot()) {}
+    CStorageLevelDBSnapshot(const CStorageLevelDBSnapshot&) = delete;
+    ~CStorageLevelDBSnapshot() override {
+        db.ReleaseSnapshot(snapshot);
+    }
+    bool Exists(const TBytes& key) const override {
+        return db.Exists(RawTBytes{(TBytes&)key}, snapshot);
+    }
+    bool Write(const TBytes&, const TBytes&) override {
+        return false;
+    }
+    bool Erase(const TBytes&) override {
+        return false;
+    }
+    bool Read(const TBytes& key, TBytes& value) const override {
+        auto rawVal = RawTBytes{(TBytes&)value};
+        return db.Read(RawTBytes{(TBytes&)key}, rawVal, snapshot);
+    }
+    bool Flush() override {
+        return false;
+    }
+    std::unique_ptr<CStorageKVIterator> NewIterator() override {
+        return MakeUnique<CStorageLevelDBIterator>(std::unique_ptr<CDBIterator>(db.NewIterator(snapshot)));
+    }
+private:
+    CDBWrapper& db;
+    const leveldb::Snapshot* snapshot;
+};
+
+// LRU cache of the db rows (or their absence) for the selected key prefixes only, so frequently read records
+// (pools, tokens etc.) aren't pushed out by the balances churn. Writes go through the cache, it never gets stale.
+class CStorageRowCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        size_t usage;
+        size_t limit;
+    };
+
+    CStorageRowCache(size_t limit_, std::set<unsigned char> prefixes_) : limit(limit_), prefixes(std::move(prefixes_)) {}
+
+    bool IsCached(const TBytes& key) const {
+        return !key.empty() && prefixes.count(key[0]);
+    }
+    // returns false on miss, otherwise 'value' is set to the row or none (if it doesn't exist)
+    bool Get(const TBytes& key, boost::optional<TBytes>& value) {
+        std::lock_guard<std::mutex> lock(cs);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            ++misses;
+            return false;
+        }
+        ++hits;
+        lru.splice(lru.begin(), lru, it->second);
+        value = it->second->second;
+        return true;
+    }
+    void Put(const TBytes& key, boost::optional<TBytes> value) {
+        std::lock_guard<std::mutex> lock(cs);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            usage -= EntryUsage(*it->second);
+            lru.erase(it->second);
+            index.erase(it);
+        }
+        lru.emplace_front(key, std::move(value));
+        index.emplace(key, lru.begin());
+        usage += EntryUsage(lru.front());
+        while (usage > limit && !lru.empty()) {
+            usage -= EntryUsage(lru.back());
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+    void Clear() {
+        std::lock_guard<std::mutex> lock(cs);
+        lru.clear();
+        index.clear();
+        usage = 0;
+    }
+    Stats GetStats() const {
+        std::lock_guard<std::mutex> lock(cs);
+        return Stats{hits, misses, index.size(), usage, limit};
+    }
+
+private:
+    using Entry = std::pair<TBytes, boost::optional<TBytes>>;
+
+    static size_t EntryUsage(const Entry& entry) {
+        // key is stored twice (list and index), plus rough nodes overhead
+        return 2 * entry.first.size() + (entry.second ? entry.second->size() : 0) + 128;
+    }
+
+    const size_t limit;
+    const std::set<unsigned char> prefixes;
+    mutable std::mutex cs;
+    std::list<Entry> lru;
+    std::map<TBytes, std::list<Entry>::iterator> index;
+    size_t usage = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
 // LevelDB glue layer storage
 class CStorageLevelDB : public CStorageKV {
 public:
@@ -115,23 +435,45 @@ public:
         : db{dbName, cacheSize, fMemory, fWipe}, directWrite(fDirectWrite) {}
     ~CStorageLevelDB() override { }
     bool Exists(const TBytes& key) const override {
+        if (rowCache && rowCache->IsCached(key)) {
+            TBytes value;
+            return Read(key, value);
+        }
         return db.Exists(RawTBytes{(TBytes&)key});
     }
     bool Write(const TBytes& key, const TBytes& value) override {
+        if (rowCache && rowCache->IsCached(key))
+            rowCache->Put(key, value);
         if (directWrite)
             return db.Write(RawTBytes{(TBytes&)key}, RawTBytes{(TBytes&)value}, true);
         BatchWrite(RawTBytes{(TBytes&)key}, RawTBytes{(TBytes&)value});
         return true;
     }
     bool Erase(const TBytes& key) override {
+        if (rowCache && rowCache->IsCached(key))
+            rowCache->Put(key, {});
         if (directWrite)
             return db.Erase(RawTBytes{(TBytes&)key}, true);
         BatchErase(RawTBytes{(TBytes&)key});
         return true;
     }
     bool Read(const TBytes& key, TBytes& value) const override {
+        bool const cached = rowCache && rowCache->IsCached(key);
+        if (cached) {
+            boost::optional<TBytes> row;
+            if (rowCache->Get(key, row)) {
+                if (row) {
+                    value = std::move(*row);
+                }
+                return (bool) row;
+            }
+        }
         auto rawVal = RawTBytes{(TBytes&)value};
-        return db.Read(RawTBytes{(TBytes&)key}, rawVal);
+        bool const found = db.Read(RawTBytes{(TBytes&)key}, rawVal);
+        if (cached) {
+            rowCache->Put(key, found ? boost::optional<TBytes>{value} : boost::none);
+        }
+        return found;
     }
     bool Flush() override { // Commit batch
         bool result = true;
@@ -144,6 +486,20 @@ public:
     std::unique_ptr<CStorageKVIterator> NewIterator() override {
         return MakeUnique<CStorageLevelDBIterator>(std::unique_ptr<CDBIterator>(db.NewIterator()));
     }
+    // @attention doesn't include the pending batch, take it between the flushes
+    std::shared_ptr<CStorageKV> Snapshot() override {
+        return std::make_shared<CStorageLevelDBSnapshot>(db);
+    }
+    // caches rows with the given key prefixes, up to 'limit' bytes
+    void EnableRowCache(size_t limit, std::set<unsigned char> prefixes) {
+        rowCache.reset(new CStorageRowCache(limit, std::move(prefixes)));
+    }
+    const CStorageRowCache* GetRowCache() const {
+        return rowCache.get();
+    }
+    size_t DynamicMemoryUsage() const {
+        return db.DynamicMemoryUsage();
+    }
 private:
     template <typename K, typename V>
     void BatchWrite(const K& key, const V& value) {
@@ -163,6 +519,7 @@ private:
     CDBWrapper db;
     boost::scoped_ptr<CDBBatch> batch;
     bool directWrite;
+    std::unique_ptr<CStorageRowCache> rowCache;
 };
 
 // Flashable storage
@@ -171,7 +528,8 @@ private:
 class CFlushableStorageKVIterator : public CStorageKVIterator {
 public:
     explicit CFlushableStorageKVIterator(std::unique_ptr<CStorageKVIterator>&& pIt_, MapKV& map_) : pIt{std::move(pIt_)}, map(map_) {
-        inited = parentOk = mapOk = false;
+        inited = parentOk = parentTaken = mapOk = false;
+        mapVersion = 0;
     }
          // No copying allowed
     CFlushableStorageKVIterator(const CFlushableStorageKVIterator&) = delete;
@@ -181,31 +539,46 @@ public:
         prevKey.clear();
         pIt->Seek(key);
         parentOk = pIt->Valid();
+        parentTaken = false;
         mIt = map.lower_bound(key);
         mapOk = mIt != map.end();
+        mapVersion = map.Version();
         inited = true;
         Next();
     }
     void Next() override {
         if (!inited) throw std::runtime_error("Iterator wasn't inited.");
-        key.clear();
-        value.clear();
+        key = value = TBytesSpan{};
+
+        // parent is moved lazily, to keep its current key/value memory alive while they are in use
+        if (parentTaken) {
+            parentTaken = false;
+            pIt->Next();
+            parentOk = pIt->Valid();
+        }
+
+        // new keys were inserted while iterating (it invalidates map's iterator), so restore position after the last processed key
+        if (mapOk && mapVersion != map.Version()) {
+            mIt = map.upper_bound(prevKey);
+            mapOk = mIt != map.end();
+            mapVersion = map.Version();
+        }
 
         while (mapOk || parentOk) {
             if (mapOk) {
-                while (mapOk && (!parentOk || mIt->first <= pIt->Key())) {
+                while (mapOk && (!parentOk || ToSpan(mIt->first) <= pIt->KeySpan())) {
                     bool ok = false;
 
                     if (mIt->second) {
-                        ok = prevKey.empty() || mIt->first > prevKey;
+                        ok = prevKey.empty() || ToSpan(mIt->first) > ToSpan(prevKey);
                     }
                     else {
                         prevKey = mIt->first;
                     }
                     if (ok) {
-                        key = mIt->first;
-                        value = *mIt->second;
-                        prevKey = key;
+                        key = ToSpan(mIt->first);
+                        value = ToSpan(*mIt->second);
+                        prevKey = mIt->first;
                     }
                     if (mapOk) {
                         mIt++;
@@ -215,45 +588,46 @@ public:
                 }
             }
             if (parentOk) {
-                bool ok = prevKey.empty() || pIt->Key() > prevKey;
+                bool ok = prevKey.empty() || pIt->KeySpan() > ToSpan(prevKey);
                 if (ok) {
-                    key = pIt->Key();
-                    value = pIt->Value();
-                    prevKey = key;
-                }
-                if (parentOk) {
-                    pIt->Next();
-                    parentOk = pIt->Valid();
+                    key = pIt->KeySpan();
+                    value = pIt->ValueSpan();
+                    prevKey.assign(key.begin(), key.end());
+                    parentTaken = true;
+                    return;
                 }
-                if (ok) return;
+                pIt->Next();
+                parentOk = pIt->Valid();
             }
         }
     }
     bool Valid() override {
-        return !key.empty();
+        return key.size() != 0;
     }
-    TBytes Key() override {
+    TBytesSpan KeySpan() override {
         return key;
     }
-    TBytes Value() override {
+    TBytesSpan ValueSpan() override {
         return value;
     }
 private:
     bool inited;
     std::unique_ptr<CStorageKVIterator> pIt;
     bool parentOk;
+    bool parentTaken;
     MapKV& map;
     MapKV::iterator mIt;
+    uint64_t mapVersion;
     bool mapOk;
-    TBytes key;
-    TBytes value;
+    TBytesSpan key;
+    TBytesSpan value;
     TBytes prevKey;
 };
 
 // Flushable Key-Value Storage
 class CFlushableStorageKV : public CStorageKV {
 public:
-    explicit CFlushableStorageKV(CStorageKV& db_) : db(db_) {}
+    explicit CFlushableStorageKV(CStorageKV& db_) : db(&db_) {}
     CFlushableStorageKV(const CFlushableStorageKV& db) = delete;
     ~CFlushableStorageKV() override {}
     bool Exists(const TBytes& key) const override {
@@ -261,20 +635,20 @@ public:
         if (it != changed.end()) {
             return (bool) it->second;
         }
-        return db.Exists(key);
+        return db->Exists(key);
     }
     bool Write(const TBytes& key, const TBytes& value) override {
-        changed[key] = {value};
+        changed.Set(key, value);
         return true;
     }
     bool Erase(const TBytes& key) override {
-        changed[key] = {};
+        changed.SetErased(key);
         return true;
     }
     bool Read(const TBytes& key, TBytes& value) const override {
         auto it = changed.find(key);
         if (it == changed.end()) {
-            return db.Read(key, value);
+            return db->Read(key, value);
         }
         else {
             if (it->second) {
@@ -289,11 +663,11 @@ public:
     bool Flush() override {
         for (auto it = changed.begin(); it != changed.end(); it++) {
             if (!it->second) {
-                if (!db.Erase(it->first))
+                if (!db->Erase(it->first))
                     return false;
             }
             else {
-                if (!db.Write(it->first, it->second.get()))
+                if (!db->Write(it->first, it->second.get()))
                     return false;
             }
         }
@@ -301,16 +675,131 @@ public:
         return true;
     }
     std::unique_ptr<CStorageKVIterator> NewIterator() override {
-        return MakeUnique<CFlushableStorageKVIterator>(db.NewIterator(), changed);
+        return MakeUnique<CFlushableStorageKVIterator>(db->NewIterator(), changed);
+    }
+    // frozen copy of the changes over the snapshot of the parent
+    std::shared_ptr<CStorageKV> Snapshot() override {
+        auto parent = db->Snapshot();
+        if (!parent) {
+            return {};
+        }
+        auto snapshot = std::make_shared<CFlushableStorageKV>(*parent);
+        snapshot->changed = changed;
+        snapshot->parentSnapshot = std::move(parent);
+        return snapshot;
     }
 
     MapKV& GetRaw() {
         return changed;
     }
 
+    // discards the changes and rebinds the layer to another parent, the write buffer keeps its memory for reuse
+    void Reset(CStorageKV& db_) {
+        db = &db_;
+        changed.clear();
+        parentSnapshot.reset();
+    }
+
 private:
-    CStorageKV& db;
+    CStorageKV* db;
     MapKV changed;
+    std::shared_ptr<CStorageKV> parentSnapshot; // owns 'db' of the snapshots
+};
+
+// key range scanned by an iterator: from the seek key up to the last visited one (or up to the end of the storage)
+struct CStorageKVReadRange {
+    TBytes begin;
+    TBytes end;
+    bool unbounded;
+};
+
+class CStorageKVReadRecorderIterator : public CStorageKVIterator {
+public:
+    CStorageKVReadRecorderIterator(std::unique_ptr<CStorageKVIterator>&& pIt_, std::vector<CStorageKVReadRange>& ranges_) : pIt{std::move(pIt_)}, ranges(ranges_), range(0) {}
+    void Seek(const TBytes& key) override {
+        ranges.push_back({key, key, false});
+        range = ranges.size() - 1;
+        pIt->Seek(key);
+        Track();
+    }
+    void Next() override {
+        pIt->Next();
+        Track();
+    }
+    bool Valid() override {
+        return pIt->Valid();
+    }
+    TBytesSpan KeySpan() override {
+        return pIt->KeySpan();
+    }
+    TBytesSpan ValueSpan() override {
+        return pIt->ValueSpan();
+    }
+private:
+    void Track() {
+        auto & r = ranges[range];
+        if (!pIt->Valid()) {
+            r.unbounded = true;
+        } else if (ToSpan(r.end) < pIt->KeySpan()) {
+            auto const key = pIt->KeySpan();
+            r.end.assign(key.begin(), key.end());
+        }
+    }
+
+    std::unique_ptr<CStorageKVIterator> pIt;
+    std::vector<CStorageKVReadRange>& ranges;
+    size_t range;
+};
+
+// Read-only pass-through layer, remembers the keys read from the parent and the scanned ranges.
+// Backs the speculative execution over a storage which isn't modified meanwhile.
+class CStorageKVReadRecorder : public CStorageKV {
+public:
+    explicit CStorageKVReadRecorder(CStorageKV& db_) : db(db_) {}
+    bool Exists(const TBytes& key) const override {
+        keys.insert(key);
+        return db.Exists(key);
+    }
+    bool Write(const TBytes&, const TBytes&) override {
+        return false;
+    }
+    bool Erase(const TBytes&) override {
+        return false;
+    }
+    bool Read(const TBytes& key, TBytes& value) const override {
+        keys.insert(key);
+        return db.Read(key, value);
+    }
+    std::unique_ptr<CStorageKVIterator> NewIterator() override {
+        return MakeUnique<CStorageKVReadRecorderIterator>(db.NewIterator(), ranges);
+    }
+    bool Flush() override {
+        return false;
+    }
+
+    // true if any of the recorded reads could give another result with 'changes' applied to the parent
+    bool Intersects(MapKV const & changes) const {
+        if (changes.empty()) {
+            return false;
+        }
+        for (auto const & key : keys) {
+            if (changes.find(key) != changes.end()) {
+                return true;
+            }
+        }
+        for (auto const & r : ranges) {
+            auto it = changes.lower_bound(r.begin);
+            if (it != changes.end() && (r.unbounded || it->first <= r.end)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    CStorageKV& db;
+    mutable std::set<TBytes> keys;
+    std::vector<CStorageKVReadRange> ranges;
 };
 
 class CStorageView {
@@ -379,11 +868,18 @@ public:
         auto key = std::make_pair(By::prefix, start);
 
         auto it = self.DB().NewIterator();
-        for(it->Seek(DbTypeToBytes(key)); it->Valid() && (BytesToDbType(it->Key(), key), key.first == By::prefix); it->Next()) {
+        for(it->Seek(DbTypeToBytes(key)); it->Valid(); it->Next()) {
             boost::this_thread::interruption_point();
 
+            // prefix is the first byte of the key, check it before decoding
+            auto keySpan = it->KeySpan();
+            if (keySpan[0] != By::prefix) {
+                break;
+            }
+            BytesToDbType(keySpan, key);
+
             ValueType value;
-            BytesToDbType(it->Value(), value);
+            BytesToDbType(it->ValueSpan(), value);
 
             if (!callback(key.second, value))
                 break;
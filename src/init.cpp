@@ -222,6 +222,7 @@ void Shutdown(InitInterfaces& interfaces)
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     peerLogic.reset();
+    panchorAuthVerifier.reset();
     g_connman.reset();
     g_banman.reset();
     g_txindex.reset();
@@ -275,6 +276,7 @@ void Shutdown(InitInterfaces& interfaces)
         panchors.reset();
         panchorAwaitingConfirms.reset();
         panchorauths.reset();
+        ResetViewSnapshot();
         pcustomcsview.reset();
         pcustomcsDB.reset();
         pcriminals.reset();
@@ -400,8 +402,11 @@ void SetupServerArgs()
     gArgs.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS); // omit for devnet
+    gArgs.AddArg("-customcsdbcache=<n>", strprintf("Share of -dbcache in percents used for the enhanced chainstate database, a quarter of it caches pools, tokens and masternodes records (1 to %d, default: %d)", MAX_CUSTOMCS_DBCACHE_SHARE, DEFAULT_CUSTOMCS_DBCACHE_SHARE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-mnundokeep=<n>", strprintf("Prune masternode undo data older than <n> blocks from tip, blocks below that depth can't be disconnected anymore (0 = keep all, otherwise >=%u, default: %u)", MIN_BLOCKS_TO_KEEP, DEFAULT_MN_UNDO_KEEP), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parallelcustomtx", strprintf("Apply custom transactions of a block speculatively on the script verification threads and commit them in block order (default: %u)", DEFAULT_PARALLEL_CUSTOMTX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", DEFI_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
@@ -452,7 +457,7 @@ void SetupServerArgs()
     gArgs.AddArg("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torpassword=<pass>", "Tor control port password (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-masternode_owner=<address>", "Masternode owner address (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-masternode_operator=<address>", "Masternode operator address (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-masternode_operator=<address>", "Masternode operator address, may be specified multiple times to mint by several masternodes (default: empty)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dummypos", "Flag to skip PoS-related checks (regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-txnotokens", "Flag to force old tx serialization (regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-anchorquorum", "Min quorum size (regtest only)", ArgsManager::ALLOW_ANY, OptionsCategory::CHAINPARAMS);
@@ -1111,6 +1116,7 @@ bool AppInitParameterInteraction()
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    fParallelCustomTx = gArgs.GetBoolArg("-parallelcustomtx", DEFAULT_PARALLEL_CUSTOMTX);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
@@ -1130,6 +1136,13 @@ bool AppInitParameterInteraction()
         fPruneMode = true;
     }
 
+    // masternode undo pruning
+    int64_t nUndoKeep = gArgs.GetArg("-mnundokeep", DEFAULT_MN_UNDO_KEEP);
+    if (nUndoKeep < 0 || (nUndoKeep > 0 && nUndoKeep < MIN_BLOCKS_TO_KEEP)) {
+        return InitError(strprintf(_("Masternode undo pruning configured below the minimum of %d blocks.  Please use a higher number.").translated, MIN_BLOCKS_TO_KEEP));
+    }
+    undosPruneStats.keep = (uint32_t) nUndoKeep;
+
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1304,6 +1317,17 @@ bool AppInitMain(InitInterfaces& interfaces)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+        if (fParallelCustomTx) {
+            for (int i=0; i<nScriptCheckThreads-1; i++)
+                threadGroup.create_thread([i]() { return ThreadCustomTxSpeculation(i); });
+        }
+    }
+
+    panchorAuthVerifier = MakeUnique<CAnchorAuthVerifier>();
+    for (int i = 0; i < ANCHOR_AUTH_VERIFY_THREADS; ++i) {
+        threadGroup.create_thread(std::bind(&TraceThread<std::function<void()>>, "anchorauth", [] {
+            panchorAuthVerifier->ThreadVerify();
+        }));
     }
 
     // Start the lightweight task scheduler thread
@@ -1484,6 +1508,10 @@ bool AppInitMain(InitInterfaces& interfaces)
         filter_index_cache = max_cache / n_indexes;
         nTotalCache -= filter_index_cache * n_indexes;
     }
+    int64_t nCustomCSDBShare = std::max<int64_t>(1, std::min(gArgs.GetArg("-customcsdbcache", DEFAULT_CUSTOMCS_DBCACHE_SHARE), MAX_CUSTOMCS_DBCACHE_SHARE));
+    int64_t nCustomCSDBCache = std::min(nTotalCache / 2, std::max(nTotalCache * nCustomCSDBShare / 100, nMinDbCache << 20));
+    nTotalCache -= nCustomCSDBCache;
+    int64_t nCustomCSRowCache = nCustomCSDBCache / 4; // hot records cache, the rest is for leveldb
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1498,6 +1526,7 @@ bool AppInitMain(InitInterfaces& interfaces)
         LogPrintf("* Using %.1f MiB for %s block filter index database\n",
                   filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
     }
+    LogPrintf("* Using %.1f MiB for enhanced chain state database (%.1f MiB of it for hot records)\n", nCustomCSDBCache * (1.0 / 1024 / 1024), nCustomCSRowCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
@@ -1581,11 +1610,45 @@ bool AppInitMain(InitInterfaces& interfaces)
                 pcriminals.reset();
                 pcriminals = MakeUnique<CCriminalsView>(GetDataDir() / "criminals", nMinDbCache << 20, false, fReset || fReindexChainState);
 
+                ResetViewSnapshot();
                 pcustomcsDB.reset();
-                pcustomcsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "enhancedcs", nMinDbCache << 20, false, fReset || fReindexChainState);
+                pcustomcsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "enhancedcs", nCustomCSDBCache - nCustomCSRowCache, false, fReset || fReindexChainState);
+                pcustomcsDB->EnableRowCache(nCustomCSRowCache, GetCustomCSHotPrefixes());
                 pcustomcsview.reset();
                 pcustomcsview = MakeUnique<CCustomCSView>(*pcustomcsDB.get());
 
+                // index account history records written by older versions, the indexes are read only with -acindex
+                if (gArgs.GetBoolArg("-acindex", false)) {
+                    auto start = CAccountsHistoryView::FirstAccountHistoryKey();
+                    uint64_t indexed = 0, records = 0;
+                    bool more;
+                    do {
+                        more = pcustomcsview->BuildAccountHistoryIndex(ACCOUNT_HISTORY_INDEX_BATCH, start, records);
+                        indexed += records;
+                        pcustomcsview->Flush();
+                        pcustomcsDB->Flush();
+                    } while (more);
+                    if (indexed > 0) {
+                        LogPrintf("Account history: indexed %d records\n", indexed);
+                    }
+                }
+
+                // convert balances and pool shares written by older versions to the compact owner keys
+                {
+                    uint32_t undoHeight = 0;
+                    uint64_t upgraded = 0, records = 0;
+                    bool more;
+                    do {
+                        more = pcustomcsview->UpgradeOwnerKeys(OWNER_KEYS_UPGRADE_BATCH, undoHeight, records);
+                        upgraded += records;
+                        pcustomcsview->Flush();
+                        pcustomcsDB->Flush();
+                    } while (more);
+                    if (upgraded > 0) {
+                        LogPrintf("Owner keys: upgraded %d records\n", upgraded);
+                    }
+                }
+
                 panchorauths.reset();
                 panchorauths = MakeUnique<CAnchorAuthIndex>();
                 panchorAwaitingConfirms.reset();
@@ -1711,6 +1774,11 @@ bool AppInitMain(InitInterfaces& interfaces)
         return false;
     }
 
+    if (fCriminals && !pcriminals->WasCleanShutdown()) {
+        LOCK(cs_main);
+        ReplayMintedHeaders();
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1891,6 +1959,13 @@ bool AppInitMain(InitInterfaces& interfaces)
         g_banman->DumpBanlist();
     }, DUMP_BANS_INTERVAL * 1000);
 
+    if (undosPruneStats.keep > 0) {
+        scheduler.scheduleEvery(PruneMasternodeUndos, MN_UNDO_PRUNE_INTERVAL * 1000);
+    }
+    if (fCriminals) {
+        scheduler.scheduleEvery(PruneMintedHeaders, MINTED_HEADERS_PRUNE_INTERVAL * 1000);
+    }
+
     // ********************************************************* Step XX: start spv
     if (spv::pspv)
     {
@@ -1901,23 +1976,28 @@ bool AppInitMain(InitInterfaces& interfaces)
     if(gArgs.GetBoolArg("-gen", DEFAULT_GENERATE)) {
         LOCK(cs_main);
 
-        CTxDestination destination = DecodeDestination(gArgs.GetArg("-masternode_operator", ""));
-
-        CKeyID const operatorId = destination.which() == 1 ? CKeyID(*boost::get<PKHash>(&destination)) :
-                                  (destination.which() == 4 ? CKeyID(*boost::get<WitnessV0KeyHash>(&destination)) : CKeyID());
-        if (operatorId.IsNull()) {
-            LogPrintf("Error: wrong (or empty) masternode_operator address (%s)\n", gArgs.GetArg("-masternode_operator", "").c_str());
+        auto const operators = GetOperatorsFromArgs();
+        if (operators.empty()) {
+            LogPrintf("Error: wrong (or empty) masternode_operator address\n");
             return false;
         }
+        auto const operatorArgs = gArgs.GetArgs("-masternode_operator");
+        for (size_t i = 0; i < operators.size(); ++i) {
+            if (operators[i].IsNull()) {
+                LogPrintf("Error: wrong (or empty) masternode_operator address (%s)\n", operatorArgs[i].c_str());
+                return false;
+            }
+        }
         {
-            pos::ThreadStaker::Args stakerParams{};
-            {
-                std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
-                if (wallets.size() == 0) {
-                    LogPrintf("Warning! wallets not found\n");
-                    return true;
-                }
-                std::shared_ptr<CWallet> defaultWallet = wallets[0];
+            std::vector<pos::ThreadStaker::Args> stakersParams;
+            std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
+            if (wallets.size() == 0) {
+                LogPrintf("Warning! wallets not found\n");
+                return true;
+            }
+
+            for (auto const & operatorId : operators) {
+                pos::ThreadStaker::Args stakerParams{};
 
                 CKey minterKey;
                 bool found =false;
@@ -1928,10 +2008,10 @@ bool AppInitMain(InitInterfaces& interfaces)
                     }
                 }
                 if (!found) {
-                    LogPrintf("Error: masternode operator private key not found\n");
+                    LogPrintf("Error: masternode operator private key not found (%s)\n", operatorId.GetHex());
                     return false;
                 }
-                
+
                 // determine coinbase script for minting thread
                 CTxDestination ownerDest;
                 auto optMasternodeID = pcustomcsview->GetMasternodeIdByOperator(operatorId);
@@ -1956,16 +2036,15 @@ bool AppInitMain(InitInterfaces& interfaces)
 
                 stakerParams.minterKey = minterKey;
                 stakerParams.operatorID = operatorId;
+                stakersParams.push_back(std::move(stakerParams));
             }
 
-            // Mint proof-of-stake blocks in background
+            // Mint proof-of-stake blocks in background, single thread for all the operators
             threadGroup.create_thread([=]() {
                 TraceThread("CoinStaker", [=]() {
-                    // Fill Staker Args
-
                     // Run ThreadStaker
                     pos::ThreadStaker threadStaker{};
-                    threadStaker(stakerParams, chainparams);
+                    threadStaker(stakersParams, chainparams);
                 });
             });
         }
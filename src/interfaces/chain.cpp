@@ -190,6 +190,10 @@ public:
     {
         m_notifications->BlockDisconnected(*block);
     }
+    void AccountBalancesChanged(const CAccounts& balances) override
+    {
+        m_notifications->AccountBalancesChanged(balances);
+    }
     void UpdatedBlockTip(const CBlockIndex* index, const CBlockIndex* fork_index, bool is_ibd) override
     {
         m_notifications->UpdatedBlockTip();
@@ -287,6 +291,11 @@ public:
         LOCK(cs_main);
         return pcustomcsview->GetTokenGuessId(str, id);
     }
+    void forEachAccountBalance(std::function<bool(CScript const & owner, CTokenAmount const & amount)> callback) const override
+    {
+        LOCK(cs_main);
+        pcustomcsview->ForEachBalance(callback);
+    }
     double guessVerificationProgress(const uint256& block_hash) override
     {
         LOCK(cs_main);
@@ -5,9 +5,11 @@
 #ifndef DEFI_INTERFACES_CHAIN_H
 #define DEFI_INTERFACES_CHAIN_H
 
+#include <masternodes/balances.h>   // For CAccounts
 #include <optional.h>               // For Optional and nullopt
 #include <primitives/transaction.h> // For CTransactionRef
 
+#include <functional>
 #include <memory>
 #include <stddef.h>
 #include <stdint.h>
@@ -150,6 +152,8 @@ public:
     virtual bool mnCanSpend(const uint256 & nodeId, int height) const = 0;
     virtual boost::optional<CMasternode> mnExists(const uint256 & nodeId) const = 0;
     virtual std::unique_ptr<CToken> existTokenGuessId(const std::string & str, DCT_ID & id) const = 0;
+    //! Iterate over all account balances, stops when the callback returns false.
+    virtual void forEachAccountBalance(std::function<bool(CScript const & owner, CTokenAmount const & amount)> callback) const = 0;
 
     //! Estimate fraction of total transactions verified if blocks up to
     //! the specified block hash are verified.
@@ -229,6 +233,7 @@ public:
         virtual void TransactionRemovedFromMempool(const CTransactionRef& ptx) {}
         virtual void BlockConnected(const CBlock& block, const std::vector<CTransactionRef>& tx_conflicted) {}
         virtual void BlockDisconnected(const CBlock& block) {}
+        virtual void AccountBalancesChanged(const CAccounts& balances) {}
         virtual void UpdatedBlockTip() {}
         virtual void ChainStateFlushed(const CBlockLocator& locator) {}
     };
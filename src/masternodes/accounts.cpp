@@ -5,31 +5,68 @@
 #include <masternodes/accounts.h>
 
 /// @attention make sure that it does not overlap with those in masternodes.cpp/tokens.cpp/undos.cpp/accounts.cpp !!!
-const unsigned char CAccountsView::ByBalanceKey::prefix = 'a';
+const unsigned char CAccountsView::ByBalanceKey::prefix = 'A';
 
 void CAccountsView::ForEachBalance(std::function<bool(CScript const & owner, CTokenAmount const & amount)> callback, BalanceKey start) const
 {
-    ForEach<ByBalanceKey, BalanceKey, CAmount>([&callback] (BalanceKey const & key, CAmount const & val) {
-        return callback(key.owner, CTokenAmount{key.tokenID, val});
-    }, start);
+    auto& self = const_cast<CAccountsView&>(*this);
+    auto it = self.DB().NewIterator();
+    it->Seek(start.owner.empty() ? TBytes{ByBalanceKey::prefix} : MakeOwnerKey(ByBalanceKey::prefix, GetOwnerID(start.owner), start.tokenID.v));
+
+    OwnerResolver resolve(*this);
+    OwnerID id;
+    DCT_ID tokenID;
+    for (; it->Valid(); it->Next()) {
+        boost::this_thread::interruption_point();
+
+        auto keySpan = it->KeySpan();
+        if (keySpan[0] != ByBalanceKey::prefix) {
+            break;
+        }
+        auto const owner = ParseOwnerKey(keySpan, id, tokenID.v) ? resolve(id) : nullptr;
+        if (!owner) {
+            continue; // not interned owner, can't happen with consistent db
+        }
+        if (!callback(*owner, CTokenAmount{tokenID, BytesToAmount(it->ValueSpan())})) {
+            break;
+        }
+    }
 }
 
 CTokenAmount CAccountsView::GetBalance(CScript const & owner, DCT_ID tokenID) const
 {
-    CAmount val;
-    bool ok = ReadBy<ByBalanceKey>(BalanceKey{owner, tokenID}, val);
-    if (ok) {
-        return CTokenAmount{tokenID, val};
+    TBytes value;
+    if (DB().Read(MakeOwnerKey(ByBalanceKey::prefix, GetOwnerID(owner), tokenID.v), value)) {
+        return CTokenAmount{tokenID, BytesToAmount(ToSpan(value))};
     }
     return CTokenAmount{tokenID, 0};
 }
 
+CAccounts CAccountsView::GetChangedBalances(MapKV const & diff) const
+{
+    CAccounts changed;
+    OwnerResolver resolve(*this);
+    OwnerID id;
+    DCT_ID tokenID;
+
+    for (auto it = diff.lower_bound({ByBalanceKey::prefix}); it != diff.end() && it->first.at(0) == ByBalanceKey::prefix; ++it) {
+        auto const owner = ParseOwnerKey(ToSpan(it->first), id, tokenID.v) ? resolve(id) : nullptr;
+        if (owner) {
+            changed[*owner].balances[tokenID] = it->second ? BytesToAmount(ToSpan(*it->second)) : 0;
+        }
+    }
+    return changed;
+}
+
 Res CAccountsView::SetBalance(CScript const & owner, CTokenAmount amount)
 {
     if (amount.nValue != 0) {
-        WriteBy<ByBalanceKey>(BalanceKey{owner, amount.nTokenId}, amount.nValue);
+        DB().Write(MakeOwnerKey(ByBalanceKey::prefix, InternOwner(owner), amount.nTokenId.v), AmountToBytes(amount.nValue));
     } else {
-        EraseBy<ByBalanceKey>(BalanceKey{owner, amount.nTokenId});
+        auto const key = MakeOwnerKey(ByBalanceKey::prefix, GetOwnerID(owner), amount.nTokenId.v);
+        if (DB().Exists(key)) {
+            DB().Erase(key);
+        }
     }
     return Res::Ok();
 }
@@ -8,10 +8,11 @@
 #include <flushablestorage.h>
 #include <masternodes/res.h>
 #include <masternodes/balances.h>
+#include <masternodes/owners.h>
 #include <amount.h>
 #include <script/script.h>
 
-class CAccountsView : public virtual CStorageView
+class CAccountsView : public virtual COwnersView
 {
 public:
     void ForEachBalance(std::function<bool(CScript const & owner, CTokenAmount const & amount)> callback, BalanceKey start = {}) const;
@@ -22,8 +23,11 @@ public:
     Res SubBalance(CScript const & owner, CTokenAmount amount);
     Res SubBalances(CScript const & owner, CBalances const & balances);
 
+    // resulting balances of the owners touched by the 'diff' layer of this view, erased balances are reported as zero
+    CAccounts GetChangedBalances(MapKV const & diff) const;
+
     // tags
-    struct ByBalanceKey { static const unsigned char prefix; };
+    struct ByBalanceKey { static const unsigned char prefix; }; // compact owner key (owner id, tokenID) -> amount
 
 private:
     Res SetBalance(CScript const & owner, CTokenAmount amount);
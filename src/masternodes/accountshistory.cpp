@@ -8,14 +8,85 @@
 
 /// @attention make sure that it does not overlap with those in masternodes.cpp/tokens.cpp/undos.cpp/accounts.cpp !!!
 const unsigned char CAccountsHistoryView::ByAccountHistoryKey::prefix = 'h'; // don't intersects with CMintedHeadersView::MintedHeaders::prefix due to different DB
+const unsigned char CAccountsHistoryView::ByHeightKey::prefix = 'e';
+const unsigned char CAccountsHistoryView::ByTokenKey::prefix = 'f';
+const unsigned char CAccountsHistoryView::ByIndexVersion::prefix = 'V';
 
-void CAccountsHistoryView::ForEachAccountHistory(std::function<bool(CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs)> callback, AccountHistoryKey start) const
+static const int ACCOUNT_HISTORY_INDEX_VERSION = 1;
+
+void CAccountsHistoryView::ForEachAccountHistory(AccountHistoryCallback callback, AccountHistoryKey start) const
 {
     ForEach<ByAccountHistoryKey, AccountHistoryKey, AccountHistoryValue>([&callback] (AccountHistoryKey const & key, AccountHistoryValue const & val) {
         return callback(key.owner,key.blockHeight, key.txn, val.txid, val.category, val.diff);
     }, start);
 }
 
+bool CAccountsHistoryView::ReadAccountHistory(AccountHistoryHeightKey const & key, AccountHistoryCallback const & callback) const
+{
+    AccountHistoryValue val;
+    if (!ReadBy<ByAccountHistoryKey>(AccountHistoryKey{key.owner, key.blockHeight, key.txn}, val)) {
+        return true; // continue, index is ahead of the record
+    }
+    return callback(key.owner, key.blockHeight, key.txn, val.txid, val.category, val.diff);
+}
+
+void CAccountsHistoryView::ForEachAccountHistoryByHeight(AccountHistoryCallback callback, uint32_t startHeight) const
+{
+    AccountHistoryHeightKey start{startHeight, std::numeric_limits<uint32_t>::max(), CScript{}}; // starting from max txn values
+    ForEach<ByHeightKey, AccountHistoryHeightKey, char>([&] (AccountHistoryHeightKey const & key, char) {
+        return ReadAccountHistory(key, callback);
+    }, start);
+}
+
+void CAccountsHistoryView::ForEachAccountHistoryByToken(DCT_ID const & tokenID, AccountHistoryCallback callback, uint32_t startHeight) const
+{
+    AccountHistoryTokenKey start{tokenID, {startHeight, std::numeric_limits<uint32_t>::max(), CScript{}}};
+    ForEach<ByTokenKey, AccountHistoryTokenKey, char>([&] (AccountHistoryTokenKey const & key, char) {
+        if (key.tokenID != tokenID) {
+            return false; // stop
+        }
+        return ReadAccountHistory(key.key, callback);
+    }, start);
+}
+
+void CAccountsHistoryView::WriteAccountHistoryIndex(CScript const & owner, uint32_t height, uint32_t txn, TAmounts const & diff)
+{
+    AccountHistoryHeightKey key{height, txn, owner};
+    WriteBy<ByHeightKey>(key, '\0');
+    for (auto const & kv : diff) {
+        WriteBy<ByTokenKey>(AccountHistoryTokenKey{kv.first, key}, '\0');
+    }
+}
+
+AccountHistoryKey CAccountsHistoryView::FirstAccountHistoryKey()
+{
+    return AccountHistoryKey{CScript{}, std::numeric_limits<uint32_t>::max(), std::numeric_limits<uint32_t>::max()};
+}
+
+bool CAccountsHistoryView::BuildAccountHistoryIndex(size_t limit, AccountHistoryKey & start, uint64_t & records)
+{
+    records = 0;
+    int version = 0;
+    if (Read(ByIndexVersion::prefix, version) && version >= ACCOUNT_HISTORY_INDEX_VERSION) {
+        return false;
+    }
+    bool more = false;
+    ForEachAccountHistory([&] (CScript const & owner, uint32_t height, uint32_t txn, uint256 const &, unsigned char, TAmounts const & diff) {
+        if (records >= limit) {
+            start = AccountHistoryKey{owner, height, txn}; // next call starts here
+            more = true;
+            return false;
+        }
+        WriteAccountHistoryIndex(owner, height, txn, diff);
+        ++records;
+        return true;
+    }, start);
+    if (!more) {
+        Write(ByIndexVersion::prefix, ACCOUNT_HISTORY_INDEX_VERSION);
+    }
+    return more;
+}
+
 Res CAccountsHistoryView::SetAccountHistory(const CScript & owner, uint32_t height, uint32_t txn, const uint256 & txid, unsigned char category, TAmounts const & diff)
 {
 ////  left for debug:
@@ -28,6 +99,7 @@ Res CAccountsHistoryView::SetAccountHistory(const CScript & owner, uint32_t heig
 //    LogPrintf("DEBUG: SetAccountHistory: owner: %s, ownerStr: %s, block: %i, txn: %d, txid: %s, diffs: %ld\n", owner.GetHex().c_str(), ownerStr.c_str(), height, txn, txid.ToString().c_str(), diff.size());
 
     WriteBy<ByAccountHistoryKey>(AccountHistoryKey{owner, height, txn}, AccountHistoryValue{txid, category, diff});
+    WriteAccountHistoryIndex(owner, height, txn, diff);
     return Res::Ok();
 }
 
@@ -35,22 +107,30 @@ bool CAccountsHistoryView::TrackAffectedAccounts(CStorageKV const & before, MapK
     if (!gArgs.GetBoolArg("-acindex", false))
         return false;
 
-    std::map<CScript, TAmounts> balancesDiff;
-    using TKey = std::pair<unsigned char, BalanceKey>;
+    // balance keys of the same owner are adjacent, so the diff is collected owner by owner.
+    // history is written after the loop, the diff is the own write buffer of this view
+    static thread_local std::vector<std::pair<CScript, TAmounts>> balancesDiff; // keeps its capacity between txs
+    balancesDiff.clear();
+    OwnerResolver resolve(*this);
+    TBytes beforeVal;
+    OwnerID id;
+    DCT_ID tokenID;
 
     for (auto it = diff.lower_bound({CAccountsView::ByBalanceKey::prefix}); it != diff.end() && it->first.at(0) == CAccountsView::ByBalanceKey::prefix; ++it) {
-        CAmount oldAmount = 0, newAmount = 0;
-
-        if (it->second) {
-            BytesToDbType(*it->second, newAmount);
+        if (!ParseOwnerKey(ToSpan(it->first), id, tokenID.v)) {
+            continue;
+        }
+        bool const sameOwner = resolve.id && *resolve.id == id;
+        auto const owner = resolve(id);
+        if (!owner) {
+            continue;
         }
-        TBytes beforeVal;
-        if (before.Read(it->first, beforeVal)) {
-            BytesToDbType(beforeVal, oldAmount);
+        if (!sameOwner || balancesDiff.empty()) {
+            balancesDiff.emplace_back(*owner, TAmounts{});
         }
-        TKey balanceKey;
-        BytesToDbType(it->first, balanceKey);
-        balancesDiff[balanceKey.second.owner][balanceKey.second.tokenID] = newAmount - oldAmount;
+        CAmount const newAmount = it->second ? BytesToAmount(ToSpan(*it->second)) : 0;
+        CAmount const oldAmount = before.Read(it->first, beforeVal) ? BytesToAmount(ToSpan(beforeVal)) : 0;
+        balancesDiff.back().second[tokenID] = newAmount - oldAmount;
     }
     for (auto const & kv : balancesDiff) {
         SetAccountHistory(kv.first, height, txn, txid, category, kv.second);
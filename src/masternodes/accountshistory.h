@@ -6,6 +6,7 @@
 #define DEFI_MASTERNODES_ACCOUNTSHISTORY_H
 
 #include <flushablestorage.h>
+#include <masternodes/owners.h>
 #include <masternodes/res.h>
 #include <amount.h>
 #include <script/script.h>
@@ -38,6 +39,46 @@ struct AccountHistoryKey {
     }
 };
 
+// secondary index of the history: latest heights go first
+struct AccountHistoryHeightKey {
+    uint32_t blockHeight;
+    uint32_t txn;
+    CScript owner;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        if (ser_action.ForRead()) {
+            READWRITE(WrapBigEndian(blockHeight));
+            blockHeight = ~blockHeight;
+            READWRITE(WrapBigEndian(txn));
+            txn = ~txn;
+        }
+        else {
+            uint32_t blockHeight_ = ~blockHeight;
+            READWRITE(WrapBigEndian(blockHeight_));
+            uint32_t txn_ = ~txn;
+            READWRITE(WrapBigEndian(txn_));
+        }
+        READWRITE(owner);
+    }
+};
+
+// per-token posting list of the history, latest heights go first
+struct AccountHistoryTokenKey {
+    DCT_ID tokenID;
+    AccountHistoryHeightKey key;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(WrapBigEndian(tokenID.v));
+        READWRITE(key);
+    }
+};
+
 struct AccountHistoryValue {
     uint256 txid;
     unsigned char category;
@@ -53,15 +94,34 @@ struct AccountHistoryValue {
     }
 };
 
-class CAccountsHistoryView : public virtual CStorageView
+class CAccountsHistoryView : public virtual COwnersView
 {
 public:
+    using AccountHistoryCallback = std::function<bool(CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diff)>;
+
     Res SetAccountHistory(CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diff);
-    void ForEachAccountHistory(std::function<bool(CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diff)> callback, AccountHistoryKey start) const;
+    void ForEachAccountHistory(AccountHistoryCallback callback, AccountHistoryKey start) const;
+    // all owners, from the 'startHeight' downto genesis
+    void ForEachAccountHistoryByHeight(AccountHistoryCallback callback, uint32_t startHeight) const;
+    // all owners, only records with 'tokenID' in diff, from the 'startHeight' downto genesis
+    void ForEachAccountHistoryByToken(DCT_ID const & tokenID, AccountHistoryCallback callback, uint32_t startHeight) const;
     bool TrackAffectedAccounts(CStorageKV const & before, MapKV const & diff, uint32_t height, uint32_t txn, const uint256 & txid, unsigned char category);
 
+    // one-time indexing of the records written before the secondary indexes were introduced.
+    // indexes about 'limit' records per call ('start' keeps the progress), returns false once the indexes are complete
+    bool BuildAccountHistoryIndex(size_t limit, AccountHistoryKey & start, uint64_t & records);
+    // the initial 'start' of BuildAccountHistoryIndex
+    static AccountHistoryKey FirstAccountHistoryKey();
+
     // tags
     struct ByAccountHistoryKey { static const unsigned char prefix; };
+    struct ByHeightKey { static const unsigned char prefix; }; // ~height+~txn+owner -> {}
+    struct ByTokenKey { static const unsigned char prefix; }; // tokenID+~height+~txn+owner -> {}
+    struct ByIndexVersion { static const unsigned char prefix; }; // single record with version of secondary indexes
+
+private:
+    void WriteAccountHistoryIndex(CScript const & owner, uint32_t height, uint32_t txn, TAmounts const & diff);
+    bool ReadAccountHistory(AccountHistoryHeightKey const & key, AccountHistoryCallback const & callback) const;
 };
 
 #endif //DEFI_MASTERNODES_ACCOUNTSHISTORY_H
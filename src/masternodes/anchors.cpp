@@ -20,6 +20,7 @@
 #include <tuple>
 
 std::unique_ptr<CAnchorAuthIndex> panchorauths;
+std::unique_ptr<CAnchorAuthVerifier> panchorAuthVerifier;
 std::unique_ptr<CAnchorIndex> panchors;
 std::unique_ptr<CAnchorAwaitingConfirms> panchorAwaitingConfirms;
 
@@ -58,6 +59,7 @@ bool CAnchorAuthMessage::SignWithKey(const CKey& key)
     if (!key.SignCompact(GetSignHash(), signature)) {
         signature.clear();
     }
+    signer = boost::none;
     return !signature.empty();
 }
 
@@ -68,8 +70,11 @@ bool CAnchorAuthMessage::GetPubKey(CPubKey& pubKey) const
 
 CKeyID CAnchorAuthMessage::GetSigner() const
 {
-    CPubKey pubKey;
-    return (!signature.empty() && pubKey.RecoverCompact(GetSignHash(), signature)) ? pubKey.GetID() : CKeyID{};
+    if (!signer) {
+        CPubKey pubKey;
+        signer = GetPubKey(pubKey) ? pubKey.GetID() : CKeyID{};
+    }
+    return *signer;
 }
 
 CAnchor CAnchor::Create(const std::vector<CAnchorAuthMessage> & auths, CTxDestination const & rewardDest)
@@ -146,15 +151,14 @@ bool CAnchorAuthIndex::ValidateAuth(const CAnchorAuthIndex::Auth & auth) const
         return error("%s: Can't get block from height: %d !", __func__, auth.height);
     }
 
-    if (auth.nextTeam != pcustomcsview->CalcNextTeam(block->stakeModifier)) {
+    if (auth.nextTeam != GetNextTeamCached(block->stakeModifier)) {
         return error("%s: Wrong nextTeam for auth %s!!!", __func__, auth.GetHash().ToString());
     }
 
-    CPubKey pubKey;
-    if (!auth.GetPubKey(pubKey)) {
-        return error("%s: Can't recover pubkey from sig, auth: ", __func__, auth.GetHash().ToString());
+    const CKeyID masternodeKey{auth.GetSigner()};
+    if (masternodeKey.IsNull()) {
+        return error("%s: Can't recover pubkey from sig, auth: %s", __func__, auth.GetHash().ToString());
     }
-    const CKeyID masternodeKey{pubKey.GetID()};
     if (team.find(masternodeKey) == team.end()) {
         return error("%s: Recovered keyID %s is not a current team member!", __func__, masternodeKey.ToString());
     }
@@ -168,6 +172,65 @@ bool CAnchorAuthIndex::AddAuth(const CAnchorAuthIndex::Auth & auth)
     return auths.insert(auth).second;
 }
 
+bool CAnchorAuthVerifier::Enqueue(const CAnchorAuthMessage & auth, Callback callback)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (queue.size() >= ANCHOR_AUTH_VERIFY_QUEUE) {
+            return false;
+        }
+        queue.emplace_back(auth, std::move(callback));
+    }
+    cond.notify_one();
+    return true;
+}
+
+void CAnchorAuthVerifier::ThreadVerify()
+{
+    while (true) {
+        Batch batch;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty()) {
+                cond.wait(lock); // interruption point
+            }
+            while (!queue.empty() && batch.size() < ANCHOR_AUTH_VERIFY_BATCH) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+        // the expensive part, the signer stays cached within the message
+        for (auto const & item : batch) {
+            item.first.GetSigner();
+        }
+        Process(batch);
+    }
+}
+
+void CAnchorAuthVerifier::Process(Batch const & batch)
+{
+    LOCK(cs_main);
+    if (!panchorauths) {
+        return;
+    }
+    for (auto const & item : batch) {
+        auto const & auth = item.first;
+        Result result;
+        // don't check spv here, but only our anchor index!
+        if (panchorauths->GetAuth(auth.GetHash())) {
+            result = Result::Known;
+        } else if (panchorauths->GetVote(auth.GetSignHash(), auth.GetSigner())) {
+            result = Result::DoubleSign;
+        } else {
+            LogPrintf("Got anchor auth, hash %s, blockheight: %d\n", auth.GetHash().ToString(), auth.height);
+            result = panchorauths->ValidateAuth(auth) && panchorauths->AddAuth(auth) ? Result::Accepted : Result::Invalid;
+        }
+        if (item.second) {
+            item.second(auth, result);
+        }
+    }
+}
+
 uint32_t GetMinAnchorQuorum(CCustomCSView::CTeam const & team)
 {
     if (Params().NetworkIDString() == "regtest") {
@@ -667,8 +730,9 @@ bool CAnchorAwaitingConfirms::Validate(CAnchorConfirmMessage const &confirmMessa
         LogPrintf("AnchorConfirms::Validate: Warning! Signature incorrect. btcTxHash: %s confirmMessageHash: %s Key: %s\n", confirmMessage.btcTxHash.ToString(), confirmMessage.GetHash().ToString(), signer.ToString());
         return false;
     }
-    auto it = pcustomcsview->GetMasternodeIdByOperator(signer);
-    if (!it || !pcustomcsview->GetMasternode(*it)->IsActive()) {
+    auto const registry = GetMasternodesRegistry();
+    auto const entry = registry->GetByOperator(signer);
+    if (!entry || !entry->node.IsActive()) {
         LogPrintf("AnchorConfirms::Validate: Warning! Masternode with operator key %s does not exist or not active!\n", signer.ToString());
         return false;
     }
@@ -691,8 +755,9 @@ void CAnchorAwaitingConfirms::ReVote()
 {
     AssertLockHeld(cs_main);
 
-    auto myIDs = pcustomcsview->AmIOperator();
-    if (myIDs && pcustomcsview->GetMasternode(myIDs->second)->IsActive()) {
+    auto const registry = GetMasternodesRegistry();
+    auto myIDs = registry->AmIOperator();
+    if (myIDs && registry->Get(myIDs->second)->node.IsActive()) {
         auto const & currentTeam = pcustomcsview->GetCurrentTeam();
         if (currentTeam.find(myIDs->first) != currentTeam.end()) {
 
@@ -11,6 +11,7 @@
 #include <serialize.h>
 #include <uint256.h>
 
+#include <deque>
 #include <functional>
 #include <vector>
 
@@ -82,6 +83,7 @@ public:
     uint256 GetHash() const;
     bool SignWithKey(const CKey& key);
     bool GetPubKey(CPubKey& pubKey) const;
+    // recovered once and cached, the multiindex calls it on every insertion comparison
     CKeyID GetSigner() const;
 
     ADD_SERIALIZE_METHODS;
@@ -90,6 +92,9 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action) {
          READWRITEAS(CAnchorData, *this);
          READWRITE(signature);
+         if (ser_action.ForRead()) {
+             signer = boost::none;
+         }
     }
 
     // tags for multiindex
@@ -100,6 +105,7 @@ public:
 
 private:
     Signature signature;
+    mutable boost::optional<CKeyID> signer;
 };
 
 class CAnchor : public CAnchorData
@@ -186,6 +192,29 @@ protected:
     Auths auths;
 };
 
+/// Verifies incoming auths on the worker threads: signers are recovered off cs_main,
+/// then every batch is validated and inserted into panchorauths under a single cs_main lock
+class CAnchorAuthVerifier
+{
+public:
+    enum class Result { Accepted, Known, DoubleSign, Invalid };
+    // called under cs_main with the verification result
+    using Callback = std::function<void(CAnchorAuthMessage const & auth, Result result)>;
+    using Batch = std::vector<std::pair<CAnchorAuthMessage, Callback>>;
+
+    // returns false if the queue is full
+    bool Enqueue(CAnchorAuthMessage const & auth, Callback callback);
+    // worker thread loop, exits on thread interruption
+    void ThreadVerify();
+    // validates and inserts the batch (takes cs_main)
+    static void Process(Batch const & batch);
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::pair<CAnchorAuthMessage, Callback>> queue;
+};
+
 class CAnchorIndex
 {
 private:
@@ -439,4 +468,14 @@ extern std::unique_ptr<CAnchorAuthIndex> panchorauths;
 extern std::unique_ptr<CAnchorIndex> panchors;
 extern std::unique_ptr<CAnchorAwaitingConfirms> panchorAwaitingConfirms;
 
+/** Number of worker threads verifying incoming auths */
+static const int ANCHOR_AUTH_VERIFY_THREADS = 2;
+/** Max auths validated under a single cs_main lock */
+static const size_t ANCHOR_AUTH_VERIFY_BATCH = 64;
+/** Max auths waiting for verification, the rest are dropped (they may be requested again later) */
+static const size_t ANCHOR_AUTH_VERIFY_QUEUE = 10000;
+
+/** Incoming auths verifier, thread safe (nullptr if the worker threads aren't started) */
+extern std::unique_ptr<CAnchorAuthVerifier> panchorAuthVerifier;
+
 #endif // DEFI_MASTERNODES_ANCHORS_H
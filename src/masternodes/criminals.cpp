@@ -4,35 +4,20 @@
 
 #include <masternodes/criminals.h>
 #include <masternodes/masternodes.h>
-
-static const unsigned int DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL = 100;
+#include <validation.h>
 
 const unsigned char CMintedHeadersView::MintedHeaders ::prefix = 'h';
 const unsigned char CCriminalProofsView::Proofs       ::prefix = 'm';
+const unsigned char CCriminalsView::CleanShutdown     ::prefix = 'c';
 
-struct DBMNBlockHeadersKey
-{
-    uint256 masternodeID;
-    uint64_t mintedBlocks;
-    uint256 blockHash;
-
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action)
-    {
-        READWRITE(masternodeID);
-        READWRITE(mintedBlocks);
-        READWRITE(blockHash);
-    }
-};
+// next key to be scanned by the pruner
+static DBMNBlockHeadersKey mintedHeadersPruneCursor GUARDED_BY(cs_main) = DBMNBlockHeadersKey{};
 
 void CMintedHeadersView::WriteMintedBlockHeader(const uint256 & txid, const uint64_t mintedBlocks, const uint256 & hash, const CBlockHeader & blockHeader, bool fIsFakeNet)
 {
     if (fIsFakeNet) {
         return;
     }
-    // directly!
     WriteBy<MintedHeaders>(DBMNBlockHeadersKey{txid, mintedBlocks, hash}, blockHeader);
 }
 
@@ -58,10 +43,35 @@ bool CMintedHeadersView::FetchMintedHeaders(const uint256 & txid, const uint64_t
 
 void CMintedHeadersView::EraseMintedBlockHeader(const uint256 & txid, const uint64_t mintedBlocks, const uint256 & hash)
 {
-    // directly!
     EraseBy<MintedHeaders>(DBMNBlockHeadersKey{txid, mintedBlocks, hash});
 }
 
+size_t CMintedHeadersView::PruneMintedHeaders(uint64_t height, size_t limit, DBMNBlockHeadersKey & cursor)
+{
+    std::vector<DBMNBlockHeadersKey> outdated;
+    size_t scanned = 0;
+    bool reachedEnd = true;
+    ForEach<MintedHeaders,DBMNBlockHeadersKey,CBlockHeader>([&] (DBMNBlockHeadersKey const & key, CBlockHeader & blockHeader) {
+        if (scanned++ == limit) {
+            cursor = key;
+            reachedEnd = false;
+            return false;
+        }
+        if (blockHeader.height < height) {
+            outdated.push_back(key);
+        }
+        return true;
+    }, cursor);
+
+    if (reachedEnd) {
+        cursor = DBMNBlockHeadersKey{};
+    }
+    for (auto const & key : outdated) {
+        EraseBy<MintedHeaders>(key);
+    }
+    return outdated.size();
+}
+
 void CCriminalProofsView::AddCriminalProof(const uint256 & id, const CBlockHeader & blockHeader, const CBlockHeader & conflictBlockHeader) {
     WriteBy<Proofs>(id, CDoubleSignFact{blockHeader, conflictBlockHeader});
     LogPrintf("Add criminal proof for node %s, blocks: %s, %s\n", id.ToString(), blockHeader.GetHash().ToString(), conflictBlockHeader.GetHash().ToString());
@@ -89,6 +99,46 @@ CCriminalProofsView::CMnCriminals CCriminalProofsView::GetUnpunishedCriminals()
 
 }
 
+CCriminalsView::CCriminalsView(CStorageLevelDB * db_)
+    : CStorageView(new CFlushableStorageKV(*db_))
+    , db(db_)
+{
+    // the mark is erased right away, so it survives only a clean shutdown
+    cleanShutdown = Exists(CleanShutdown::prefix);
+    if (cleanShutdown) {
+        Erase(CleanShutdown::prefix);
+        Flush();
+    }
+}
+
+CCriminalsView::~CCriminalsView()
+{
+    Write(CleanShutdown::prefix, true);
+    Flush();
+}
+
+bool CCriminalsView::Flush()
+{
+    return DB().Flush() && db->Flush();
+}
+
+void PruneMintedHeaders()
+{
+    LOCK(cs_main);
+    if (!pcriminals) {
+        return;
+    }
+    auto const tipHeight = (uint64_t) ::ChainActive().Height();
+    if (tipHeight <= MINTED_HEADERS_KEEP_DEPTH) {
+        return;
+    }
+    auto const pruned = pcriminals->PruneMintedHeaders(tipHeight - MINTED_HEADERS_KEEP_DEPTH, MINTED_HEADERS_PRUNE_BATCH, mintedHeadersPruneCursor);
+    if (pruned > 0) {
+        pcriminals->Flush();
+        LogPrint(BCLog::BENCH, "%s: pruned %d minted headers\n", __func__, pruned);
+    }
+}
+
 bool IsDoubleSignRestricted(uint64_t height1, uint64_t height2)
 {
     return (std::max(height1, height2) - std::min(height1, height2)) <= DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL;
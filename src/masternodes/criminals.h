@@ -32,12 +32,32 @@ public:
 };
 
 
+struct DBMNBlockHeadersKey
+{
+    uint256 masternodeID;
+    uint64_t mintedBlocks;
+    uint256 blockHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(masternodeID);
+        READWRITE(mintedBlocks);
+        READWRITE(blockHash);
+    }
+};
+
 class CMintedHeadersView : public virtual CStorageView
 {
 public:
     void WriteMintedBlockHeader(uint256 const & txid, uint64_t const mintedBlocks, uint256 const & hash, CBlockHeader const & blockHeader, bool fIsFakeNet);
     bool FetchMintedHeaders(uint256 const & txid, uint64_t const mintedBlocks, std::map<uint256, CBlockHeader> & blockHeaders, bool fIsFakeNet);
     void EraseMintedBlockHeader(uint256 const & txid, uint64_t const mintedBlocks, uint256 const & hash);
+    // scans up to 'limit' headers from 'cursor' and erases ones below 'height', returns the number of erased.
+    // 'cursor' is set to the key to continue from, or reset if the end was reached
+    size_t PruneMintedHeaders(uint64_t height, size_t limit, DBMNBlockHeadersKey & cursor);
 
     struct MintedHeaders { static const unsigned char prefix; };
 };
@@ -55,21 +75,45 @@ public:
     struct Proofs { static const unsigned char prefix; };
 };
 
-// "off-chain" data, should be written directly
+// "off-chain" data, buffered in memory and committed by Flush() (once per headers message or block)
 class CCriminalsView
         : public CMintedHeadersView
         , public CCriminalProofsView
 {
 public:
     CCriminalsView(const fs::path& dbName, std::size_t cacheSize, bool fMemory = false, bool fWipe = false)
-        : CStorageView(new CStorageLevelDB(dbName, cacheSize, fMemory, fWipe, true)) // direct!
+        : CCriminalsView(new CStorageLevelDB(dbName, cacheSize, fMemory, fWipe))
     {}
+    ~CCriminalsView();
+
+    bool Flush();
+    // false if the previous session didn't close the db, so the recent minted headers should be replayed
+    bool WasCleanShutdown() const { return cleanShutdown; }
 
+    struct CleanShutdown { static const unsigned char prefix; };
+
+private:
+    explicit CCriminalsView(CStorageLevelDB * db_);
+
+    std::unique_ptr<CStorageLevelDB> db;
+    bool cleanShutdown;
 };
 
 /** Global variable that holds CCriminalsView (should be protected by cs_main) */
 extern std::unique_ptr<CCriminalsView> pcriminals;
 
+static const unsigned int DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL = 100;
+/** Minted headers are matched with the new ones within the double-sign interval only,
+ *  twice the interval below the tip leaves the room for the headers of the recent forks */
+static const unsigned int MINTED_HEADERS_KEEP_DEPTH = 2 * DOUBLE_SIGN_MINIMUM_PROOF_INTERVAL;
+/** Max minted headers scanned by a single pruner run (keeps cs_main hold short) */
+static const size_t MINTED_HEADERS_PRUNE_BATCH = 10000;
+/** Interval in seconds between minted headers pruner runs */
+static const int64_t MINTED_HEADERS_PRUNE_INTERVAL = 60;
+
+/** Prunes one batch of minted headers that can't be matched with the new headers anymore */
+void PruneMintedHeaders();
+
 bool IsDoubleSignRestricted(uint64_t height1, uint64_t height2);
 bool IsDoubleSigned(CBlockHeader const & oneHeader, CBlockHeader const & twoHeader, CKeyID & minter);
 
@@ -16,6 +16,7 @@
 #include <wallet/wallet.h>
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 
 /// @attention make sure that it does not overlap with those in tokens.cpp !!!
@@ -27,6 +28,9 @@ const unsigned char DB_MN_HEIGHT = 'H';       // single record with last process
 const unsigned char DB_MN_ANCHOR_REWARD = 'r';
 const unsigned char DB_MN_CURRENT_TEAM = 't';
 const unsigned char DB_MN_FOUNDERS_DEBT = 'd';
+const unsigned char DB_MN_OWNER_KEYS_VERSION = 'v'; // single record with version of balances/shares keys format
+const unsigned char DB_LEGACY_BALANCES = 'a';       // script keyed balances, before OWNER_KEYS_VERSION 1
+const unsigned char DB_LEGACY_SHARES = 'k';         // script keyed pool shares, before OWNER_KEYS_VERSION 1
 
 const unsigned char CMasternodesView::ID      ::prefix = DB_MASTERNODES;
 const unsigned char CMasternodesView::Operator::prefix = DB_MN_OPERATORS;
@@ -35,6 +39,18 @@ const unsigned char CAnchorRewardsView::BtcTx ::prefix = DB_MN_ANCHOR_REWARD;
 
 std::unique_ptr<CCustomCSView> pcustomcsview;
 std::unique_ptr<CStorageLevelDB> pcustomcsDB;
+CUndosPruneStats undosPruneStats;
+
+static CCriticalSection cs_viewSnapshot;
+static std::shared_ptr<CCustomCSView> viewSnapshot GUARDED_BY(cs_viewSnapshot);
+static uint64_t viewSnapshotGeneration GUARDED_BY(cs_viewSnapshot) = 0;
+static std::atomic<uint64_t> viewGeneration{1};
+static std::map<uint256, CTeamView::CTeam> nextTeamCache GUARDED_BY(cs_main);
+static uint64_t nextTeamCacheGeneration GUARDED_BY(cs_main) = 0;
+static std::shared_ptr<const CPoolGraph> poolGraph; // accessed by std::atomic_load/atomic_store only
+static std::shared_ptr<const CTokensTable> tokensTable; // accessed by std::atomic_load/atomic_store only
+static std::atomic<uint64_t> tokensTableVersion{0};
+static std::shared_ptr<const CMasternodesRegistry> masternodesRegistry; // accessed by std::atomic_load/atomic_store only
 
 int GetMnActivationDelay()
 {
@@ -277,12 +293,19 @@ bool CMasternodesView::UnbanCriminal(const uint256 txid, std::vector<unsigned ch
 
 boost::optional<std::pair<CKeyID, uint256> > CMasternodesView::AmIOperator() const
 {
-    CTxDestination dest = DecodeDestination(gArgs.GetArg("-masternode_operator", ""));
-    CKeyID const authAddress = dest.which() == 1 ? CKeyID(*boost::get<PKHash>(&dest)) : (dest.which() == 4 ? CKeyID(*boost::get<WitnessV0KeyHash>(&dest)) : CKeyID());
-    if (!authAddress.IsNull()) {
-        auto nodeId = GetMasternodeIdByOperator(authAddress);
+    for (auto const & authAddress : GetOperatorsFromArgs()) {
+        if (auto ids = AmIOperator(authAddress))
+            return ids;
+    }
+    return {};
+}
+
+boost::optional<std::pair<CKeyID, uint256> > CMasternodesView::AmIOperator(CKeyID const & operatorAuthAddress) const
+{
+    if (!operatorAuthAddress.IsNull()) {
+        auto nodeId = GetMasternodeIdByOperator(operatorAuthAddress);
         if (nodeId)
-            return { std::make_pair(authAddress, *nodeId) };
+            return { std::make_pair(operatorAuthAddress, *nodeId) };
     }
     return {};
 }
@@ -431,6 +454,231 @@ void CAnchorRewardsView::ForEachAnchorReward(std::function<bool (const CAnchorRe
     ForEach<BtcTx, AnchorTxHash, RewardTxHash>(callback);
 }
 
+/*
+ *  CMasternodesRegistry
+ */
+CMasternodesRegistry::CMasternodesRegistry(CMasternodesView & view, int height_)
+    : height(height_)
+{
+    std::vector<decltype(nodes)::Item> allNodes;
+    std::vector<decltype(candidates)::Item> allCandidates;
+    std::vector<decltype(finals)::Item> allFinals;
+    view.ForEachMasternode([&] (uint256 const & id, CMasternode & node) {
+        auto const finalHeight = FinalHeight(node);
+        if (finalHeight != NEVER_FINAL) {
+            allFinals.emplace_back(FinalKey{finalHeight, id}, '\0');
+        }
+        if (height < finalHeight) {
+            allCandidates.emplace_back(id, '\0');
+        }
+        allNodes.emplace_back(id, Entry{id, node});
+        return true;
+    });
+    // indexes are read as they are, not derived from the nodes
+    std::vector<decltype(byOperator)::Item> operators, owners;
+    view.ForEach<CMasternodesView::Operator, CKeyID, uint256>([&] (CKeyID const & key, uint256 & id) {
+        operators.emplace_back(key, id);
+        return true;
+    });
+    view.ForEach<CMasternodesView::Owner, CKeyID, uint256>([&] (CKeyID const & key, uint256 & id) {
+        owners.emplace_back(key, id);
+        return true;
+    });
+    nodes = decltype(nodes)(std::move(allNodes));
+    candidates = decltype(candidates)(std::move(allCandidates));
+    finals = decltype(finals)(std::move(allFinals));
+    byOperator = decltype(byOperator)(std::move(operators));
+    byOwner = decltype(byOwner)(std::move(owners));
+}
+
+CMasternodesRegistry::CMasternodesRegistry(CMasternodesRegistry const & prev, MapKV const & diff, int height_)
+    : height(height_)
+{
+    std::vector<decltype(nodes)::Change> nodeChanges;
+    std::vector<decltype(candidates)::Change> candidateChanges;
+    std::vector<decltype(finals)::Change> finalChanges;
+    std::set<uint256> touched;
+    std::pair<unsigned char, uint256> nodeKey;
+    for (auto it = diff.lower_bound({CMasternodesView::ID::prefix}); it != diff.end() && it->first.at(0) == CMasternodesView::ID::prefix; ++it) {
+        BytesToDbType(ToSpan(it->first), nodeKey);
+        auto const & id = nodeKey.second;
+        touched.insert(id);
+        if (auto const old = prev.nodes.Get(id)) {
+            auto const finalHeight = FinalHeight(old->node);
+            if (finalHeight != NEVER_FINAL) {
+                finalChanges.emplace_back(FinalKey{finalHeight, id}, boost::none);
+            }
+        }
+        if (!it->second) {
+            nodeChanges.emplace_back(id, boost::none);
+            candidateChanges.emplace_back(id, boost::none);
+            continue;
+        }
+        Entry entry{id, {}};
+        BytesToDbType(ToSpan(*it->second), entry.node);
+        auto const finalHeight = FinalHeight(entry.node);
+        if (finalHeight != NEVER_FINAL) {
+            finalChanges.emplace_back(FinalKey{finalHeight, id}, '\0');
+        }
+        candidateChanges.emplace_back(id, height < finalHeight ? boost::make_optional('\0') : boost::none);
+        nodeChanges.emplace_back(id, std::move(entry));
+    }
+
+    // the rest change their final state by the height alone: the ones which get it between the two heights
+    if (prev.height != height) {
+        int const low = std::min(prev.height, height), high = std::max(prev.height, height);
+        auto onFinal = [&] (FinalKey const & key, char) {
+            if (key.height > low && key.height <= high && touched.count(key.id) == 0) {
+                candidateChanges.emplace_back(key.id, height < key.height ? boost::make_optional('\0') : boost::none);
+            }
+            return true;
+        };
+        if (size_t(high - low) >= decltype(finals)::COUNT) {
+            prev.finals.ForEach(onFinal);
+        } else {
+            for (int h = low + 1; h <= high; ++h) {
+                prev.finals.ForEach([&] (FinalKey const & key, char value) {
+                    return key.height == h && onFinal(key, value);
+                }, FinalKey{h, uint256()});
+            }
+        }
+    }
+
+    // the indexes change only by a node creation or its undo
+    auto indexChanges = [&diff] (unsigned char prefix) {
+        std::vector<decltype(byOperator)::Change> changes;
+        std::pair<unsigned char, CKeyID> key;
+        for (auto it = diff.lower_bound({prefix}); it != diff.end() && it->first.at(0) == prefix; ++it) {
+            BytesToDbType(ToSpan(it->first), key);
+            boost::optional<uint256> id;
+            if (it->second) {
+                id = uint256();
+                BytesToDbType(ToSpan(*it->second), *id);
+            }
+            changes.emplace_back(key.second, id);
+        }
+        return changes;
+    };
+    nodes = prev.nodes.Update(nodeChanges);
+    candidates = prev.candidates.Update(candidateChanges);
+    finals = prev.finals.Update(finalChanges);
+    byOperator = prev.byOperator.Update(indexChanges(CMasternodesView::Operator::prefix));
+    byOwner = prev.byOwner.Update(indexChanges(CMasternodesView::Owner::prefix));
+}
+
+bool CMasternodesRegistry::AreMasternodesChanged(MapKV const & diff)
+{
+    for (auto prefix : {CMasternodesView::ID::prefix, CMasternodesView::Operator::prefix, CMasternodesView::Owner::prefix}) {
+        auto it = diff.lower_bound({prefix});
+        if (it != diff.end() && it->first.at(0) == prefix) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int CMasternodesRegistry::FinalHeight(CMasternode const & node)
+{
+    // the same bounds as CMasternode::GetState
+    if (node.resignHeight != -1) {
+        return node.resignHeight + GetMnResignDelay();
+    }
+    if (node.banHeight != -1) {
+        return node.banHeight + GetMnResignDelay();
+    }
+    return NEVER_FINAL;
+}
+
+void CMasternodesRegistry::ForEachNode(std::function<bool(Entry const &)> callback, uint256 const & start) const
+{
+    nodes.ForEach([&callback] (uint256 const &, Entry const & entry) {
+        return callback(entry);
+    }, start);
+}
+
+std::vector<uint256> CMasternodesRegistry::GetCandidates() const
+{
+    std::vector<uint256> ids;
+    ids.reserve(candidates.Size());
+    candidates.ForEach([&ids] (uint256 const & id, char) {
+        ids.push_back(id);
+        return true;
+    });
+    return ids;
+}
+
+CMasternodesRegistry::Entry const * CMasternodesRegistry::Get(uint256 const & id) const
+{
+    return nodes.Get(id);
+}
+
+CMasternodesRegistry::Entry const * CMasternodesRegistry::GetByOperator(CKeyID const & operatorAuthAddress) const
+{
+    auto const id = byOperator.Get(operatorAuthAddress);
+    return id ? Get(*id) : nullptr;
+}
+
+CMasternodesRegistry::Entry const * CMasternodesRegistry::GetByOwner(CKeyID const & ownerAuthAddress) const
+{
+    auto const id = byOwner.Get(ownerAuthAddress);
+    return id ? Get(*id) : nullptr;
+}
+
+boost::optional<std::pair<CKeyID, uint256> > CMasternodesRegistry::AmIOperator() const
+{
+    for (auto const & authAddress : GetOperatorsFromArgs()) {
+        if (auto ids = AmIOperator(authAddress))
+            return ids;
+    }
+    return {};
+}
+
+boost::optional<std::pair<CKeyID, uint256> > CMasternodesRegistry::AmIOperator(CKeyID const & operatorAuthAddress) const
+{
+    if (!operatorAuthAddress.IsNull()) {
+        if (auto const id = byOperator.Get(operatorAuthAddress))
+            return { std::make_pair(operatorAuthAddress, *id) };
+    }
+    return {};
+}
+
+CTeamView::CTeam CMasternodesRegistry::CalcNextTeam(uint256 const & stakeModifier, int h) const
+{
+    if (stakeModifier == uint256())
+        return Params().GetGenesisTeam();
+
+    int anchoringTeamSize = Params().GetConsensus().mn.anchoringTeamSize;
+
+    std::map<arith_uint256, CKeyID, std::less<arith_uint256>> priorityMN;
+    auto add = [&stakeModifier, &priorityMN, h] (Entry const & entry) {
+        if (!entry.node.IsActive(h))
+            return;
+
+        CDataStream ss{SER_GETHASH, PROTOCOL_VERSION};
+        ss << entry.id << stakeModifier;
+        priorityMN.insert(std::make_pair(UintToArith256(Hash(ss.begin(), ss.end())), entry.node.operatorAuthAddress));
+    };
+    if (h >= height) {
+        candidates.ForEach([&] (uint256 const & id, char) {
+            add(*Get(id));
+            return true;
+        });
+    } else {
+        // nodes resigned since 'h' are out of the candidates
+        nodes.ForEach([&] (uint256 const &, Entry const & entry) {
+            add(entry);
+            return true;
+        });
+    }
+
+    CTeamView::CTeam newTeam;
+    auto && it = priorityMN.begin();
+    for (int i = 0; i < anchoringTeamSize && it != priorityMN.end(); ++i, ++it) {
+        newTeam.insert(it->second);
+    }
+    return newTeam;
+}
+
 /*
  *  CCustomCSView
  */
@@ -464,8 +712,10 @@ CTeamView::CTeam CCustomCSView::CalcNextTeam(const uint256 & stakeModifier)
 void CCustomCSView::CreateAndRelayConfirmMessageIfNeed(const CAnchor & anchor, const uint256 & btcTxHash)
 {
     /// @todo refactor to use AmISignerNow()
-    auto myIDs = AmIOperator();
-    if (!myIDs || !GetMasternode(myIDs->second)->IsActive())
+    // the view is the tip one, so its masternodes are the registry ones
+    auto const registry = GetMasternodesRegistry();
+    auto myIDs = registry->AmIOperator();
+    if (!myIDs || !registry->Get(myIDs->second)->node.IsActive())
         return ;
     CKeyID const & operatorAuthAddress = myIDs->first;
     CTeam const currentTeam = GetCurrentTeam();
@@ -511,6 +761,326 @@ void CCustomCSView::OnUndoTx(uint256 const & txid, uint32_t height)
     this->DelUndo(UndoKey{height, txid}); // erase undo data, it served its purpose
 }
 
+bool CCustomCSView::UpgradeOwnerKeys(size_t limit, uint32_t & undoHeight, uint64_t & records)
+{
+    records = 0;
+    int version = 0;
+    if (Read(DB_MN_OWNER_KEYS_VERSION, version) && version >= OWNER_KEYS_VERSION) {
+        return false;
+    }
+
+    // legacy key -> compact one, owner gets interned on the way
+    auto convert = [this] (TBytes const & key) -> boost::optional<TBytes> {
+        if (key.at(0) == DB_LEGACY_BALANCES) {
+            std::pair<unsigned char, BalanceKey> legacy;
+            BytesToDbType(key, legacy);
+            return MakeOwnerKey(ByBalanceKey::prefix, InternOwner(legacy.second.owner), legacy.second.tokenID.v);
+        }
+        if (key.at(0) == DB_LEGACY_SHARES) {
+            std::pair<unsigned char, PoolShareKey> legacy;
+            BytesToDbType(key, legacy);
+            return MakeIdOwnerKey(ByShare::prefix, legacy.second.poolID.v, InternOwner(legacy.second.owner));
+        }
+        return {};
+    };
+
+    // converted records leave the legacy tables, so every batch starts from the beginning of them.
+    // values keep their encoding (8 bytes amount for balances, '\0' for shares)
+    for (auto const prefix : {DB_LEGACY_BALANCES, DB_LEGACY_SHARES}) {
+        std::vector<std::pair<TBytes, TBytes>> batch;
+        auto it = DB().NewIterator();
+        for (it->Seek(TBytes{prefix}); it->Valid() && records + batch.size() < limit; it->Next()) {
+            if (it->KeySpan()[0] != prefix) {
+                break;
+            }
+            batch.emplace_back(it->Key(), it->Value());
+        }
+        it.reset();
+
+        for (auto const & kv : batch) {
+            DB().Write(*convert(kv.first), kv.second);
+            DB().Erase(kv.first);
+        }
+        records += batch.size();
+        if (records >= limit) {
+            return true;
+        }
+    }
+
+    // undos keep raw keys of the changed records, they are rewritten in place, whole heights at once
+    std::vector<std::pair<UndoKey, CUndo>> undos;
+    bool more = false;
+    uint32_t height = undoHeight;
+    ForEachUndo([&] (UndoKey const & key, CUndo const & undo) {
+        if (records >= limit && key.height != height) {
+            undoHeight = key.height; // next call starts here
+            more = true;
+            return false;
+        }
+        height = key.height;
+        ++records;
+
+        CUndo converted;
+        bool changed = false;
+        for (auto const & kv : undo.before) {
+            auto const compactKey = convert(kv.first);
+            changed |= bool(compactKey);
+            converted.before.emplace(compactKey ? *compactKey : kv.first, kv.second);
+        }
+        if (changed) {
+            undos.emplace_back(key, std::move(converted));
+        }
+        return true;
+    }, UndoKey{undoHeight, uint256()});
+
+    for (auto const & undo : undos) {
+        SetUndo(undo.first, undo.second);
+    }
+    if (more) {
+        return true;
+    }
+    Write(DB_MN_OWNER_KEYS_VERSION, OWNER_KEYS_VERSION);
+    return false;
+}
+
+std::vector<std::pair<std::string, CKeyID>> GetOperatorAddressesFromArgs()
+{
+    std::vector<std::pair<std::string, CKeyID>> operators;
+    for (auto const & address : gArgs.GetArgs("-masternode_operator")) {
+        CTxDestination dest = DecodeDestination(address);
+        CKeyID const authAddress = dest.which() == 1 ? CKeyID(*boost::get<PKHash>(&dest)) : (dest.which() == 4 ? CKeyID(*boost::get<WitnessV0KeyHash>(&dest)) : CKeyID());
+        operators.emplace_back(address, authAddress);
+    }
+    return operators;
+}
+
+std::vector<CKeyID> GetOperatorsFromArgs()
+{
+    std::vector<CKeyID> operators;
+    for (auto const & op : GetOperatorAddressesFromArgs()) {
+        operators.push_back(op.second);
+    }
+    return operators;
+}
+
+void PruneMasternodeUndos()
+{
+    LOCK(cs_main);
+    if (undosPruneStats.keep == 0 || !pcustomcsview) {
+        return;
+    }
+    auto const tipHeight = (uint32_t) pcustomcsview->GetLastHeight();
+    if (tipHeight <= undosPruneStats.keep) {
+        return;
+    }
+
+    // erasures are collected in a separate layer and get to disk with the next state flush
+    CCustomCSView pruneView(*pcustomcsview);
+    uint64_t records = 0, bytes = 0;
+    pruneView.PruneUndos(tipHeight - undosPruneStats.keep, MN_UNDO_PRUNE_BATCH, records, bytes);
+    pruneView.Flush();
+
+    undosPruneStats.records += records;
+    undosPruneStats.bytes += bytes;
+    if (records > 0) {
+        LogPrint(BCLog::BENCH, "%s: pruned %d undos (%d bytes), pruned height %d\n", __func__, records, bytes, pcustomcsview->GetUndosPrunedHeight());
+    }
+}
+
+std::set<unsigned char> GetCustomCSHotPrefixes()
+{
+    return {
+        CPoolPairView::ByID::prefix, CPoolPairView::ByPair::prefix,
+        CTokensView::ID::prefix, CTokensView::Symbol::prefix, CTokensView::CreationTx::prefix,
+        CGovView::ByName::prefix,
+        CMasternodesView::ID::prefix, CMasternodesView::Operator::prefix, CMasternodesView::Owner::prefix,
+        COwnersView::ByOwnerID::prefix,
+    };
+}
+
+std::shared_ptr<CCustomCSView> GetViewSnapshot()
+{
+    {
+        LOCK(cs_viewSnapshot);
+        if (viewSnapshot && viewSnapshotGeneration == viewGeneration) {
+            return viewSnapshot;
+        }
+    }
+    // the generation can't change while cs_main is held
+    LOCK2(cs_main, cs_viewSnapshot);
+    if (!viewSnapshot || viewSnapshotGeneration != viewGeneration) {
+        viewSnapshot = std::make_shared<CCustomCSView>(pcustomcsview->GetRaw().Snapshot(), GetTokensTable());
+        viewSnapshotGeneration = viewGeneration;
+    }
+    return viewSnapshot;
+}
+
+void InvalidateViewSnapshot()
+{
+    ++viewGeneration;
+}
+
+void ResetViewSnapshot()
+{
+    LOCK(cs_viewSnapshot);
+    viewSnapshot.reset();
+    viewSnapshotGeneration = 0;
+    ++viewGeneration;
+    std::atomic_store(&poolGraph, std::shared_ptr<const CPoolGraph>{});
+    std::atomic_store(&tokensTable, std::shared_ptr<const CTokensTable>{});
+    std::atomic_store(&masternodesRegistry, std::shared_ptr<const CMasternodesRegistry>{});
+}
+
+std::shared_ptr<const CTokensTable> GetTokensTable()
+{
+    auto table = std::atomic_load(&tokensTable);
+    if (!table) {
+        // the first call since the start, the table can't change while cs_main is held
+        LOCK(cs_main);
+        table = std::atomic_load(&tokensTable);
+        if (!table) {
+            table = std::make_shared<const CTokensTable>(*pcustomcsview, ++tokensTableVersion);
+            std::atomic_store(&tokensTable, table);
+        }
+    }
+    return table;
+}
+
+void UpdateTokensTable(CCustomCSView & view)
+{
+    std::atomic_store(&tokensTable, std::make_shared<const CTokensTable>(view, ++tokensTableVersion));
+}
+
+std::shared_ptr<const CMasternodesRegistry> GetMasternodesRegistry()
+{
+    auto registry = std::atomic_load(&masternodesRegistry);
+    if (!registry) {
+        // the first call since the start, the registry can't change while cs_main is held
+        LOCK(cs_main);
+        registry = std::atomic_load(&masternodesRegistry);
+        if (!registry) {
+            registry = std::make_shared<const CMasternodesRegistry>(*pcustomcsview, pcustomcsview->GetLastHeight());
+            std::atomic_store(&masternodesRegistry, registry);
+        }
+    }
+    return registry;
+}
+
+void UpdateMasternodesRegistry(CCustomCSView & view, MapKV const & changes)
+{
+    AssertLockHeld(cs_main);
+    auto registry = std::atomic_load(&masternodesRegistry);
+    if (!registry) {
+        return; // not built yet, it will be read from the flushed state
+    }
+    // the height changes by every block, so do the states of the nodes
+    std::atomic_store(&masternodesRegistry, std::make_shared<const CMasternodesRegistry>(*registry, changes, view.GetLastHeight()));
+}
+
+static std::shared_ptr<const CPoolGraph> MakePoolGraph(CCustomCSView & view)
+{
+    int const height = view.GetLastHeight();
+    return std::make_shared<const CPoolGraph>(view, height, height + 1 >= Params().GetConsensus().BayfrontGardensHeight);
+}
+
+std::shared_ptr<const CPoolGraph> GetPoolGraph()
+{
+    auto graph = std::atomic_load(&poolGraph);
+    if (!graph) {
+        // no block was connected since the start, so the graph is taken from the current snapshot.
+        // a graph published meanwhile by UpdatePoolGraph is newer, it wins
+        graph = MakePoolGraph(*GetViewSnapshot());
+        std::shared_ptr<const CPoolGraph> published;
+        if (!std::atomic_compare_exchange_strong(&poolGraph, &published, graph)) {
+            graph = published;
+        }
+    }
+    return graph;
+}
+
+bool IsPoolGraphChanged(CCustomCSView & view, MapKV const & changes)
+{
+    auto const graph = std::atomic_load(&poolGraph);
+    if (!graph) {
+        return true; // the one being built meanwhile by GetPoolGraph may come from the previous snapshot
+    }
+    int const height = view.GetLastHeight();
+    if (graph->IsPostBayfrontGardens() != (height + 1 >= Params().GetConsensus().BayfrontGardensHeight)) {
+        return true;
+    }
+    auto it = changes.lower_bound({CPoolPairView::ByPair::prefix});
+    if (it != changes.end() && it->first.at(0) == CPoolPairView::ByPair::prefix) {
+        return true;
+    }
+    // pools rewards rewrite every pool by each block, mostly with the same values
+    uint32_t poolId;
+    auto poolKey = std::make_pair(CPoolPairView::ByID::prefix, WrapVarInt(poolId));
+    for (it = changes.lower_bound({CPoolPairView::ByID::prefix}); it != changes.end() && it->first.at(0) == CPoolPairView::ByID::prefix; ++it) {
+        BytesToDbType(ToSpan(it->first), poolKey);
+        auto const pool = graph->GetPool(DCT_ID{poolId});
+        if (!pool || !it->second || DbTypeToBytes(pool->pool) != *it->second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void UpdatePoolGraph(CCustomCSView & view)
+{
+    std::atomic_store(&poolGraph, MakePoolGraph(view));
+}
+
+CTeamView::CTeam GetNextTeamCached(uint256 const & stakeModifier)
+{
+    AssertLockHeld(cs_main);
+    // masternodes states depend on the tip height as well, so any tip change drops the cache
+    if (nextTeamCacheGeneration != viewGeneration || nextTeamCache.size() >= NEXT_TEAM_CACHE_SIZE) {
+        nextTeamCache.clear();
+        nextTeamCacheGeneration = viewGeneration;
+    }
+    auto it = nextTeamCache.find(stakeModifier);
+    if (it == nextTeamCache.end()) {
+        it = nextTeamCache.emplace(stakeModifier, GetMasternodesRegistry()->CalcNextTeam(stakeModifier, ::ChainActive().Height())).first;
+    }
+    return it->second;
+}
+
+std::shared_ptr<const CTokensTable> CCustomCSView::GetTokensTable() const
+{
+    if (tokens) {
+        return tokens;
+    }
+    return std::make_shared<const CTokensTable>(const_cast<CCustomCSView&>(*this), 0);
+}
+
+void CCustomCSView::Reset(CCustomCSView & other)
+{
+    snapshot.reset();
+    tokens.reset();
+    dynamic_cast<CFlushableStorageKV&>(DB()).Reset(other.DB());
+}
+
+// layers returned by the finished txs of this thread
+static thread_local std::vector<std::unique_ptr<CCustomCSView>> pooledLayers;
+
+CCustomCSViewLayer::CCustomCSViewLayer(CCustomCSView & parent)
+{
+    if (pooledLayers.empty()) {
+        view = MakeUnique<CCustomCSView>(parent);
+    } else {
+        view = std::move(pooledLayers.back());
+        pooledLayers.pop_back();
+        view->Reset(parent);
+    }
+}
+
+CCustomCSViewLayer::~CCustomCSViewLayer()
+{
+    if (pooledLayers.size() < MAX_POOLED_LAYERS) {
+        pooledLayers.push_back(std::move(view));
+    }
+}
+
 bool CCustomCSView::CanSpend(const uint256 & txId, int height) const
 {
     auto node = GetMasternode(txId);
@@ -14,15 +14,21 @@
 #include <masternodes/incentivefunding.h>
 #include <masternodes/tokens.h>
 #include <masternodes/undos.h>
+#include <masternodes/poolgraph.h>
 #include <masternodes/poolpairs.h>
 #include <masternodes/gv.h>
+#include <masternodes/sharedbuckets.h>
 #include <uint256.h>
 
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
+#include <tuple>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -125,7 +131,9 @@ public:
     bool BanCriminal(const uint256 txid, std::vector<unsigned char> & metadata, int height);
     bool UnbanCriminal(const uint256 txid, std::vector<unsigned char> & metadata);
 
+    // first of -masternode_operator addresses which has a masternode
     boost::optional<std::pair<CKeyID, uint256>> AmIOperator() const;
+    boost::optional<std::pair<CKeyID, uint256>> AmIOperator(CKeyID const & operatorAuthAddress) const;
     boost::optional<std::pair<CKeyID, uint256>> AmIOwner() const;
 
     Res CreateMasternode(uint256 const & nodeId, CMasternode const & node);
@@ -176,6 +184,71 @@ public:
     struct BtcTx { static const unsigned char prefix; };
 };
 
+/// Immutable decoded copy of all the masternodes of some state, shared by its readers without any locks.
+/// The registry of the next state is derived from the previous one by the masternode records changed in between.
+/// It shares all the buckets of the nodes and indexes but the changed ones, and the nodes which change their final
+/// (resigned or banned) state by the height alone are found by that height, so a block (or its undo) costs only
+/// its own records, not the number of nodes.
+class CMasternodesRegistry
+{
+public:
+    struct Entry {
+        uint256 id;
+        CMasternode node;
+    };
+
+    // 'height' is the height of the state, states of the nodes are taken at it or later
+    CMasternodesRegistry(CMasternodesView & view, int height);
+    // registry of the state 'diff' leads to from the state of 'prev' ('diff' are the changes of a view over it)
+    CMasternodesRegistry(CMasternodesRegistry const & prev, MapKV const & diff, int height);
+
+    // true if 'diff' touches any masternode record
+    static bool AreMasternodesChanged(MapKV const & diff);
+
+    int GetHeight() const { return height; }
+    size_t GetNodesCount() const { return nodes.Size(); }
+    // from 'start' in the order of ids, the same order as CMasternodesView::ForEachMasternode
+    void ForEachNode(std::function<bool(Entry const &)> callback, uint256 const & start = uint256()) const;
+    // ids of the nodes which aren't finally resigned or banned at the height, in the order of ids
+    std::vector<uint256> GetCandidates() const;
+
+    // all of them return nullptr if there is no such node
+    Entry const * Get(uint256 const & id) const;
+    Entry const * GetByOperator(CKeyID const & operatorAuthAddress) const;
+    Entry const * GetByOwner(CKeyID const & ownerAuthAddress) const;
+
+    // the same as CMasternodesView::AmIOperator
+    boost::optional<std::pair<CKeyID, uint256>> AmIOperator() const;
+    boost::optional<std::pair<CKeyID, uint256>> AmIOperator(CKeyID const & operatorAuthAddress) const;
+
+    // the same team as CCustomCSView::CalcNextTeam at height 'h' (no less than the height of the registry)
+    CTeamView::CTeam CalcNextTeam(uint256 const & stakeModifier, int h) const;
+
+private:
+    // the height the node gets its final (resigned or banned) state at, NEVER_FINAL if it isn't resigned nor banned
+    static const int NEVER_FINAL = std::numeric_limits<int>::max();
+    static int FinalHeight(CMasternode const & node);
+
+    struct FinalKey {
+        int height;
+        uint256 id;
+
+        FinalKey() : height(0) {}
+        FinalKey(int height_, uint256 const & id_) : height(height_), id(id_) {}
+        bool operator<(FinalKey const & other) const { return std::tie(height, id) < std::tie(other.height, other.id); }
+    };
+    struct ByFinalHeight {
+        size_t operator()(FinalKey const & key) const { return key.height; }
+    };
+
+    int height;
+    CSharedBuckets<uint256, Entry> nodes;
+    CSharedBuckets<uint256, char> candidates; // not finally resigned or banned at the height
+    CSharedBuckets<FinalKey, char, ByFinalHeight> finals; // resigned and banned ones by their final heights
+    CSharedBuckets<CKeyID, uint256> byOperator; // auth address -> node id
+    CSharedBuckets<CKeyID, uint256> byOwner;
+};
+
 class CCustomCSView
         : public CMasternodesView
         , public CLastHeightView
@@ -198,6 +271,13 @@ public:
     CCustomCSView(CCustomCSView & other)
         : CStorageView(new CFlushableStorageKV(other.DB()))
     {}
+    // view over the point-in-time snapshot of the storage (see CStorageKV::Snapshot), keeps it alive.
+    // 'tokens_' is the tokens table of the same state, if any
+    explicit CCustomCSView(std::shared_ptr<CStorageKV> const & snapshot_, std::shared_ptr<const CTokensTable> tokens_ = {})
+        : CStorageView(new CFlushableStorageKV(*snapshot_))
+        , snapshot(snapshot_)
+        , tokens(std::move(tokens_))
+    {}
 
     // cause depends on current mns:
     CTeamView::CTeam CalcNextTeam(uint256 const & stakeModifier);
@@ -210,15 +290,116 @@ public:
 
     bool CanSpend(const uint256 & txId, int height) const;
 
+    // one-time conversion of the script keyed balances, pool shares and their undos to the compact owner keys.
+    // converts about 'limit' records per call ('undoHeight' keeps the progress), returns false once the format is up to date
+    bool UpgradeOwnerKeys(size_t limit, uint32_t & undoHeight, uint64_t & records);
+
     bool Flush() { return DB().Flush(); }
 
     CStorageKV& GetRaw() {
         return DB();
     }
+
+    // turns the layer into a fresh one over 'other', as if it was constructed by the cache-upon-a-cache constructor
+    void Reset(CCustomCSView & other);
+
+    // tokens of the view: the shared table of the snapshot, or a new one built from the view itself
+    std::shared_ptr<const CTokensTable> GetTokensTable() const;
+
+private:
+    std::shared_ptr<CStorageKV> snapshot;
+    std::shared_ptr<const CTokensTable> tokens;
 };
 
+/** Per-tx layer over the view, taken from the per-thread pool of layers.
+ *  The pooled layers are reset and reused instead of being freed, so a tx doesn't allocate the view and its write buffer.
+ */
+class CCustomCSViewLayer
+{
+public:
+    static const size_t MAX_POOLED_LAYERS = 8;
+
+    explicit CCustomCSViewLayer(CCustomCSView & parent);
+    ~CCustomCSViewLayer();
+    CCustomCSViewLayer(CCustomCSViewLayer const &) = delete;
+    CCustomCSViewLayer& operator=(CCustomCSViewLayer const &) = delete;
+
+    CCustomCSView & operator*() { return *view; }
+    CCustomCSView * operator->() { return view.get(); }
+
+private:
+    std::unique_ptr<CCustomCSView> view;
+};
+
+/** Operator addresses set by -masternode_operator (may be specified multiple times) */
+std::vector<CKeyID> GetOperatorsFromArgs();
+/** The same along with the addresses they were given by */
+std::vector<std::pair<std::string, CKeyID>> GetOperatorAddressesFromArgs();
+
 /** Global DB and view that holds enhanced chainstate data (should be protected by cs_main) */
 extern std::unique_ptr<CStorageLevelDB> pcustomcsDB;
 extern std::unique_ptr<CCustomCSView> pcustomcsview;
 
+/**
+ * Read-only snapshot of pcustomcsview at the last connected (or disconnected) block, shared between callers.
+ * Doesn't need cs_main to be read, so long RPC scans don't block the block connection.
+ * Writes to the snapshot itself are forbidden, use a child view for "what if" checks.
+ */
+std::shared_ptr<CCustomCSView> GetViewSnapshot();
+/** Marks the current snapshot as outdated, should be called under cs_main after every pcustomcsview change */
+void InvalidateViewSnapshot();
+/** Releases the cached snapshot (and the pools graph), has to be called before pcustomcsDB destruction */
+void ResetViewSnapshot();
+/** Tokens of the tip, rebuilt only by the blocks which change tokens. Doesn't need cs_main to be read */
+std::shared_ptr<const CTokensTable> GetTokensTable();
+/** Rebuilds the tokens table from 'view', should be called under cs_main after the block connect/disconnect which changed tokens */
+void UpdateTokensTable(CCustomCSView & view);
+/** Masternodes of the tip. Doesn't need cs_main to be read */
+std::shared_ptr<const CMasternodesRegistry> GetMasternodesRegistry();
+/** Applies the changes of the block connect/disconnect to the registry, should be called under cs_main before they are flushed to 'view' */
+void UpdateMasternodesRegistry(CCustomCSView & view, MapKV const & changes);
+/** Pools of the tip, doesn't need cs_main nor any other lock to be read */
+std::shared_ptr<const CPoolGraph> GetPoolGraph();
+/** True if the changes of the block connect/disconnect (applied to 'view', not flushed yet) make the pools graph outdated */
+bool IsPoolGraphChanged(CCustomCSView & view, MapKV const & changes);
+/** Rebuilds the pools graph from 'view', should be called under cs_main after the block connect/disconnect which changed pools */
+void UpdatePoolGraph(CCustomCSView & view);
+
+/** Max stake modifiers kept by GetNextTeamCached */
+static const size_t NEXT_TEAM_CACHE_SIZE = 16;
+/** CalcNextTeam of the tip (by the masternodes registry), memoized per stake modifier until the next tip change (requires cs_main) */
+CTeamView::CTeam GetNextTeamCached(uint256 const & stakeModifier);
+
+/** Default for -customcsdbcache, share of -dbcache in percents given to the enhanced chainstate database */
+static const int64_t DEFAULT_CUSTOMCS_DBCACHE_SHARE = 10;
+/** Max for -customcsdbcache */
+static const int64_t MAX_CUSTOMCS_DBCACHE_SHARE = 50;
+/** Version of the balances and pool shares keys format, 1 = compact owner keys (see masternodes/owners.h) */
+static const int OWNER_KEYS_VERSION = 1;
+/** Records converted between flushes by the startup upgrade of older datadirs */
+static const size_t OWNER_KEYS_UPGRADE_BATCH = 100000;
+/** Account history records indexed between flushes by the startup indexing of older datadirs */
+static const size_t ACCOUNT_HISTORY_INDEX_BATCH = 100000;
+/** Key prefixes of the small and frequently read records (pools, tokens, gov vars, masternodes, interned owners), kept in the row cache */
+std::set<unsigned char> GetCustomCSHotPrefixes();
+
+/** Default for -mnundokeep, 0 = keep all masternode undos */
+static const uint32_t DEFAULT_MN_UNDO_KEEP = 0;
+/** Max undo records erased by a single pruner run (keeps cs_main hold short) */
+static const size_t MN_UNDO_PRUNE_BATCH = 10000;
+/** Interval in seconds between pruner runs */
+static const int64_t MN_UNDO_PRUNE_INTERVAL = 10;
+
+struct CUndosPruneStats {
+    uint32_t keep = 0;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+};
+
+/** Undo pruner session stats (protected by cs_main) */
+extern CUndosPruneStats undosPruneStats;
+
+/** Prunes one batch of masternode undos older than undosPruneStats.keep blocks from tip */
+void PruneMasternodeUndos();
+
 #endif // DEFI_MASTERNODES_MASTERNODES_H
@@ -9,6 +9,7 @@
 
 #include <arith_uint256.h>
 #include <chainparams.h>
+#include <coins.h>
 #include <logging.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
@@ -72,7 +73,7 @@ CPubKey GetPubkeyFromScriptSig(CScript const & scriptSig)
 // not used for now (cause works only with signed inputs)
 bool HasAuth(CTransaction const & tx, CKeyID const & auth)
 {
-    for (auto input : tx.vin)
+    for (auto const & input : tx.vin)
     {
         if (input.scriptWitness.IsNull()) {
             if (GetPubkeyFromScriptSig(input.scriptSig).GetID() == auth)
@@ -89,7 +90,7 @@ bool HasAuth(CTransaction const & tx, CKeyID const & auth)
 
 bool HasAuth(CTransaction const & tx, CCoinsViewCache const & coins, CScript const & auth)
 {
-    for (auto input : tx.vin) {
+    for (auto const & input : tx.vin) {
         const Coin& coin = coins.AccessCoin(input.prevout);
         assert(!coin.IsSpent());
         if (coin.out.scriptPubKey == auth)
@@ -106,7 +107,7 @@ bool HasCollateralAuth(CTransaction const & tx, CCoinsViewCache const & coins, u
 
 bool HasFoundationAuth(CTransaction const & tx, CCoinsViewCache const & coins, Consensus::Params const & consensusParams)
 {
-    for (auto input : tx.vin) {
+    for (auto const & input : tx.vin) {
         const Coin& coin = coins.AccessCoin(input.prevout);
         assert(!coin.IsSpent());
         if (consensusParams.foundationMembers.find(coin.out.scriptPubKey) != consensusParams.foundationMembers.end())
@@ -115,6 +116,80 @@ bool HasFoundationAuth(CTransaction const & tx, CCoinsViewCache const & coins, C
     return false;
 }
 
+CCustomTxDecodeCache customTxDecodeCache;
+
+template<typename T>
+static CCustomTxMessage DecodeCustomTxMessage(std::vector<unsigned char> const & metadata)
+{
+    T msg;
+    try {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return CCustomTxMessageNone{}; // left for Apply*Tx to report
+        }
+    } catch (...) {
+        return CCustomTxMessageNone{};
+    }
+    return msg;
+}
+
+static CCustomTxMessage DecodeCustomTxMessage(CustomTxType txType, std::vector<unsigned char> const & metadata)
+{
+    switch (txType)
+    {
+        case CustomTxType::MintToken:               return DecodeCustomTxMessage<CBalances>(metadata);
+        case CustomTxType::AddPoolLiquidity:        return DecodeCustomTxMessage<CLiquidityMessage>(metadata);
+        case CustomTxType::RemovePoolLiquidity:     return DecodeCustomTxMessage<CRemoveLiquidityMessage>(metadata);
+        case CustomTxType::PoolSwap:                return DecodeCustomTxMessage<CPoolSwapMessage>(metadata);
+        case CustomTxType::UtxosToAccount:          return DecodeCustomTxMessage<CUtxosToAccountMessage>(metadata);
+        case CustomTxType::AccountToUtxos:          return DecodeCustomTxMessage<CAccountToUtxosMessage>(metadata);
+        case CustomTxType::AccountToAccount:        return DecodeCustomTxMessage<CAccountToAccountMessage>(metadata);
+        case CustomTxType::AnyAccountsToAccounts:   return DecodeCustomTxMessage<CAnyAccountsToAccountsMessage>(metadata);
+        default:                                    return CCustomTxMessageNone{};
+    }
+}
+
+std::shared_ptr<const CCustomTxDecoded> CCustomTxDecodeCache::Find(CTransaction const & tx)
+{
+    LOCK(cs);
+    auto it = entries.find(tx.GetHash());
+    return it != entries.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<const CCustomTxDecoded> CCustomTxDecodeCache::Decode(CTransaction const & tx)
+{
+    if (auto decoded = Find(tx)) {
+        ++hits;
+        return decoded;
+    }
+
+    // txid commits to metadata, so the entry never gets stale
+    auto decoded = std::make_shared<CCustomTxDecoded>();
+    decoded->type = GuessCustomTxType(tx, decoded->metadata);
+    if (decoded->type == CustomTxType::None) {
+        return decoded; // plain txs would only push the custom ones out
+    }
+    ++misses;
+    decoded->msg = DecodeCustomTxMessage(decoded->type, decoded->metadata);
+
+    LOCK(cs);
+    if (entries.emplace(tx.GetHash(), decoded).second) {
+        order.push_back(tx.GetHash());
+        while (order.size() > maxSize) {
+            entries.erase(order.front());
+            order.pop_front();
+        }
+    }
+    return decoded;
+}
+
+size_t CCustomTxDecodeCache::Size() const
+{
+    LOCK(cs);
+    return entries.size();
+}
+
 Res ApplyCustomTx(CCustomCSView & base_mnview, CCoinsViewCache const & coins, CTransaction const & tx, Consensus::Params const & consensusParams, uint32_t height, uint32_t txn, bool isCheck)
 {
     Res res = Res::Ok();
@@ -123,12 +198,14 @@ Res ApplyCustomTx(CCustomCSView & base_mnview, CCoinsViewCache const & coins, CT
         return Res::Ok(); // not "custom" tx
     }
 
-    CCustomCSView mnview(base_mnview);
+    CCustomCSViewLayer layer(base_mnview);
+    auto & mnview = *layer;
     CustomTxType guess;
     try {
         // Check if it is custom tx with metadata
-        std::vector<unsigned char> metadata;
-        guess = GuessCustomTxType(tx, metadata);
+        auto const decoded = customTxDecodeCache.Decode(tx);
+        auto const & metadata = decoded->metadata;
+        guess = decoded->type;
         switch (guess)
         {
             case CustomTxType::CreateMasternode:
@@ -199,12 +276,13 @@ Res ApplyCustomTx(CCustomCSView & base_mnview, CCoinsViewCache const & coins, CT
     // construct undo
     auto& flushable = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw());
     mnview.TrackAffectedAccounts(base_mnview.GetRaw(), flushable.GetRaw(), height, txn, tx.GetHash(), (unsigned char) guess);
-    auto undo = CUndo::Construct(base_mnview.GetRaw(), flushable.GetRaw());
+    static thread_local CUndoBuilder undo; // keeps its buffers between txs
+    bool const hasUndo = undo.Construct(base_mnview.GetRaw(), flushable.GetRaw());
     // flush changes
     mnview.Flush();
     // write undo
-    if (!undo.before.empty()) {
-        base_mnview.SetUndo(UndoKey{height, tx.GetHash()}, undo);
+    if (hasUndo) {
+        base_mnview.SetUndo(UndoKey{height, tx.GetHash()}, undo.GetBytes());
     }
 
     return res;
@@ -432,10 +510,12 @@ Res ApplyMintTokenTx(CCustomCSView & mnview, CCoinsViewCache const & coins, CTra
     const std::string base{"Token minting"};
 
     CBalances minted;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> minted;
-    if (!ss.empty()) {
-        return Res::Err("MintToken tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, minted)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> minted;
+        if (!ss.empty()) {
+            return Res::Err("MintToken tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
 
     // check auth and increase balance of token's owner
@@ -505,10 +585,12 @@ Res ApplyAddPoolLiquidityTx(CCustomCSView & mnview, CCoinsViewCache const & coin
 
     // deserialize
     CLiquidityMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("Adding liquidity tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, msg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return Res::Err("Adding liquidity tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
 
     const auto base = strprintf("Adding liquidity %s", msg.ToString());
@@ -588,10 +670,12 @@ Res ApplyRemovePoolLiquidityTx(CCustomCSView & mnview, CCoinsViewCache const & c
 
     // deserialize
     CRemoveLiquidityMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("Removing liquidity tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, msg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return Res::Err("Removing liquidity tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
 
     const auto base = strprintf("Removing liquidity %s", msg.ToString());
@@ -660,10 +744,12 @@ Res ApplyUtxosToAccountTx(CCustomCSView & mnview, CTransaction const & tx, uint3
 
     // deserialize
     CUtxosToAccountMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("UtxosToAccount tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, msg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return Res::Err("UtxosToAccount tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
     const auto base = strprintf("Transfer UtxosToAccount: %s", msg.ToString());
 
@@ -704,10 +790,12 @@ Res ApplyAccountToUtxosTx(CCustomCSView & mnview, CCoinsViewCache const & coins,
 
     // deserialize
     CAccountToUtxosMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("AccountToUtxos tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, msg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return Res::Err("AccountToUtxos tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
     const auto base = strprintf("Transfer AccountToUtxos: %s", msg.ToString());
 
@@ -759,10 +847,12 @@ Res ApplyAccountToAccountTx(CCustomCSView & mnview, CCoinsViewCache const & coin
 
     // deserialize
     CAccountToAccountMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("AccountToAccount tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, msg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return Res::Err("AccountToAccount tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
     const auto base = strprintf("Transfer AccountToAccount: %s", msg.ToString());
 
@@ -816,10 +906,12 @@ Res ApplyAnyAccountsToAccountsTx(CCustomCSView & mnview, CCoinsViewCache const &
 
     // deserialize
     CAnyAccountsToAccountsMessage msg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> msg;
-    if (!ss.empty()) {
-        return Res::Err("AnyAccountsToAccounts tx deserialization failed: excess %d bytes", ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, msg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> msg;
+        if (!ss.empty()) {
+            return Res::Err("AnyAccountsToAccounts tx deserialization failed: excess %d bytes", ss.size());
+        }
     }
     const auto base = strprintf("Transfer AnyAccountsToAccounts: %s", msg.ToString());
 
@@ -1001,10 +1093,12 @@ Res ApplyPoolSwapTx(CCustomCSView &mnview, const CCoinsViewCache &coins, const C
     }
 
     CPoolSwapMessage poolSwapMsg;
-    CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
-    ss >> poolSwapMsg;
-    if (!ss.empty()) {
-        return Res::Err("PoolSwap: deserialization failed: excess %d bytes",  ss.size());
+    if (!customTxDecodeCache.Get(tx, metadata, poolSwapMsg)) {
+        CDataStream ss(metadata, SER_NETWORK, PROTOCOL_VERSION);
+        ss >> poolSwapMsg;
+        if (!ss.empty()) {
+            return Res::Err("PoolSwap: deserialization failed: excess %d bytes",  ss.size());
+        }
     }
 
     const std::string base{"PoolSwap creation: " + poolSwapMsg.ToString()};
@@ -1177,3 +1271,131 @@ bool IsMempooledCustomTxCreate(const CTxMemPool & pool, const uint256 & txid)
     }
     return false;
 }
+
+namespace {
+
+// coins source of a speculation: knows only the prefetched coins, remembers every request to be validated at commit
+class CCoinsViewSpeculative : public CCoinsView
+{
+public:
+    std::map<COutPoint, Coin> known;
+    mutable std::map<COutPoint, Coin> requested; // spent (empty) coin for the unknown ones
+
+    bool GetCoin(COutPoint const & outpoint, Coin & coin) const override {
+        auto it = known.find(outpoint);
+        if (it == known.end()) {
+            requested.emplace(outpoint, Coin());
+            return false;
+        }
+        requested.emplace(outpoint, it->second);
+        coin = it->second;
+        return true;
+    }
+};
+
+bool SameCoin(Coin const & a, Coin const & b)
+{
+    if (a.IsSpent() || b.IsSpent()) {
+        return a.IsSpent() == b.IsSpent();
+    }
+    return a.out == b.out && a.nHeight == b.nHeight && a.fCoinBase == b.fCoinBase;
+}
+
+} // namespace
+
+struct CCustomTxSpeculation
+{
+    CCustomTxSpeculator const & speculator;
+    CTransaction const & tx;
+    uint32_t const txn;
+    CCoinsViewSpeculative coins;
+    CStorageKVReadRecorder reads;
+    CCustomCSView view;
+    Res res;
+    bool done;
+
+    CCustomTxSpeculation(CCustomTxSpeculator const & speculator_, CCustomCSView & base, CTransaction const & tx_, uint32_t txn_)
+        : speculator(speculator_), tx(tx_), txn(txn_), reads(base.GetRaw()), view(reads), res(Res::Ok()), done(false)
+    {}
+};
+
+CCustomTxSpeculator::CCustomTxSpeculator(CCustomCSView & base_, uint32_t height_, Consensus::Params const & consensusParams_, bool isCheck_)
+    : base(base_), height(height_), consensusParams(consensusParams_), isCheck(isCheck_), committed(0), reapplied(0)
+{}
+
+CCustomTxSpeculator::~CCustomTxSpeculator() = default;
+
+std::vector<CCustomTxSpeculator::Check> CCustomTxSpeculator::Prepare(CBlock const & block, CCoinsViewCache const & coins)
+{
+    std::vector<Check> checks;
+    std::map<uint256, CTransaction const *> earlier;
+    for (uint32_t i = 0; i < block.vtx.size(); ++i) {
+        auto const & tx = *block.vtx[i];
+        if (i > 0 && customTxDecodeCache.Decode(tx)->type != CustomTxType::None) {
+            auto job = MakeUnique<CCustomTxSpeculation>(*this, base, tx, i);
+            bool prefetched = true;
+            for (auto const & input : tx.vin) {
+                auto const & coin = coins.AccessCoin(input.prevout);
+                if (!coin.IsSpent()) {
+                    job->coins.known.emplace(input.prevout, coin);
+                    continue;
+                }
+                // output of the earlier tx of the block, as UpdateCoins would add it
+                auto const prev = earlier.find(input.prevout.hash);
+                if (prev == earlier.end() || input.prevout.n >= prev->second->vout.size() || prev->second->vout[input.prevout.n].scriptPubKey.IsUnspendable()) {
+                    prefetched = false; // malformed or spends missing input, leave it to the block loop
+                    break;
+                }
+                job->coins.known.emplace(input.prevout, Coin(prev->second->vout[input.prevout.n], height, prev->second->IsCoinBase()));
+            }
+            if (prefetched) {
+                checks.emplace_back(job.get());
+                jobs.emplace(i, std::move(job));
+            }
+        }
+        earlier.emplace(tx.GetHash(), &tx);
+    }
+    return checks;
+}
+
+bool CCustomTxSpeculator::Check::operator()()
+{
+    auto const & speculator = job->speculator;
+    try {
+        CCoinsViewCache coins(&job->coins);
+        job->res = ApplyCustomTx(job->view, coins, job->tx, speculator.consensusParams, speculator.height, job->txn, speculator.isCheck);
+        job->done = true;
+    } catch (...) {
+        job->done = false; // the block loop applies it once again and gets the same error
+    }
+    return true;
+}
+
+Res CCustomTxSpeculator::Apply(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t txn)
+{
+    auto it = jobs.find(txn);
+    if (it != jobs.end() && it->second->done) {
+        auto & job = *it->second;
+        auto & changes = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw();
+        bool valid = !job.reads.Intersects(changes);
+        for (auto const & coin : job.coins.requested) {
+            if (!valid) {
+                break;
+            }
+            valid = SameCoin(coin.second, coins.AccessCoin(coin.first));
+        }
+        if (valid) {
+            for (auto const & kv : dynamic_cast<CFlushableStorageKV&>(job.view.GetRaw()).GetRaw()) {
+                if (kv.second) {
+                    mnview.GetRaw().Write(kv.first, *kv.second);
+                } else {
+                    mnview.GetRaw().Erase(kv.first);
+                }
+            }
+            ++committed;
+            return job.res;
+        }
+        ++reapplied;
+    }
+    return ApplyCustomTx(mnview, coins, tx, consensusParams, height, txn, isCheck);
+}
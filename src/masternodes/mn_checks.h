@@ -7,9 +7,16 @@
 
 #include <consensus/params.h>
 #include <masternodes/masternodes.h>
+#include <sync.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
 #include <vector>
 #include <cstring>
 
+#include <boost/variant.hpp>
+
 class CBlock;
 class CTransaction;
 class CTxMemPool;
@@ -109,6 +116,69 @@ inline void Unserialize(Stream& s, CustomTxType & txType) {
     txType = CustomTxCodeToType(ch);
 }
 
+struct CCustomTxMessageNone {};
+
+// messages of the most frequent custom txs, which are worth to keep decoded
+using CCustomTxMessage = boost::variant<
+    CCustomTxMessageNone,
+    CBalances,
+    CLiquidityMessage,
+    CRemoveLiquidityMessage,
+    CPoolSwapMessage,
+    CUtxosToAccountMessage,
+    CAccountToUtxosMessage,
+    CAccountToAccountMessage,
+    CAnyAccountsToAccountsMessage
+>;
+
+struct CCustomTxDecoded {
+    CustomTxType type;
+    std::vector<unsigned char> metadata;
+    CCustomTxMessage msg; // CCustomTxMessageNone if type is not kept decoded or message is malformed
+};
+
+static const size_t DEFAULT_CUSTOM_TX_CACHE_SIZE = 10000;
+
+/** Decoded custom txs by txid, shared by mempool acceptance, block assembly and ConnectBlock */
+class CCustomTxDecodeCache {
+public:
+    explicit CCustomTxDecodeCache(size_t maxSize = DEFAULT_CUSTOM_TX_CACHE_SIZE) : maxSize(maxSize) {}
+
+    // returns cached entry or decodes tx and caches it (custom txs only), counts hits and misses
+    std::shared_ptr<const CCustomTxDecoded> Decode(CTransaction const & tx);
+
+    // copies the message decoded from the same metadata of the tx, if any
+    template<typename T>
+    bool Get(CTransaction const & tx, std::vector<unsigned char> const & metadata, T & msg) {
+        auto const decoded = Find(tx);
+        if (!decoded || decoded->metadata != metadata) {
+            return false;
+        }
+        auto const cached = boost::get<T>(&decoded->msg);
+        if (!cached) {
+            return false;
+        }
+        msg = *cached;
+        return true;
+    }
+
+    uint64_t GetHits() const { return hits; }
+    uint64_t GetMisses() const { return misses; }
+    size_t Size() const;
+
+private:
+    std::shared_ptr<const CCustomTxDecoded> Find(CTransaction const & tx);
+
+    size_t const maxSize;
+    mutable CCriticalSection cs;
+    std::map<uint256, std::shared_ptr<const CCustomTxDecoded>> entries GUARDED_BY(cs);
+    std::deque<uint256> order GUARDED_BY(cs); // insertion order for eviction
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+extern CCustomTxDecodeCache customTxDecodeCache;
+
 bool HasAuth(CTransaction const & tx, CKeyID const & auth);
 bool HasAuth(CTransaction const & tx, CCoinsViewCache const & coins, CScript const & auth);
 bool HasCollateralAuth(CTransaction const & tx, CCoinsViewCache const & coins, uint256 const & collateralTx);
@@ -140,6 +210,54 @@ ResVal<uint256> ApplyAnchorRewardTx(CCustomCSView & mnview, CTransaction const &
 
 bool IsMempooledCustomTxCreate(const CTxMemPool& pool, const uint256 & txid);
 
+/** Min custom txs in a block to apply them speculatively */
+static const size_t PARALLEL_CUSTOMTX_MIN = 4;
+
+struct CCustomTxSpeculation;
+
+/**
+ * Optimistic parallel application of the custom txs of a block.
+ * Every tx is applied by the worker threads in its own layer over the base view (which must not change meanwhile),
+ * recording the keys and coins it reads. Then the block loop takes the results in block order: the writes are committed
+ * as is, unless an earlier tx of the block changed anything the speculation has read; such tx is applied once again, as usual.
+ */
+class CCustomTxSpeculator
+{
+public:
+    // CCheckQueue item, runs a single speculation
+    class Check {
+    public:
+        Check() : job(nullptr) {}
+        explicit Check(CCustomTxSpeculation * job_) : job(job_) {}
+        bool operator()();
+        void swap(Check & other) { std::swap(job, other.job); }
+    private:
+        CCustomTxSpeculation * job;
+    };
+
+    CCustomTxSpeculator(CCustomCSView & base, uint32_t height, Consensus::Params const & consensusParams, bool isCheck);
+    ~CCustomTxSpeculator();
+
+    // speculations of the block's custom txs, their inputs are taken from 'coins' (state before the block) or outputs of the earlier txs
+    std::vector<Check> Prepare(CBlock const & block, CCoinsViewCache const & coins);
+
+    // the same as ApplyCustomTx to 'mnview', which is a layer over the base with everything written since Prepare().
+    // 'coins' are the current ones, the speculation is taken if it has read the same coins and keys
+    Res Apply(CCustomCSView & mnview, CCoinsViewCache const & coins, CTransaction const & tx, uint32_t txn);
+
+    size_t GetCommitted() const { return committed; }
+    size_t GetReapplied() const { return reapplied; }
+
+private:
+    CCustomCSView & base;
+    uint32_t const height;
+    Consensus::Params const & consensusParams;
+    bool const isCheck;
+    std::map<uint32_t, std::unique_ptr<CCustomTxSpeculation>> jobs; // by txn
+    size_t committed;
+    size_t reapplied;
+};
+
 // @todo refactor header functions
 /*
  * Checks if given tx is probably one of 'CustomTx', returns tx type and serialized metadata in 'data'
@@ -42,42 +42,9 @@ extern bool DecodeHexTx(CTransaction& tx, std::string const& strHexTx); // in co
 extern void FundTransaction(CWallet* const pwallet, CMutableTransaction& tx, CAmount& fee_out, int& change_position,
                             UniValue options);
 
-extern UniValue ListReceived(interfaces::Chain::Lock& locked_chain, CWallet * const pwallet, const UniValue& params, bool by_label) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet);
-
 static CAccounts FindAccountsFromWallet(CWallet* const pwallet, bool includeWatchOnly = false) {
-
-    // make request for getting all addresses from wallet
-    UniValue params(UniValue::VARR);
-    // min confirmations
-    params.push_back(UniValue(0));
-    // include empty addresses
-    params.push_back(UniValue(true));
-    // include watch only addresses
-    params.push_back(UniValue(includeWatchOnly));
-
-    auto locked_chain = pwallet->chain().lock();
-    LOCK(pwallet->cs_wallet);
-
-    UniValue addresses = ListReceived(*locked_chain, pwallet, params, false);
-
-    CAccounts walletAccounts;
-    {
-        LOCK(cs_main);
-        for (uint32_t i = 0; i < addresses.size(); i++) {
-            CScript ownerScript = DecodeScript(addresses[i]["address"].get_str());
-            CBalances accountBalances;
-            pcustomcsview->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
-                if (owner != ownerScript)
-                    return false;
-                accountBalances.Add(balance);
-                return true;
-            }, BalanceKey{ownerScript, 0});
-            if (!accountBalances.balances.empty())
-                walletAccounts.emplace(ownerScript, accountBalances);
-        }
-    }
-
-    return walletAccounts;
+    pwallet->BlockUntilSyncedToCurrentChain();
+    return pwallet->GetAccountBalances(includeWatchOnly ? ISMINE_ALL : ISMINE_SPENDABLE);
 }
 
 typedef enum {
@@ -464,10 +431,10 @@ UniValue resignmasternode(const JSONRPCRequest& request) {
 }
 
 // Here (but not a class method) just by similarity with other '..ToJSON'
-UniValue mnToJSON(uint256 const & nodeId, CMasternode const& node, bool verbose) {
+UniValue mnToJSON(uint256 const & nodeId, CMasternode const& node, bool verbose, int height) {
     UniValue ret(UniValue::VOBJ);
     if (!verbose) {
-        ret.pushKV(nodeId.GetHex(), CMasternode::GetHumanReadableState(node.GetState()));
+        ret.pushKV(nodeId.GetHex(), CMasternode::GetHumanReadableState(node.GetState(height)));
     }
     else {
         UniValue obj(UniValue::VOBJ);
@@ -483,7 +450,7 @@ UniValue mnToJSON(uint256 const & nodeId, CMasternode const& node, bool verbose)
         obj.pushKV("resignTx", node.resignTx.GetHex());
         obj.pushKV("banHeight", node.banHeight);
         obj.pushKV("banTx", node.banTx.GetHex());
-        obj.pushKV("state", CMasternode::GetHumanReadableState(node.GetState()));
+        obj.pushKV("state", CMasternode::GetHumanReadableState(node.GetState(height)));
         obj.pushKV("mintedBlocks", (uint64_t) node.mintedBlocks);
 
         /// @todo add unlock height and|or real resign height
@@ -551,11 +518,11 @@ UniValue listmasternodes(const JSONRPCRequest& request) {
 
     UniValue ret(UniValue::VOBJ);
 
-    LOCK(cs_main);
-    pcustomcsview->ForEachMasternode([&](uint256 const& nodeId, CMasternode& node) {
-        ret.pushKVs(mnToJSON(nodeId, node, verbose));
-        limit--;
-        return limit != 0;
+    auto const registry = GetMasternodesRegistry();
+    auto const height = registry->GetHeight();
+    registry->ForEachNode([&](CMasternodesRegistry::Entry const& entry) {
+        ret.pushKVs(mnToJSON(entry.id, entry.node, verbose, height));
+        return --limit != 0;
     }, start);
 
     return ret;
@@ -578,10 +545,10 @@ UniValue getmasternode(const JSONRPCRequest& request) {
 
     uint256 id = ParseHashV(request.params[0], "masternode id");
 
-    LOCK(cs_main);
-    auto node = pcustomcsview->GetMasternode(id);
-    if (node) {
-        return mnToJSON(id, *node, true); // or maybe just node, w/o id?
+    auto const registry = GetMasternodesRegistry();
+    auto entry = registry->Get(id);
+    if (entry) {
+        return mnToJSON(id, entry->node, true, registry->GetHeight()); // or maybe just node, w/o id?
     }
     throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Masternode not found");
 }
@@ -1049,6 +1016,7 @@ UniValue tokenToJSON(DCT_ID const& id, CTokenImplementation const& token, bool v
         tokenObj.pushKV("destructionTx", token.destructionTx.ToString());
         tokenObj.pushKV("destructionHeight", token.destructionHeight);
         if (!token.IsPoolShare()) {
+            LOCK(cs_main);
             const Coin& authCoin = ::ChainstateActive().CoinsTip().AccessCoin(COutPoint(token.creationTx, 1)); // always n=1 output
             tokenObj.pushKV("collateralAddress", ScriptToString(authCoin.out.scriptPubKey));
         } else {
@@ -1118,10 +1086,8 @@ UniValue listtokens(const JSONRPCRequest& request) {
         }
     }
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
-    pcustomcsview->ForEachToken([&](DCT_ID const& id, CTokenImplementation const& token) {
+    GetViewSnapshot()->ForEachToken([&](DCT_ID const& id, CTokenImplementation const& token) {
         ret.pushKVs(tokenToJSON(id, token, verbose));
 
         limit--;
@@ -1318,13 +1284,13 @@ BalanceKey decodeBalanceKey(std::string const& str) {
     return {hexToScript(pair.first), tokenID};
 }
 
-std::string tokenAmountString(CTokenAmount const& amount) {
-    const auto token = pcustomcsview->GetToken(amount.nTokenId);
+std::string tokenAmountString(CTokenAmount const& amount, CTokensTable const& tokens) {
+    const auto token = &tokens.Get(amount.nTokenId)->token;
     const auto valueString = strprintf("%d.%08d", amount.nValue / COIN, amount.nValue % COIN);
     return valueString + "@" + token->symbol + (token->IsDAT() ? "" : "#" + amount.nTokenId.ToString());
 }
 
-UniValue accountToJSON(CScript const& owner, CTokenAmount const& amount, bool verbose, bool indexed_amounts) {
+UniValue accountToJSON(CScript const& owner, CTokenAmount const& amount, bool verbose, bool indexed_amounts, CTokensTable const& tokens) {
     // encode CScript into JSON
     UniValue ownerObj(UniValue::VOBJ);
     ScriptPubKeyToUniv(owner, ownerObj, true);
@@ -1347,7 +1313,7 @@ UniValue accountToJSON(CScript const& owner, CTokenAmount const& amount, bool ve
         obj.pushKV("amount", amountObj);
     }
     else {
-        obj.pushKV("amount", tokenAmountString(amount));
+        obj.pushKV("amount", tokenAmountString(amount, tokens));
     }
 
     return obj;
@@ -1430,15 +1396,16 @@ UniValue listaccounts(const JSONRPCRequest& request) {
 
     UniValue ret(UniValue::VARR);
 
-    LOCK(cs_main);
-    pcustomcsview->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
+    auto const view = GetViewSnapshot();
+    auto const tokens = view->GetTokensTable();
+    view->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
         if (isMineOnly) {
             if (IsMine(*pwallet, owner) == ISMINE_SPENDABLE) {
-                ret.push_back(accountToJSON(owner, balance, verbose, indexed_amounts));
+                ret.push_back(accountToJSON(owner, balance, verbose, indexed_amounts, *tokens));
                 limit--;
             }
         } else {
-            ret.push_back(accountToJSON(owner, balance, verbose, indexed_amounts));
+            ret.push_back(accountToJSON(owner, balance, verbose, indexed_amounts, *tokens));
             limit--;
         }
 
@@ -1514,8 +1481,9 @@ UniValue getaccount(const JSONRPCRequest& request) {
         ret.setObject();
     }
 
-    LOCK(cs_main);
-    pcustomcsview->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
+    auto const view = GetViewSnapshot();
+    auto const tokens = view->GetTokensTable();
+    view->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
         if (owner != reqOwner) {
             return false;
         }
@@ -1523,7 +1491,7 @@ UniValue getaccount(const JSONRPCRequest& request) {
         if (indexed_amounts)
             ret.pushKV(balance.nTokenId.ToString(), ValueFromAmount(balance.nValue));
         else
-            ret.push_back(tokenAmountString(balance));
+            ret.push_back(tokenAmountString(balance, *tokens));
 
         limit--;
         return limit != 0;
@@ -1600,25 +1568,19 @@ UniValue gettokenbalances(const JSONRPCRequest& request) {
         ret.setObject();
     }
 
-    LOCK(cs_main);
+    pwallet->BlockUntilSyncedToCurrentChain();
+
     CBalances totalBalances;
-    CScript oldOwner;
-    pcustomcsview->ForEachBalance([&](CScript const & owner, CTokenAmount const & balance) {
-        if (oldOwner == owner) {
-            totalBalances.Add(balance);
-        } else if (IsMine(*pwallet, owner) == ISMINE_SPENDABLE) {
-            oldOwner = owner;
-            totalBalances.Add(balance);
-        }
-        return true;
-    });
+    for (auto const & account : pwallet->GetAccountBalances(ISMINE_SPENDABLE)) {
+        totalBalances.AddBalances(account.second.balances);
+    }
+    auto const tokens = GetTokensTable();
     auto it = totalBalances.balances.lower_bound(start);
     for (int i = 0; it != totalBalances.balances.end() && i < limit; it++, i++) {
         CTokenAmount bal = CTokenAmount{(*it).first, (*it).second};
         std::string tokenIdStr = bal.nTokenId.ToString();
         if (symbol_lookup) {
-            auto token = pcustomcsview->GetToken(bal.nTokenId);
-            tokenIdStr = token->CreateSymbolKey(bal.nTokenId);
+            tokenIdStr = tokens->Get(bal.nTokenId)->token.CreateSymbolKey(bal.nTokenId);
         }
         if (indexed_amounts)
             ret.pushKV(tokenIdStr, ValueFromAmount(bal.nValue));
@@ -1729,11 +1691,11 @@ UniValue listpoolpairs(const JSONRPCRequest& request) {
         }
     }
 
-    LOCK(cs_main);
+    auto const view = GetViewSnapshot();
 
     UniValue ret(UniValue::VOBJ);
-    pcustomcsview->ForEachPoolPair([&](DCT_ID const & id, CPoolPair const & pool) {
-        const auto token = pcustomcsview->GetToken(id);
+    view->ForEachPoolPair([&](DCT_ID const & id, CPoolPair const & pool) {
+        const auto token = view->GetToken(id);
         if (token) {
             ret.pushKVs(poolToJSON(id, pool, *token, verbose));
         }
@@ -2590,7 +2552,8 @@ UniValue updatepoolpair(const JSONRPCRequest& request) {
     return signsend(rawTx, request)->GetHash().GetHex();
 }
 
-void CheckAndFillPoolSwapMessage(const JSONRPCRequest& request, CPoolSwapMessage &poolSwapMsg) {
+// 'withDefaultPrice' - fill omitted maxPrice by the current price of the pair +3%
+void CheckAndFillPoolSwapMessage(const JSONRPCRequest& request, CPoolSwapMessage &poolSwapMsg, CCustomCSView const & view, bool withDefaultPrice = true) {
     std::string tokenFrom, tokenTo;
     UniValue metadataObj = request.params[0].get_obj();
     if (!metadataObj["from"].isNull()) {
@@ -2609,12 +2572,11 @@ void CheckAndFillPoolSwapMessage(const JSONRPCRequest& request, CPoolSwapMessage
         tokenTo = metadataObj["tokenTo"].getValStr();
     }
     {
-        LOCK(cs_main);
-        auto token = pcustomcsview->GetTokenGuessId(tokenFrom, poolSwapMsg.idTokenFrom);
+        auto token = view.GetTokenGuessId(tokenFrom, poolSwapMsg.idTokenFrom);
         if (!token)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "TokenFrom was not found");
 
-        auto token2 = pcustomcsview->GetTokenGuessId(tokenTo, poolSwapMsg.idTokenTo);
+        auto token2 = view.GetTokenGuessId(tokenTo, poolSwapMsg.idTokenTo);
         if (!token2)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "TokenTo was not found");
 
@@ -2623,10 +2585,10 @@ void CheckAndFillPoolSwapMessage(const JSONRPCRequest& request, CPoolSwapMessage
             poolSwapMsg.maxPrice.integer = maxPrice / COIN;
             poolSwapMsg.maxPrice.fraction = maxPrice % COIN;
         }
-        else {
+        else if (withDefaultPrice) {
             // This is only for maxPrice calculation
 
-            auto poolPair = pcustomcsview->GetPoolPair(poolSwapMsg.idTokenFrom, poolSwapMsg.idTokenTo);
+            auto poolPair = view.GetPoolPair(poolSwapMsg.idTokenFrom, poolSwapMsg.idTokenTo);
             if (!poolPair) {
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "Can't find the poolpair " + tokenFrom + "-" + tokenTo);
             }
@@ -2717,7 +2679,7 @@ UniValue poolswap(const JSONRPCRequest& request) {
     RPCTypeCheck(request.params, {UniValue::VOBJ, UniValue::VARR}, true);
 
     CPoolSwapMessage poolSwapMsg{};
-    CheckAndFillPoolSwapMessage(request, poolSwapMsg);
+    CheckAndFillPoolSwapMessage(request, poolSwapMsg, *GetViewSnapshot());
     int targetHeight = chainHeight(*pwallet->chain().lock()) + 1;
 
     CDataStream metadata(DfTxMarker, SER_NETWORK, PROTOCOL_VERSION);
@@ -2780,6 +2742,8 @@ UniValue testpoolswap(const JSONRPCRequest& request) {
                                        "Maximum acceptable price"},
                        },
                    },
+                   {"path", RPCArg::Type::STR, /* default */ "direct", "\"direct\" - swap through the pool of the pair, "
+                                       "\"auto\" - the best route of up to " + std::to_string(CPoolGraph::DEFAULT_MAX_HOPS) + " pools (maxPrice is not applied)"},
                },
                RPCResult{
                           "\"amount@tokenId\"    (string) The string with amount result of poolswap in format AMOUNT@TOKENID.\n"
@@ -2802,37 +2766,24 @@ UniValue testpoolswap(const JSONRPCRequest& request) {
                },
     }.Check(request);
 
-    RPCTypeCheck(request.params, {UniValue::VOBJ}, true);
-
-    CPoolSwapMessage poolSwapMsg{};
-    CheckAndFillPoolSwapMessage(request, poolSwapMsg);
-
-    int targetHeight = ::ChainActive().Height() + 1;
+    RPCTypeCheck(request.params, {UniValue::VOBJ, UniValue::VSTR}, true);
 
-    // test execution and get amount
-    Res res = Res::Ok();
-    {
-        LOCK(cs_main);
-        CCustomCSView mnview_dummy(*pcustomcsview); // create dummy cache for test state writing
-
-        auto poolPair = mnview_dummy.GetPoolPair(poolSwapMsg.idTokenFrom, poolSwapMsg.idTokenTo);
-
-        const std::string base{"PoolSwap creation: " + poolSwapMsg.ToString()};
+    std::string const path = request.params[1].isNull() ? "direct" : request.params[1].get_str();
+    if (path != "direct" && path != "auto") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "path should be \"direct\" or \"auto\"");
+    }
 
-        CPoolPair pp = poolPair->second;
-        res = pp.Swap({poolSwapMsg.idTokenFrom, poolSwapMsg.amountFrom}, poolSwapMsg.maxPrice, [&] (const CTokenAmount &tokenAmount) {
-            auto resPP = mnview_dummy.SetPoolPair(poolPair->first, pp);
-            if (!resPP.ok) {
-                return Res::Err("%s: %s", base, resPP.msg);
-            }
+    CPoolSwapMessage poolSwapMsg{};
+    CheckAndFillPoolSwapMessage(request, poolSwapMsg, *GetViewSnapshot(), path == "direct");
 
-            return Res::Ok(tokenAmount.ToString());
-        }, targetHeight >= Params().GetConsensus().BayfrontGardensHeight);
+    // quotes come from the in-memory pools of the tip, neither cs_main nor the db are touched
+    auto const graph = GetPoolGraph();
+    CTokenAmount const in{poolSwapMsg.idTokenFrom, poolSwapMsg.amountFrom};
+    auto quote = path == "direct" ? graph->QuoteDirect(in, poolSwapMsg.idTokenTo, poolSwapMsg.maxPrice) : graph->QuoteBest(in, poolSwapMsg.idTokenTo);
+    if (!quote.ok)
+        throw JSONRPCError(RPC_VERIFY_ERROR, quote.msg);
 
-        if (!res.ok)
-            throw JSONRPCError(RPC_VERIFY_ERROR, res.msg);
-    }
-    return UniValue(res.msg);
+    return UniValue(quote.val->out.ToString());
 }
 
 UniValue poolShareToJSON(DCT_ID const & poolId, CScript const & provider, CAmount const& amount, CPoolPair const& poolPair, bool verbose) {
@@ -2917,17 +2868,17 @@ UniValue listpoolshares(const JSONRPCRequest& request) {
         }
     }
 
-    LOCK(cs_main);
+    auto const view = GetViewSnapshot();
 
     PoolShareKey startKey{ start, CScript{} };
 //    startKey.poolID = start;
 //    startKey.owner = CScript(0);
 
     UniValue ret(UniValue::VOBJ);
-    pcustomcsview->ForEachPoolShare([&](DCT_ID const & poolId, CScript const & provider) {
-        const CTokenAmount tokenAmount = pcustomcsview->GetBalance(provider, poolId);
+    view->ForEachPoolShare([&](DCT_ID const & poolId, CScript const & provider) {
+        const CTokenAmount tokenAmount = view->GetBalance(provider, poolId);
         if(tokenAmount.nValue) {
-            const auto poolPair = pcustomcsview->GetPoolPair(poolId);
+            const auto poolPair = view->GetPoolPair(poolId);
             if(poolPair) {
                 if (isMineOnly) {
                     if (IsMine(*pwallet, provider) == ISMINE_SPENDABLE) {
@@ -2947,7 +2898,7 @@ UniValue listpoolshares(const JSONRPCRequest& request) {
     return ret;
 }
 
-UniValue accounthistoryToJSON(CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs) {
+UniValue accounthistoryToJSON(CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs, CTokensTable const & tokens) {
     UniValue obj(UniValue::VOBJ);
 
     obj.pushKV("owner", ScriptToString(owner));
@@ -2960,8 +2911,7 @@ UniValue accounthistoryToJSON(CScript const & owner, uint32_t height, uint32_t t
 
     UniValue diffsObj(UniValue::VARR);
     for (auto const & diff : diffs) {
-        auto token = pcustomcsview->GetToken(diff.first);
-        std::string const tokenIdStr = token->CreateSymbolKey(diff.first);
+        std::string const tokenIdStr = tokens.Get(diff.first)->token.CreateSymbolKey(diff.first);
 
         diffsObj.push_back(ValueFromAmount(diff.second).getValStr() + "@" + tokenIdStr);
     }
@@ -2975,7 +2925,8 @@ UniValue listaccounthistory(const JSONRPCRequest& request) {
                "\nReturns information about account history.\n",
                {
                         {"owner", RPCArg::Type::STR, RPCArg::Optional::OMITTED,
-                                    "Single account ID (CScript or address) or reserved words: \"mine\" - to list history for all owned accounts or \"all\" to list whole DB (default = \"mine\")."},
+                                    "Single account ID (CScript or address) or reserved words: \"mine\" - to list history for all owned accounts or \"all\" to list whole DB (default = \"mine\").\n"
+                                    "History of \"mine\" and \"all\" goes from the latest blocks (and txs) across the accounts, history of a single account from its latest ones."},
                         {"options", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
                             {
                                  {"maxBlockHeight", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
@@ -2986,6 +2937,8 @@ UniValue listaccounthistory(const JSONRPCRequest& request) {
                                   "Filter out rewards"},
                                  {"token", RPCArg::Type::STR, RPCArg::Optional::OMITTED,
                                   "Filter by token"},
+                                 {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
+                                  "Maximum number of records to return (default = no limit)"},
                             },
                         },
                },
@@ -3007,6 +2960,7 @@ UniValue listaccounthistory(const JSONRPCRequest& request) {
     uint32_t depth = 100;
     bool noRewards = false;
     std::string tokenFilter;
+    uint32_t limit = std::numeric_limits<uint32_t>::max();
 
     if (request.params.size() > 1) {
         UniValue optionsObj = request.params[1].get_obj();
@@ -3016,6 +2970,7 @@ UniValue listaccounthistory(const JSONRPCRequest& request) {
                 {"depth", UniValueType(UniValue::VNUM)},
                 {"no_rewards", UniValueType(UniValue::VBOOL)},
                 {"token", UniValueType(UniValue::VSTR)},
+                {"limit", UniValueType(UniValue::VNUM)},
             }, true, true);
 
         if (!optionsObj["maxBlockHeight"].isNull()) {
@@ -3032,127 +2987,88 @@ UniValue listaccounthistory(const JSONRPCRequest& request) {
         if (!optionsObj["token"].isNull()) {
             tokenFilter = optionsObj["token"].get_str();
         }
+
+        if (!optionsObj["limit"].isNull()) {
+            limit = (uint32_t) optionsObj["limit"].get_int64();
+        }
+        if (limit == 0) {
+            limit = std::numeric_limits<decltype(limit)>::max();
+        }
     }
 
     pwallet->BlockUntilSyncedToCurrentChain();
-    startBlock = std::min(startBlock, uint32_t(chainHeight(*pwallet->chain().lock())));
+    auto const view = GetViewSnapshot();
+    auto const tokens = view->GetTokensTable();
+    startBlock = std::min(startBlock, uint32_t(view->GetLastHeight()));
+    uint32_t const minBlock = depth <= startBlock ? startBlock - depth : 0;
+
+    // token filter is resolved once, then records are matched by token id
+    DCT_ID tokenId{};
+    if (!tokenFilter.empty()) {
+        auto token = tokens->Get(tokenFilter);
+        if (!token) {
+            return UniValue(UniValue::VARR); // nothing could match
+        }
+        tokenId = token->id;
+    }
 
     UniValue ret(UniValue::VARR);
 
-    if (accounts == "mine") {
-        // traversing through owned scripts
-        CScript prevOwner{};
-        bool isMine = false;
-        AccountHistoryKey startKey{ prevOwner, startBlock, std::numeric_limits<uint32_t>::max() }; // starting from max txn values
-        pcustomcsview->ForEachAccountHistory([&](CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs) {
-            if (height > startKey.blockHeight || (depth <= startKey.blockHeight && (height < startKey.blockHeight - depth)))
-                return true; // continue
-
-            if(!tokenFilter.empty()) {
-                bool hasToken = false;
-                for (auto const & diff : diffs) {
-                    auto token = pcustomcsview->GetToken(diff.first);
-                    std::string const tokenIdStr = token->CreateSymbolKey(diff.first);
-
-                    if(tokenIdStr == tokenFilter) {
-                        hasToken = true;
-                        break;
-                    }
-                }
-
-                if(!hasToken) {
-                    return true; // continue
-                }
-            }
-
-            if(noRewards) {
-                if(category == static_cast<unsigned char>(CustomTxType::NonTxRewards)) {
-                    return true; // continue
-                }
-            }
-
-            if (prevOwner != owner) {
-                prevOwner = owner;
-                isMine = IsMine(*pwallet, owner) == ISMINE_SPENDABLE;
-            }
+    auto shouldSkip = [&] (unsigned char category, TAmounts const & diffs) {
+        if (!tokenFilter.empty() && diffs.find(tokenId) == diffs.end()) {
+            return true;
+        }
+        if (noRewards && category == static_cast<unsigned char>(CustomTxType::NonTxRewards)) {
+            return true;
+        }
+        return false;
+    };
 
-            if (isMine) {
-                ret.push_back(accounthistoryToJSON(owner, height, txn, txid, category, diffs));
+    if (accounts == "mine" || accounts == "all") {
+        bool const mineOnly = accounts == "mine";
+        // seeking straight to the heights range (and token) through the secondary indexes,
+        // rows go in their order (by height across the owners), so the walk stops at the limit
+        std::map<CScript, bool> isMineCache;
+        auto onHistory = [&](CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs) {
+            if (height < minBlock) {
+                return false; // stop, out of depth
             }
-
-            return true;
-        }, startKey);
-    }
-    else if (accounts == "all") {
-        // traversing the whole DB, skipping wrong heights
-        AccountHistoryKey startKey{ CScript{}, startBlock, std::numeric_limits<uint32_t>::max() }; // starting from max txn values
-        pcustomcsview->ForEachAccountHistory([&](CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs) {
-            if (height > startKey.blockHeight || (depth <= startKey.blockHeight && (height < startKey.blockHeight - depth))) {
+            if (shouldSkip(category, diffs)) {
                 return true; // continue
             }
-
-            if(!tokenFilter.empty()) {
-                bool hasToken = false;
-                for (auto const & diff : diffs) {
-                    auto token = pcustomcsview->GetToken(diff.first);
-                    std::string const tokenIdStr = token->CreateSymbolKey(diff.first);
-
-                    if(tokenIdStr == tokenFilter) {
-                        hasToken = true;
-                        break;
-                    }
-                }
-
-                if(!hasToken) {
-                    return true; // continue
+            if (mineOnly) {
+                auto it = isMineCache.find(owner);
+                if (it == isMineCache.end()) {
+                    it = isMineCache.emplace(owner, IsMine(*pwallet, owner) == ISMINE_SPENDABLE).first;
                 }
-            }
-
-            if(noRewards) {
-                if(category == static_cast<unsigned char>(CustomTxType::NonTxRewards)) {
+                if (!it->second) {
                     return true; // continue
                 }
             }
-
-            ret.push_back(accounthistoryToJSON(owner, height, txn, txid, category, diffs));
-            return true;
-        }, startKey);
-
+            ret.push_back(accounthistoryToJSON(owner, height, txn, txid, category, diffs, *tokens));
+            return ret.size() < limit;
+        };
+        if (!tokenFilter.empty()) {
+            view->ForEachAccountHistoryByToken(tokenId, onHistory, startBlock);
+        } else {
+            view->ForEachAccountHistoryByHeight(onHistory, startBlock);
+        }
     }
     else {
         // parse single script/address:
         CScript const owner = DecodeScript(accounts);
 
         AccountHistoryKey startKey{ owner, startBlock, std::numeric_limits<uint32_t>::max() }; // starting from max txn values
-        pcustomcsview->ForEachAccountHistory([&](CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs) {
-            if (owner != startKey.owner || (height > startKey.blockHeight || (depth <= startKey.blockHeight && (height < startKey.blockHeight - depth))))
+        view->ForEachAccountHistory([&](CScript const & owner, uint32_t height, uint32_t txn, uint256 const & txid, unsigned char category, TAmounts const & diffs) {
+            if (owner != startKey.owner || (height > startKey.blockHeight || height < minBlock))
                 return false;
 
-            if(!tokenFilter.empty()) {
-                bool hasToken = false;
-                for (auto const & diff : diffs) {
-                    auto token = pcustomcsview->GetToken(diff.first);
-                    std::string const tokenIdStr = token->CreateSymbolKey(diff.first);
-
-                    if(tokenIdStr == tokenFilter) {
-                        hasToken = true;
-                        break;
-                    }
-                }
-
-                if(!hasToken) {
-                    return true; // continue
-                }
-            }
-
-            if(noRewards) {
-                if(category == static_cast<unsigned char>(CustomTxType::NonTxRewards)) {
-                    return true; // continue
-                }
+            if (shouldSkip(category, diffs)) {
+                return true; // continue
             }
 
-            ret.push_back(accounthistoryToJSON(owner, height, txn, txid, category, diffs));
-            return true;
+            ret.push_back(accounthistoryToJSON(owner, height, txn, txid, category, diffs, *tokens));
+            return ret.size() < limit;
         }, startKey);
     }
 
@@ -3183,6 +3099,43 @@ UniValue listcommunitybalances(const JSONRPCRequest& request) {
     return ret;
 }
 
+UniValue getundopruneinfo(const JSONRPCRequest& request) {
+    RPCHelpMan{"getundopruneinfo",
+               "\nReturns progress of masternode undo data pruning (see -mnundokeep).\n",
+               {
+               },
+               RPCResult{
+                       "{\n"
+                       "  \"enabled\": true|false,        (bool) Whether undo pruning is enabled\n"
+                       "  \"keep\": n,                    (numeric) Number of blocks from tip to keep undo data for\n"
+                       "  \"height\": n,                  (numeric) Current height of the masternode state\n"
+                       "  \"targetheight\": n,            (numeric) Undo data below this height is to be pruned\n"
+                       "  \"prunedheight\": n,            (numeric) Undo data below this height is already pruned\n"
+                       "  \"prunedrecords\": n,           (numeric) Undo records pruned since node start\n"
+                       "  \"reclaimedbytes\": n,          (numeric) Size of pruned undo records since node start\n"
+                       "}\n"
+               },
+               RPCExamples{
+                       HelpExampleCli("getundopruneinfo", "")
+                       + HelpExampleRpc("getundopruneinfo", "")
+               },
+    }.Check(request);
+
+    LOCK(cs_main);
+    auto const height = (uint32_t) pcustomcsview->GetLastHeight();
+    auto const keep = undosPruneStats.keep;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", keep > 0);
+    ret.pushKV("keep", (uint64_t) keep);
+    ret.pushKV("height", (uint64_t) height);
+    ret.pushKV("targetheight", (uint64_t) (keep > 0 && height > keep ? height - keep : 0));
+    ret.pushKV("prunedheight", (uint64_t) pcustomcsview->GetUndosPrunedHeight());
+    ret.pushKV("prunedrecords", undosPruneStats.records);
+    ret.pushKV("reclaimedbytes", undosPruneStats.bytes);
+    return ret;
+}
+
 UniValue setgov(const JSONRPCRequest& request) {
     CWallet* const pwallet = GetWallet(request);
 
@@ -3498,12 +3451,13 @@ static const CRPCCommand commands[] =
     {"poolpair",    "updatepoolpair",        &updatepoolpair,        {"metadata", "inputs"}},
     {"poolpair",    "poolswap",              &poolswap,              {"metadata", "inputs"}},
     {"poolpair",    "listpoolshares",        &listpoolshares,     {"pagination", "verbose", "is_mine_only"}},
-    {"poolpair",    "testpoolswap",          &testpoolswap,          {"metadata"}},
+    {"poolpair",    "testpoolswap",          &testpoolswap,          {"metadata", "path"}},
     {"accounts",    "listaccounthistory",    &listaccounthistory,    {"owner", "options"}},
     {"accounts",    "listcommunitybalances", &listcommunitybalances, {}},
     {"blockchain",  "setgov",                &setgov,                {"variables", "inputs"}},
     {"blockchain",  "getgov",                &getgov,                {"name"}},
     {"blockchain",  "isappliedcustomtx",     &isappliedcustomtx,     {"txid", "blockHeight"}},
+    {"blockchain",  "getundopruneinfo",      &getundopruneinfo,      {}},
     {"accounts",    "sendtokenstoaddress",   &sendtokenstoaddress,   {"from", "to", "selectionMode"}},
 };
 
@@ -0,0 +1,44 @@
+// Copyright (c) 2020 DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <masternodes/owners.h>
+
+/// @attention make sure that it does not overlap with those in masternodes.cpp/tokens.cpp/undos.cpp/accounts.cpp !!!
+const unsigned char COwnersView::ByOwnerID::prefix = 'O';
+
+static TBytes MakeOwnerIDKey(OwnerID const & id)
+{
+    TBytes key(1 + OWNER_ID_SIZE);
+    key[0] = COwnersView::ByOwnerID::prefix;
+    std::copy(id.begin(), id.end(), key.begin() + 1);
+    return key;
+}
+
+OwnerID COwnersView::InternOwner(CScript const & owner)
+{
+    auto const id = GetOwnerID(owner);
+    auto const key = MakeOwnerIDKey(id);
+    if (!DB().Exists(key)) {
+        DB().Write(key, TBytes(owner.begin(), owner.end()));
+    }
+    return id;
+}
+
+boost::optional<CScript> COwnersView::GetOwner(OwnerID const & id) const
+{
+    TBytes value;
+    if (!DB().Read(MakeOwnerIDKey(id), value)) {
+        return {};
+    }
+    return CScript(value.begin(), value.end());
+}
+
+CScript const * COwnersView::OwnerResolver::operator()(OwnerID const & next)
+{
+    if (!id || *id != next) {
+        id = next;
+        owner = view.GetOwner(next);
+    }
+    return owner ? owner.get_ptr() : nullptr;
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2020 DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEFI_MASTERNODES_OWNERS_H
+#define DEFI_MASTERNODES_OWNERS_H
+
+#include <amount.h>
+#include <crypto/common.h>
+#include <flushablestorage.h>
+#include <hash.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <boost/optional.hpp>
+
+/// Fixed-width id of the balance/share owner (hash160 of the script), scripts themselves are interned in COwnersView
+using OwnerID = uint160;
+
+inline OwnerID GetOwnerID(CScript const & owner) {
+    return Hash160(owner.begin(), owner.end());
+}
+
+/// Compact keys of the hot tables, built right into the buffer, without streams:
+/// owner keys:  prefix | owner id (20 bytes) | big-endian id (4 bytes)
+/// id keys:     prefix | big-endian id (4 bytes) | owner id (20 bytes)
+/// Both have the same size, so a record of these tables is recognized by the key length.
+static const size_t OWNER_ID_SIZE = 20;
+static const size_t COMPACT_KEY_SIZE = 1 + OWNER_ID_SIZE + sizeof(uint32_t);
+static_assert(sizeof(OwnerID) == OWNER_ID_SIZE, "unexpected owner id size");
+
+inline TBytes MakeOwnerKey(unsigned char prefix, OwnerID const & owner, uint32_t id) {
+    TBytes key(COMPACT_KEY_SIZE);
+    key[0] = prefix;
+    std::copy(owner.begin(), owner.end(), key.begin() + 1);
+    WriteBE32(key.data() + 1 + OWNER_ID_SIZE, id);
+    return key;
+}
+
+inline TBytes MakeIdOwnerKey(unsigned char prefix, uint32_t id, OwnerID const & owner) {
+    TBytes key(COMPACT_KEY_SIZE);
+    key[0] = prefix;
+    WriteBE32(key.data() + 1, id);
+    std::copy(owner.begin(), owner.end(), key.begin() + 1 + sizeof(uint32_t));
+    return key;
+}
+
+// returns false if the key isn't a compact one
+inline bool ParseOwnerKey(TBytesSpan key, OwnerID & owner, uint32_t & id) {
+    if (key.size() != COMPACT_KEY_SIZE) {
+        return false;
+    }
+    std::copy(key.begin() + 1, key.begin() + 1 + OWNER_ID_SIZE, owner.begin());
+    id = ReadBE32(key.data() + 1 + OWNER_ID_SIZE);
+    return true;
+}
+
+inline bool ParseIdOwnerKey(TBytesSpan key, uint32_t & id, OwnerID & owner) {
+    if (key.size() != COMPACT_KEY_SIZE) {
+        return false;
+    }
+    id = ReadBE32(key.data() + 1);
+    std::copy(key.begin() + 1 + sizeof(uint32_t), key.end(), owner.begin());
+    return true;
+}
+
+// amounts are stored as plain 8 bytes LE (the same as serialized CAmount)
+inline TBytes AmountToBytes(CAmount amount) {
+    TBytes value(sizeof(CAmount));
+    WriteLE64(value.data(), static_cast<uint64_t>(amount));
+    return value;
+}
+
+inline CAmount BytesToAmount(TBytesSpan value) {
+    return value.size() == sizeof(CAmount) ? static_cast<CAmount>(ReadLE64(value.data())) : 0;
+}
+
+class COwnersView : public virtual CStorageView
+{
+public:
+    // stores the script under its id if it's not there yet
+    OwnerID InternOwner(CScript const & owner);
+    boost::optional<CScript> GetOwner(OwnerID const & id) const;
+
+    // resolves ids of sequential records, consecutive records of the same owner don't repeat the lookup
+    struct OwnerResolver {
+        COwnersView const & view;
+        boost::optional<OwnerID> id;
+        boost::optional<CScript> owner;
+
+        explicit OwnerResolver(COwnersView const & view_) : view(view_) {}
+        // nullptr if the owner isn't interned (broken record)
+        CScript const * operator()(OwnerID const & next);
+    };
+
+    // tags
+    struct ByOwnerID { static const unsigned char prefix; };
+};
+
+#endif //DEFI_MASTERNODES_OWNERS_H
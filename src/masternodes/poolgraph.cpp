@@ -0,0 +1,122 @@
+// Copyright (c) 2020 DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <masternodes/poolgraph.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+CPoolGraph::CPoolGraph(CPoolPairView & view, int height_, bool postBayfrontGardens_)
+    : height(height_)
+    , postBayfrontGardens(postBayfrontGardens_)
+{
+    view.ForEachPoolPair([&] (DCT_ID const & poolId, CPoolPair const & pool) {
+        pools.push_back({poolId, pool});
+        return true;
+    });
+    // keys are varints, their byte order matches the ids order only below 16512
+    std::sort(pools.begin(), pools.end(), [] (Pool const & a, Pool const & b) {
+        return a.id < b.id;
+    });
+    for (size_t i = 0; i < pools.size(); ++i) {
+        tokenPools[pools[i].pool.idTokenA].push_back(i);
+        tokenPools[pools[i].pool.idTokenB].push_back(i);
+    }
+}
+
+CPoolGraph::Pool const * CPoolGraph::GetPool(DCT_ID const & poolId) const
+{
+    auto it = std::lower_bound(pools.begin(), pools.end(), poolId, [] (Pool const & pool, DCT_ID const & id) {
+        return pool.id < id;
+    });
+    return it != pools.end() && it->id == poolId ? &*it : nullptr;
+}
+
+CPoolGraph::Pool const * CPoolGraph::GetPool(DCT_ID const & tokenA, DCT_ID const & tokenB) const
+{
+    auto it = tokenPools.find(tokenA);
+    if (it == tokenPools.end()) {
+        return nullptr;
+    }
+    for (auto idx : it->second) {
+        auto const & pool = pools[idx].pool;
+        if ((pool.idTokenA == tokenA && pool.idTokenB == tokenB) || (pool.idTokenA == tokenB && pool.idTokenB == tokenA)) {
+            return &pools[idx];
+        }
+    }
+    return nullptr;
+}
+
+Res CPoolGraph::Swap(Pool const & pool, CTokenAmount const & in, PoolPrice const & maxPrice, CTokenAmount & out) const
+{
+    CPoolPair pp = pool.pool;
+    return pp.Swap(in, maxPrice, [&out] (CTokenAmount const & tokenAmount) {
+        out = tokenAmount;
+        return Res::Ok();
+    }, postBayfrontGardens);
+}
+
+ResVal<CPoolGraph::Quote> CPoolGraph::QuoteDirect(CTokenAmount const & in, DCT_ID const & tokenTo, PoolPrice const & maxPrice) const
+{
+    auto pool = GetPool(in.nTokenId, tokenTo);
+    if (!pool) {
+        return Res::Err("can't find the poolpair!");
+    }
+    Quote quote{{pool->id}, {}};
+    auto res = Swap(*pool, in, maxPrice, quote.out);
+    if (!res.ok) {
+        return res;
+    }
+    return {quote, Res::Ok()};
+}
+
+ResVal<CPoolGraph::Quote> CPoolGraph::QuoteBest(CTokenAmount const & in, DCT_ID const & tokenTo, size_t maxHops) const
+{
+    if (in.nTokenId == tokenTo) {
+        return Res::Err("tokens are the same");
+    }
+    // intermediate hops have no price limit, as the route itself is chosen by the result
+    PoolPrice const noLimit{std::numeric_limits<CAmount>::max(), 0};
+
+    boost::optional<Quote> best;
+    Quote route;
+    std::vector<DCT_ID> visited{in.nTokenId};
+
+    // depth-first over the simple routes, every hop is swapped on a copy of its pool
+    std::function<void(CTokenAmount const &)> step = [&] (CTokenAmount const & amount) {
+        auto it = tokenPools.find(amount.nTokenId);
+        if (it == tokenPools.end()) {
+            return;
+        }
+        for (auto idx : it->second) {
+            auto const & pool = pools[idx];
+            auto const next = pool.pool.idTokenA == amount.nTokenId ? pool.pool.idTokenB : pool.pool.idTokenA;
+            if (std::find(visited.begin(), visited.end(), next) != visited.end()) {
+                continue;
+            }
+            CTokenAmount out{};
+            if (!Swap(pool, amount, noLimit, out).ok || out.nValue <= 0) {
+                continue;
+            }
+            route.poolIds.push_back(pool.id);
+            if (next == tokenTo) {
+                if (!best || out.nValue > best->out.nValue || (out.nValue == best->out.nValue && route.poolIds.size() < best->poolIds.size())) {
+                    best = Quote{route.poolIds, out};
+                }
+            } else if (route.poolIds.size() < maxHops) {
+                visited.push_back(next);
+                step(out);
+                visited.pop_back();
+            }
+            route.poolIds.pop_back();
+        }
+    };
+    step(in);
+
+    if (!best) {
+        return Res::Err("no route from %s to %s", in.nTokenId.ToString(), tokenTo.ToString());
+    }
+    return {*best, Res::Ok()};
+}
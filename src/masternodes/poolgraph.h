@@ -0,0 +1,58 @@
+// Copyright (c) 2020 DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEFI_MASTERNODES_POOLGRAPH_H
+#define DEFI_MASTERNODES_POOLGRAPH_H
+
+#include <masternodes/poolpairs.h>
+#include <masternodes/res.h>
+
+#include <map>
+#include <vector>
+
+/// Immutable in-memory copy of all the pools at some block: tokens are the vertices, pools are the edges.
+/// Quotes are computed by CPoolPair::Swap on copies of the pools, so they are exactly what the poolswap tx would get.
+class CPoolGraph
+{
+public:
+    /// Default max pools in the route of QuoteBest
+    static const size_t DEFAULT_MAX_HOPS = 3;
+
+    struct Pool {
+        DCT_ID id;
+        CPoolPair pool;
+    };
+
+    struct Quote {
+        std::vector<DCT_ID> poolIds; // route
+        CTokenAmount out;
+    };
+
+    // 'height' is the height of the block the pools were read at, quotes are made for the next one
+    CPoolGraph(CPoolPairView & view, int height, bool postBayfrontGardens);
+
+    // the graph is kept by the blocks which don't change pools, so the tip may be higher
+    int GetHeight() const { return height; }
+    bool IsPostBayfrontGardens() const { return postBayfrontGardens; }
+    std::vector<Pool> const & GetPools() const { return pools; }
+
+    Pool const * GetPool(DCT_ID const & poolId) const;
+    // pool of the pair, the tokens may be given in any order
+    Pool const * GetPool(DCT_ID const & tokenA, DCT_ID const & tokenB) const;
+
+    // swap through the pool of the pair, the same as the poolswap tx
+    ResVal<Quote> QuoteDirect(CTokenAmount const & in, DCT_ID const & tokenTo, PoolPrice const & maxPrice) const;
+    // the route of at most 'maxHops' pools which gives the most of 'tokenTo', the shortest one among equal
+    ResVal<Quote> QuoteBest(CTokenAmount const & in, DCT_ID const & tokenTo, size_t maxHops = DEFAULT_MAX_HOPS) const;
+
+private:
+    Res Swap(Pool const & pool, CTokenAmount const & in, PoolPrice const & maxPrice, CTokenAmount & out) const;
+
+    int height;
+    bool postBayfrontGardens;
+    std::vector<Pool> pools;                          // sorted by id
+    std::map<DCT_ID, std::vector<size_t>> tokenPools; // token -> indexes of its pools
+};
+
+#endif //DEFI_MASTERNODES_POOLGRAPH_H
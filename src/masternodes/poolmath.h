@@ -0,0 +1,81 @@
+// Copyright (c) 2020 DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEFI_MASTERNODES_POOLMATH_H
+#define DEFI_MASTERNODES_POOLMATH_H
+
+#include <arith_uint256.h>
+
+#include <stdint.h>
+
+/// Fixed-precision kernel of the pool math.
+/// Every operand is a 64-bit amount, so any product of two of them (plus a 64-bit addend) fits into 128 bits
+/// and the native type gives exactly the same results as the former arith_uint256 expressions,
+/// including the GetLow64() truncation. Platforms without __int128 fall back to arith_uint256 itself.
+namespace PoolMath {
+
+#ifdef __SIZEOF_INT128__
+using CWideAmount = unsigned __int128;
+
+inline uint64_t Low64(CWideAmount v) {
+    return static_cast<uint64_t>(v);
+}
+
+inline CWideAmount Div(CWideAmount a, CWideAmount b) {
+    if (b == 0) // the same as arith_uint256 does
+        throw uint_error("Division by zero");
+    return a / b;
+}
+
+// floor of the square root, the same digit-by-digit algorithm as arith_uint256::sqrt()
+inline CWideAmount Sqrt(CWideAmount num) {
+    CWideAmount res = 0;
+    CWideAmount bit = CWideAmount(1) << 126;
+    while (bit > num)
+        bit >>= 2;
+
+    while (bit != 0) {
+        if (num >= res + bit) {
+            num -= res + bit;
+            res = (res >> 1) + bit;
+        } else
+            res >>= 1;
+        bit >>= 2;
+    }
+    return res;
+}
+#else
+using CWideAmount = arith_uint256;
+
+inline uint64_t Low64(CWideAmount const & v) {
+    return v.GetLow64();
+}
+
+inline CWideAmount Div(CWideAmount const & a, CWideAmount const & b) {
+    return a / b;
+}
+
+inline CWideAmount Sqrt(CWideAmount const & num) {
+    return num.sqrt();
+}
+#endif
+
+// amounts are taken as uint64_t, like arith_uint256(CAmount) does
+inline CWideAmount Wide(uint64_t v) {
+    return CWideAmount(v);
+}
+
+// a * b / c, truncated to 64 bits
+inline uint64_t MulDiv(uint64_t a, uint64_t b, uint64_t c) {
+    return Low64(Div(Wide(a) * Wide(b), Wide(c)));
+}
+
+// floor(sqrt(a * b)), truncated to 64 bits
+inline uint64_t SqrtMul(uint64_t a, uint64_t b) {
+    return Low64(Sqrt(Wide(a) * Wide(b)));
+}
+
+} // namespace PoolMath
+
+#endif //DEFI_MASTERNODES_POOLMATH_H
@@ -2,14 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include <arith_uint256.h>
 #include <masternodes/poolpairs.h>
 #include <core_io.h>
 #include <primitives/transaction.h>
 
 const unsigned char CPoolPairView::ByID          ::prefix = 'i';
 const unsigned char CPoolPairView::ByPair        ::prefix = 'j';
-const unsigned char CPoolPairView::ByShare       ::prefix = 'k';
+const unsigned char CPoolPairView::ByShare       ::prefix = 'K';
 
 Res CPoolPairView::SetPoolPair(DCT_ID const & poolId, CPoolPair const & pool)
 {
@@ -114,19 +113,17 @@ Res CPoolPair::Swap(CTokenAmount in, PoolPrice const & maxPrice, std::function<R
     if (reserveA < SLOPE_SWAP_RATE || reserveB < SLOPE_SWAP_RATE)
         return Res::Err("Lack of liquidity.");
 
-    auto const aReserveA = arith_uint256(reserveA);
-    auto const aReserveB = arith_uint256(reserveB);
-
-    arith_uint256 maxPrice256 = arith_uint256(maxPrice.integer) * PRECISION + maxPrice.fraction;
-    arith_uint256 priceAB = (aReserveA * PRECISION / aReserveB);
-    arith_uint256 priceBA = (aReserveB * PRECISION / aReserveA);
-    arith_uint256 curPrice = forward ? priceBA : priceAB;
-    if (curPrice > maxPrice256)
+    using namespace PoolMath;
+    CWideAmount const maxPrice128 = Wide(maxPrice.integer) * PRECISION + Wide(maxPrice.fraction);
+    CWideAmount const priceAB = Div(Wide(reserveA) * PRECISION, Wide(reserveB));
+    CWideAmount const priceBA = Div(Wide(reserveB) * PRECISION, Wide(reserveA));
+    CWideAmount const curPrice = forward ? priceBA : priceAB;
+    if (curPrice > maxPrice128)
         return Res::Err("Price is higher than indicated.");
 
     // claim trading fee
     if (commission) {
-        CAmount const tradeFee = (arith_uint256(in.nValue) * arith_uint256(commission) / arith_uint256(COIN)).GetLow64(); /// @todo check overflow (COIN vs PRECISION cause commission was normalized to COIN)
+        CAmount const tradeFee = MulDiv(in.nValue, commission, COIN); /// @todo check overflow (COIN vs PRECISION cause commission was normalized to COIN)
         in.nValue -= tradeFee;
         if (forward) {
             blockCommissionA += tradeFee;
@@ -154,33 +151,33 @@ CAmount CPoolPair::slopeSwap(CAmount unswapped, CAmount &poolFrom, CAmount &pool
     assert (unswapped >= 0);
     assert (SafeAdd(unswapped, poolFrom).ok);
 
-    arith_uint256 poolF = arith_uint256(poolFrom);
-    arith_uint256 poolT = arith_uint256(poolTo);
-   
-    arith_uint256 swapped = 0;
+    // both reserves stay within CAmount during the whole swap ('poolF' is bounded by the assert above, 'poolT' only decreases),
+    // so only the products need 128 bits
+    uint64_t poolF = poolFrom;
+    uint64_t poolT = poolTo;
+
+    uint64_t swapped = 0;
     if (!postBayfrontGardens) {
+        // the legacy swap slides by 0.1% chunks and floors every step, so it has no exact closed form;
+        // each step is a single native 128-by-64 bit division instead of the bignum one
         CAmount chunk = poolFrom/SLOPE_SWAP_RATE < unswapped ? poolFrom/SLOPE_SWAP_RATE : unswapped;
         while (unswapped > 0) {
-            //arith_uint256 stepFrom = std::min(poolFrom/1000, unswapped); // 0.1%
             CAmount stepFrom = std::min(chunk, unswapped);
-            arith_uint256 stepFrom256(stepFrom);
-            arith_uint256 stepTo = poolT * stepFrom256 / poolF;
-            poolF += stepFrom256;
+            uint64_t stepTo = PoolMath::MulDiv(poolT, stepFrom, poolF);
+            poolF += stepFrom;
             poolT -= stepTo;
             unswapped -= stepFrom;
             swapped += stepTo;
         }
     } else {
-        arith_uint256 unswappedA = arith_uint256(unswapped);
-
-        swapped = poolT - (poolT * poolF / (poolF + unswappedA));
-        poolF += unswappedA;
+        swapped = poolT - PoolMath::MulDiv(poolT, poolF, poolF + unswapped);
+        poolF += unswapped;
         poolT -= swapped;
     }
 
-    poolFrom = poolF.GetLow64();
-    poolTo = poolT.GetLow64();
-    return swapped.GetLow64();
+    poolFrom = poolF;
+    poolTo = poolT;
+    return swapped;
 }
 
 void CPoolPairView::ForEachPoolPair(std::function<bool(const DCT_ID &, const CPoolPair &)> callback, DCT_ID const & start) {
@@ -194,7 +191,39 @@ void CPoolPairView::ForEachPoolPair(std::function<bool(const DCT_ID &, const CPo
 
 void CPoolPairView::ForEachPoolShare(std::function<bool (DCT_ID const & id, CScript const & provider)> callback, const PoolShareKey &startKey) const
 {
-    ForEach<ByShare, PoolShareKey, char>([&callback] (PoolShareKey const & poolShareKey, const char &) {
-        return callback(poolShareKey.poolID, poolShareKey.owner);
-    }, startKey);
+    auto& self = const_cast<CPoolPairView&>(*this);
+    auto it = self.DB().NewIterator();
+    it->Seek(MakeIdOwnerKey(ByShare::prefix, startKey.poolID.v, startKey.owner.empty() ? OwnerID() : GetOwnerID(startKey.owner)));
+
+    OwnerResolver resolve(*this);
+    OwnerID id;
+    DCT_ID poolID;
+    for (; it->Valid(); it->Next()) {
+        boost::this_thread::interruption_point();
+
+        auto keySpan = it->KeySpan();
+        if (keySpan[0] != ByShare::prefix) {
+            break;
+        }
+        auto const owner = ParseIdOwnerKey(keySpan, poolID.v, id) ? resolve(id) : nullptr;
+        if (!owner) {
+            continue; // not interned owner, can't happen with consistent db
+        }
+        if (!callback(poolID, *owner)) {
+            break;
+        }
+    }
+}
+
+CPoolPairView::PoolShares CPoolPairView::GetPoolShares(DCT_ID const & poolId, std::function<CTokenAmount(CScript const & owner, DCT_ID tokenID)> onGetBalance) const
+{
+    PoolShares shares;
+    ForEachPoolShare([&] (DCT_ID const & currentId, CScript const & provider) {
+        if (currentId != poolId) {
+            return false; // stop
+        }
+        shares.emplace_back(provider, onGetBalance(provider, poolId).nValue);
+        return true;
+    }, PoolShareKey{poolId, CScript{}});
+    return shares;
 }
@@ -8,12 +8,13 @@
 #include <flushablestorage.h>
 
 #include <amount.h>
-#include <arith_uint256.h>
+#include <masternodes/poolmath.h>
 #include <masternodes/res.h>
 #include <script/script.h>
 #include <serialize.h>
 #include <uint256.h>
 #include <masternodes/balances.h>
+#include <masternodes/owners.h>
 
 struct ByPairKey {
     DCT_ID idTokenA;
@@ -120,15 +121,15 @@ public:
 
         CAmount liquidity{0};
         if (totalLiquidity == 0) {
-            liquidity = (CAmount) (arith_uint256(amountA) * arith_uint256(amountB)).sqrt().GetLow64(); // sure this is below std::numeric_limits<CAmount>::max() due to sqrt natue
+            liquidity = (CAmount) PoolMath::SqrtMul(amountA, amountB); // sure this is below std::numeric_limits<CAmount>::max() due to sqrt natue
             if (liquidity <= MINIMUM_LIQUIDITY) // ensure that it'll be non-zero
                 return Res::Err("liquidity too low");
             liquidity -= MINIMUM_LIQUIDITY;
             // MINIMUM_LIQUIDITY is a hack for non-zero division
             totalLiquidity = MINIMUM_LIQUIDITY;
         } else {
-            CAmount liqA = (arith_uint256(amountA) * arith_uint256(totalLiquidity) / reserveA).GetLow64();
-            CAmount liqB = (arith_uint256(amountB) * arith_uint256(totalLiquidity) / reserveB).GetLow64();
+            CAmount liqA = PoolMath::MulDiv(amountA, totalLiquidity, reserveA);
+            CAmount liqB = PoolMath::MulDiv(amountB, totalLiquidity, reserveB);
             liquidity = std::min(liqA, liqB);
 
             if (liquidity == 0)
@@ -169,8 +170,8 @@ public:
         }
 
         CAmount resAmountA, resAmountB;
-        resAmountA = (arith_uint256(liqAmount) * arith_uint256(reserveA) / totalLiquidity).GetLow64();
-        resAmountB = (arith_uint256(liqAmount) * arith_uint256(reserveB) / totalLiquidity).GetLow64();
+        resAmountA = PoolMath::MulDiv(liqAmount, reserveA, totalLiquidity);
+        resAmountB = PoolMath::MulDiv(liqAmount, reserveB, totalLiquidity);
 
         reserveA -= resAmountA; // safe due to previous math
         reserveB -= resAmountB;
@@ -231,7 +232,7 @@ struct PoolShareKey {
 };
 
 
-class CPoolPairView : public virtual CStorageView
+class CPoolPairView : public virtual COwnersView
 {
 public:
     Res SetPoolPair(const DCT_ID &poolId, CPoolPair const & pool);
@@ -245,14 +246,21 @@ public:
     void ForEachPoolShare(std::function<bool(DCT_ID const & id, CScript const & provider)> callback, PoolShareKey const &startKey = PoolShareKey{0,CScript{}}) const;
 
     Res SetShare(DCT_ID const & poolId, CScript const & provider) {
-        WriteBy<ByShare>(PoolShareKey{ poolId, provider}, '\0');
+        DB().Write(MakeIdOwnerKey(ByShare::prefix, poolId.v, InternOwner(provider)), TBytes{'\0'});
         return Res::Ok();
     }
     Res DelShare(DCT_ID const & poolId, CScript const & provider) {
-        EraseBy<ByShare>(PoolShareKey{poolId, provider});
+        auto const key = MakeIdOwnerKey(ByShare::prefix, poolId.v, GetOwnerID(provider));
+        if (DB().Exists(key)) {
+            DB().Erase(key);
+        }
         return Res::Ok();
     }
 
+    /// provider -> LP token balance, collected in a single pass over pool's 'ByShare' records
+    using PoolShares = std::vector<std::pair<CScript, CAmount>>;
+    PoolShares GetPoolShares(DCT_ID const & poolId, std::function<CTokenAmount(CScript const & owner, DCT_ID tokenID)> onGetBalance) const;
+
     /// @attention it throws (at least for debug), cause errors are critical!
     CAmount DistributeRewards(CAmount yieldFarming, std::function<CTokenAmount(CScript const & owner, DCT_ID tokenID)> onGetBalance, std::function<Res(CScript const & to, CTokenAmount amount)> onTransfer, bool newRewardCalc = false) {
 
@@ -266,16 +274,27 @@ public:
             CAmount distributedFeeA = 0;
             CAmount distributedFeeB = 0;
 
-            
             if (pool.totalLiquidity == 0 || (!pool.swapEvent && poolReward == 0)) {
                 return true; // no events, skip to the next pool
             }
 
-            ForEachPoolShare([&] (DCT_ID const & currentId, CScript const & provider) {
-                if (currentId != poolId) {
-                    return false; // stop
+            // payouts are accumulated per provider and applied as one sorted batch after the whole pool was calculated.
+            // it is safe, cause rewards are paid in tokenA, tokenB and DFI, but never in the pool's own LP token,
+            // so shares of the current pool can't be affected by its own payouts (the batch is applied before the next pool).
+            CAccounts payouts;
+            auto addPayout = [&payouts] (CScript const & provider, CTokenAmount amount) {
+                if (amount.nValue == 0) {
+                    return;
                 }
-                CAmount const liquidity = onGetBalance(provider, poolId).nValue;
+                auto res = payouts[provider].Add(amount);
+                if (!res.ok) {
+                    throw std::runtime_error(strprintf("Pool rewards: can't accumulate %s for %s: %s", amount.ToString(), provider.GetHex(), res.msg));
+                }
+            };
+
+            for (auto const & share : GetPoolShares(poolId, onGetBalance)) {
+                CScript const & provider = share.first;
+                CAmount const liquidity = share.second;
 
                 uint32_t const liqWeight = liquidity * PRECISION / pool.totalLiquidity;
                 assert (liqWeight < PRECISION);
@@ -287,14 +306,14 @@ public:
                         feeA = pool.blockCommissionA * liqWeight / PRECISION;
                     }
                     distributedFeeA += feeA;
-                    onTransfer(provider, {pool.idTokenA, feeA}); //can throw
+                    addPayout(provider, {pool.idTokenA, feeA});
 
                     CAmount feeB = pool.blockCommissionB * liquidity / pool.totalLiquidity;
                     if (!newRewardCalc) {
                         feeB = pool.blockCommissionB * liqWeight / PRECISION;
                     }
                     distributedFeeB += feeB;
-                    onTransfer(provider, {pool.idTokenB, feeB}); //can throw
+                    addPayout(provider, {pool.idTokenB, feeB});
                 }
 
                 // distribute yield farming
@@ -304,12 +323,17 @@ public:
                         providerReward = poolReward * liqWeight / PRECISION;
                     }
                     if (providerReward) {
-                        onTransfer(provider, {DCT_ID{0}, providerReward}); //can throw
+                        addPayout(provider, {DCT_ID{0}, providerReward});
                         totalDistributed += providerReward;
                     }
                 }
-                return true;
-            }, PoolShareKey{poolId, CScript{}});
+            }
+
+            for (auto const & payout : payouts) {
+                for (auto const & balance : payout.second.balances) {
+                    onTransfer(payout.first, {balance.first, balance.second}); //can throw
+                }
+            }
 
             // we have no "non-const foreaches", but it is safe here cause not broke indexes, so:
             const_cast<CPoolPair &>(pool).blockCommissionA -= distributedFeeA;
@@ -328,7 +352,7 @@ public:
     // tags
     struct ByID { static const unsigned char prefix; }; // lsTokenID -> СPoolPair
     struct ByPair { static const unsigned char prefix; }; // tokenA+tokenB -> lsTokenID
-    struct ByShare { static const unsigned char prefix; }; // lsTokenID+accountID -> {}
+    struct ByShare { static const unsigned char prefix; }; // compact id key (lsTokenID, owner id) -> {}
 };
 
 struct CLiquidityMessage {
@@ -0,0 +1,140 @@
+// Copyright (c) 2020 DeFi Blockchain Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEFI_MASTERNODES_SHAREDBUCKETS_H
+#define DEFI_MASTERNODES_SHAREDBUCKETS_H
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// Bucket of hash keys (uint256, uint160): their first byte, so the buckets go in the order of the keys.
+/// Buckets of other keys are given the same way, taken modulo the buckets count
+struct FirstByteBucket {
+    template<typename Key>
+    size_t operator()(Key const & key) const { return *key.begin(); }
+};
+
+/// Immutable map of the keys spread over the fixed number of sorted buckets.
+/// Copies share all the buckets, Update() makes a map which shares all but the changed ones,
+/// so the cost of a change is the size of its bucket, not of the whole map.
+template<typename Key, typename Value, typename BucketOf = FirstByteBucket>
+class CSharedBuckets
+{
+public:
+    static const size_t COUNT = 256;
+    using Item = std::pair<Key, Value>;
+    using Change = std::pair<Key, boost::optional<Value>>; // none erases the key
+
+    CSharedBuckets() : buckets(std::make_shared<const Buckets>()), size(0) {}
+
+    explicit CSharedBuckets(std::vector<Item> items) : size(items.size())
+    {
+        Buckets all;
+        std::vector<Bucket> filled(COUNT);
+        for (auto & item : items) {
+            filled[BucketIndex(item.first)].push_back(std::move(item));
+        }
+        for (size_t i = 0; i < COUNT; ++i) {
+            if (!filled[i].empty()) {
+                std::sort(filled[i].begin(), filled[i].end(), Less);
+                all[i] = std::make_shared<const Bucket>(std::move(filled[i]));
+            }
+        }
+        buckets = std::make_shared<const Buckets>(std::move(all));
+    }
+
+    // the map with the changes applied, later changes of the same key win
+    CSharedBuckets Update(std::vector<Change> const & changes) const
+    {
+        CSharedBuckets result(*this);
+        if (changes.empty()) {
+            return result;
+        }
+        auto updated = *buckets;
+        std::vector<Bucket> copies(COUNT);
+        std::vector<bool> copied(COUNT, false);
+        for (auto const & change : changes) {
+            auto const idx = BucketIndex(change.first);
+            auto & bucket = copies[idx];
+            if (!copied[idx]) {
+                copied[idx] = true;
+                if (updated[idx]) {
+                    bucket = *updated[idx];
+                }
+            }
+            auto it = std::lower_bound(bucket.begin(), bucket.end(), change.first, KeyLess);
+            bool const exists = it != bucket.end() && !(change.first < it->first);
+            if (!change.second) {
+                if (exists) {
+                    bucket.erase(it);
+                    --result.size;
+                }
+            } else if (exists) {
+                it->second = *change.second;
+            } else {
+                bucket.insert(it, {change.first, *change.second});
+                ++result.size;
+            }
+        }
+        for (size_t i = 0; i < COUNT; ++i) {
+            if (copied[i]) {
+                updated[i] = copies[i].empty() ? nullptr : std::make_shared<const Bucket>(std::move(copies[i]));
+            }
+        }
+        result.buckets = std::make_shared<const Buckets>(std::move(updated));
+        return result;
+    }
+
+    size_t Size() const { return size; }
+
+    Value const * Get(Key const & key) const
+    {
+        auto const & bucket = (*buckets)[BucketIndex(key)];
+        if (!bucket) {
+            return nullptr;
+        }
+        auto it = std::lower_bound(bucket->begin(), bucket->end(), key, KeyLess);
+        return it != bucket->end() && !(key < it->first) ? &it->second : nullptr;
+    }
+
+    // from 'start' in the order of the buckets, then of the keys in every bucket
+    void ForEach(std::function<bool(Key const &, Value const &)> callback, Key const & start = Key()) const
+    {
+        auto const first = BucketIndex(start);
+        for (size_t i = first; i < COUNT; ++i) {
+            auto const & bucket = (*buckets)[i];
+            if (!bucket) {
+                continue;
+            }
+            auto it = i == first ? std::lower_bound(bucket->begin(), bucket->end(), start, KeyLess) : bucket->begin();
+            for (; it != bucket->end(); ++it) {
+                if (!callback(it->first, it->second)) {
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    using Bucket = std::vector<Item>;
+    using Buckets = std::array<std::shared_ptr<const Bucket>, COUNT>; // null for the empty ones
+
+    static size_t BucketIndex(Key const & key) { return BucketOf()(key) % COUNT; }
+    static bool Less(Item const & a, Item const & b) { return a.first < b.first; }
+    static bool KeyLess(Item const & item, Key const & key) { return item.first < key; }
+
+    std::shared_ptr<const Buckets> buckets;
+    size_t size;
+};
+
+template<typename Key, typename Value, typename BucketOf>
+const size_t CSharedBuckets<Key, Value, BucketOf>::COUNT;
+
+#endif //DEFI_MASTERNODES_SHAREDBUCKETS_H
@@ -6,6 +6,8 @@
 #include <core_io.h>
 #include <primitives/transaction.h>
 
+#include <algorithm>
+
 /// @attention make sure that it does not overlap with other views !!!
 const unsigned char CTokensView::ID          ::prefix = 'T';
 const unsigned char CTokensView::Symbol      ::prefix = 'S';
@@ -101,6 +103,17 @@ void CTokensView::ForEachToken(std::function<bool (const DCT_ID &, const CTokenI
 
 }
 
+bool CTokensView::AreTokensChanged(MapKV const & diff)
+{
+    for (auto prefix : {ID::prefix, Symbol::prefix, CreationTx::prefix}) {
+        auto it = diff.lower_bound({prefix});
+        if (it != diff.end() && it->first.at(0) == prefix) {
+            return true;
+        }
+    }
+    return false;
+}
+
 Res CTokensView::CreateDFIToken()
 {
     CTokenImpl token;
@@ -316,3 +329,62 @@ boost::optional<DCT_ID> CTokensView::ReadLastDctId() const
 }
 
 
+
+CTokensTable::CTokensTable(CTokensView & view, uint64_t version_)
+    : version(version_)
+{
+    view.ForEachToken([&] (DCT_ID const & id, CTokenImplementation const & token) {
+        entries.push_back({id, token});
+        return true;
+    });
+
+    // ids are dense: DATs are below DCT_ID_START, the rest are allocated one by one after it.
+    // keys are varints, their byte order matches the ids order only below 16512, so the last entry isn't the max one
+    auto const maxId = std::max_element(entries.begin(), entries.end(), [] (Entry const & a, Entry const & b) {
+        return a.id < b.id;
+    });
+    byId.assign(maxId == entries.end() ? 0 : maxId->id.v + 1, -1);
+    bySymbol.reserve(entries.size());
+    byCreationTx.reserve(entries.size());
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        auto const & entry = entries[i];
+        byId[entry.id.v] = i;
+        bySymbol.emplace(entry.token.CreateSymbolKey(entry.id), i);
+        byCreationTx.emplace(entry.token.creationTx, i);
+    }
+}
+
+CTokensTable::Entry const * CTokensTable::Get(DCT_ID const & id) const
+{
+    return id.v < byId.size() && byId[id.v] >= 0 ? &entries[byId[id.v]] : nullptr;
+}
+
+CTokensTable::Entry const * CTokensTable::Get(std::string const & symbolKey) const
+{
+    auto it = bySymbol.find(symbolKey);
+    return it != bySymbol.end() ? &entries[it->second] : nullptr;
+}
+
+CTokensTable::Entry const * CTokensTable::GetByCreationTx(uint256 const & txid) const
+{
+    auto it = byCreationTx.find(txid);
+    return it != byCreationTx.end() ? &entries[it->second] : nullptr;
+}
+
+CTokensTable::Entry const * CTokensTable::GetGuessId(std::string const & str) const
+{
+    std::string const key = trim_ws(str);
+
+    if (key.empty()) {
+        return Get(DCT_ID{0});
+    }
+    DCT_ID id;
+    if (ParseUInt32(key, &id.v)) {
+        return Get(id);
+    }
+    uint256 tx;
+    if (ParseHashStr(key, tx)) {
+        return GetByCreationTx(tx);
+    }
+    return Get(key);
+}
@@ -8,11 +8,15 @@
 #include <flushablestorage.h>
 
 #include <amount.h>
+#include <crypto/common.h>
 #include <masternodes/res.h>
 #include <script/script.h>
 #include <serialize.h>
 #include <uint256.h>
 
+#include <unordered_map>
+#include <vector>
+
 class CTransaction;
 
 std::string trim_ws(std::string const & str);
@@ -143,6 +147,9 @@ public:
 
     void ForEachToken(std::function<bool(DCT_ID const & id, CTokenImpl const & token)> callback, DCT_ID const & start = DCT_ID{0});
 
+    // true if 'diff' (changes of a view) touches any token record
+    static bool AreTokensChanged(MapKV const & diff);
+
     Res CreateDFIToken();
     ResVal<DCT_ID> CreateToken(CTokenImpl const & token, bool isPreBayfront);
     bool RevertCreateToken(uint256 const & txid);   /// @deprecated used only by tests. rewrite tests
@@ -164,6 +171,43 @@ private:
     boost::optional<DCT_ID> ReadLastDctId() const;
 };
 
+/// Immutable decoded copy of all the tokens of some state, shared by its readers without any locks.
+/// Lookups return references into the table, so they neither read the db nor allocate.
+class CTokensTable
+{
+public:
+    struct Entry {
+        DCT_ID id;
+        CTokenImplementation token;
+    };
+
+    // 'version' identifies the set of tokens, tables of the same version are equal
+    CTokensTable(CTokensView & view, uint64_t version);
+
+    uint64_t GetVersion() const { return version; }
+    // in the order of the db keys: ids are varints there, so it isn't the order of ids from 16512
+    std::vector<Entry> const & GetTokens() const { return entries; }
+
+    // all of them return nullptr if there is no such token
+    Entry const * Get(DCT_ID const & id) const;
+    // by the symbol key, see CToken::CreateSymbolKey
+    Entry const * Get(std::string const & symbolKey) const;
+    Entry const * GetByCreationTx(uint256 const & txid) const;
+    // the same lookup as CTokensView::GetTokenGuessId
+    Entry const * GetGuessId(std::string const & str) const;
+
+private:
+    struct TxHasher {
+        size_t operator()(uint256 const & hash) const { return ReadLE64(hash.begin()); }
+    };
+
+    uint64_t version;
+    std::vector<Entry> entries;
+    std::vector<int32_t> byId; // id -> index of the entry, -1 if there is no token with this id
+    std::unordered_map<std::string, uint32_t> bySymbol;
+    std::unordered_map<uint256, uint32_t, TxHasher> byCreationTx;
+};
+
 
 
 #endif // DEFI_MASTERNODES_TOKENS_H
@@ -11,6 +11,8 @@
 #include <serialize.h>
 #include <serialize_optional.h>
 #include <flushablestorage.h>
+#include <masternodes/owners.h>
+#include <streams.h>
 
 struct UndoKey {
     uint32_t height; // height is there to be able to prune older undos using lexicographic iteration
@@ -25,6 +27,12 @@ struct UndoKey {
     }
 };
 
+// interned owners are never erased: records reverted by the block disconnect refer to them by ids,
+// which have to stay resolvable (AccountBalancesChanged of the disconnected block)
+inline bool IsRevertibleKey(TBytes const & key) {
+    return key.empty() || key[0] != COwnersView::ByOwnerID::prefix;
+}
+
 struct CUndo {
     std::map<TBytes, boost::optional<TBytes>> before;
 
@@ -32,6 +40,9 @@ struct CUndo {
         CUndo result;
         for (const auto & kv : diff) {
             const auto& beforeKey = kv.first;
+            if (!IsRevertibleKey(beforeKey)) {
+                continue;
+            }
             TBytes beforeVal;
             if (before.Read(beforeKey, beforeVal)) {
                 result.before[beforeKey] = std::move(beforeVal);
@@ -44,6 +55,9 @@ struct CUndo {
 
     static void Revert(CStorageKV & after, CUndo const & undo) {
         for (const auto & kv : undo.before) {
+            if (!IsRevertibleKey(kv.first)) {
+                continue; // undos written before interned owners were kept out of them
+            }
             if (kv.second) {
                 after.Write(kv.first, *kv.second);
             } else {
@@ -60,5 +74,42 @@ struct CUndo {
     }
 };
 
+// Serializes the undo of the diff right into the reused buffer, the same bytes as CUndo::Construct(before, diff) would give
+class CUndoBuilder {
+public:
+    // false if there is nothing to undo
+    bool Construct(CStorageKV const & before, MapKV const & diff) {
+        bytes.clear();
+        size_t interned = 0;
+        auto const prefix = COwnersView::ByOwnerID::prefix;
+        for (auto it = diff.lower_bound({prefix}); it != diff.end() && it->first.at(0) == prefix; ++it) {
+            ++interned;
+        }
+        if (diff.size() == interned) {
+            return false;
+        }
+        CVectorWriter writer(SER_DISK, CLIENT_VERSION, bytes, 0);
+        WriteCompactSize(writer, diff.size() - interned);
+        for (const auto & kv : diff) {
+            if (!IsRevertibleKey(kv.first)) {
+                continue;
+            }
+            writer << kv.first;
+            if (before.Read(kv.first, beforeVal)) {
+                writer << uint8_t{1} << beforeVal;
+            } else {
+                writer << uint8_t{0};
+            }
+        }
+        return true;
+    }
+
+    TBytes const & GetBytes() const { return bytes; }
+
+private:
+    TBytes bytes;
+    TBytes beforeVal;
+};
+
 
 #endif //DEFI_MASTERNODES_UNDO_H
@@ -6,6 +6,7 @@
 
 /// @attention make sure that it does not overlap with those in masternodes.cpp/tokens.cpp/undos.cpp/accounts.cpp !!!
 const unsigned char CUndosView::ByUndoKey::prefix = 'u';
+const unsigned char CUndosView::ByPrunedHeight::prefix = 'U';
 
 void CUndosView::ForEachUndo(std::function<bool(UndoKey key, CUndo const & Undo)> callback, UndoKey start) const
 {
@@ -20,6 +21,12 @@ Res CUndosView::SetUndo(UndoKey key, CUndo const & undo)
     return Res::Ok();
 }
 
+Res CUndosView::SetUndo(UndoKey key, TBytes const & undo)
+{
+    DB().Write(DbTypeToBytes(std::make_pair(ByUndoKey::prefix, key)), undo);
+    return Res::Ok();
+}
+
 Res CUndosView::DelUndo(UndoKey key)
 {
     EraseBy<ByUndoKey>(key);
@@ -35,3 +42,56 @@ boost::optional<CUndo> CUndosView::GetUndo(UndoKey key) const
     }
     return {};
 }
+
+uint32_t CUndosView::GetUndosPrunedHeight() const
+{
+    uint32_t height = 0;
+    Read(ByPrunedHeight::prefix, height);
+    return height;
+}
+
+Res CUndosView::PruneUndos(uint32_t height, size_t limit, uint64_t & records, uint64_t & bytes)
+{
+    records = bytes = 0;
+    uint32_t prunedHeight = GetUndosPrunedHeight();
+    if (height <= prunedHeight) {
+        return Res::Ok();
+    }
+
+    // collect raw keys first, then erase them as a single batch in this view
+    std::vector<TBytes> keys;
+    uint32_t lastHeight = prunedHeight;
+    auto key = std::make_pair(ByUndoKey::prefix, UndoKey{prunedHeight, uint256()});
+    auto it = DB().NewIterator();
+    for (it->Seek(DbTypeToBytes(key)); it->Valid(); it->Next()) {
+        auto keySpan = it->KeySpan();
+        if (keySpan[0] != ByUndoKey::prefix) {
+            break;
+        }
+        BytesToDbType(keySpan, key);
+        if (key.second.height >= height) {
+            break;
+        }
+        // undos are per tx, so the batch is cut between heights only: the blocks of the pruned height
+        // (and above) must have their undos complete, otherwise they would be disconnected partly
+        if (keys.size() >= limit && key.second.height != lastHeight) {
+            // all undos below the current one are gone, it becomes the new bound
+            height = key.second.height;
+            break;
+        }
+        lastHeight = key.second.height;
+        bytes += keySpan.size() + it->ValueSpan().size();
+        keys.emplace_back(keySpan.begin(), keySpan.end());
+    }
+    it.reset();
+
+    for (auto const & k : keys) {
+        DB().Erase(k);
+    }
+    records = keys.size();
+
+    if (height > prunedHeight) {
+        Write(ByPrunedHeight::prefix, height);
+    }
+    return Res::Ok();
+}
@@ -15,10 +15,18 @@ public:
 
     boost::optional<CUndo> GetUndo(UndoKey key) const;
     Res SetUndo(UndoKey key, CUndo const & undo);
+    // already serialized undo (see CUndoBuilder)
+    Res SetUndo(UndoKey key, TBytes const & undo);
     Res DelUndo(UndoKey key);
 
+    // all undos below this height are pruned and can't be reverted
+    uint32_t GetUndosPrunedHeight() const;
+    // erases about 'limit' undos below 'height' (whole heights only), counts erased records and their size in bytes
+    Res PruneUndos(uint32_t height, size_t limit, uint64_t & records, uint64_t & bytes);
+
     // tags
     struct ByUndoKey { static const unsigned char prefix; };
+    struct ByPrunedHeight { static const unsigned char prefix; };
 };
 
 
@@ -95,7 +95,7 @@ void BlockAssembler::resetBlock()
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CKeyID& operatorID)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -114,11 +114,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     LOCK2(cs_main, mempool.cs);
     // in fact, this may be redundant cause it was checked upthere in the miner
-    auto myIDs = pcustomcsview->AmIOperator();
+    auto const registry = GetMasternodesRegistry();
+    auto myIDs = operatorID.IsNull() ? registry->AmIOperator() : registry->AmIOperator(operatorID);
     if (!myIDs)
         return nullptr;
-    auto nodePtr = pcustomcsview->GetMasternode(myIDs->second);
-    if (!nodePtr || !nodePtr->IsActive())
+    auto entry = registry->Get(myIDs->second);
+    if (!entry || !entry->node.IsActive())
         return nullptr;
 
     CBlockIndex* pindexPrev = ::ChainActive().Tip();
@@ -156,7 +157,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (confirms.size() > 0) { // quorum or zero
 
         CAnchorFinalizationMessage finMsg{confirms[0]};
-        finMsg.nextTeam = pcustomcsview->CalcNextTeam(pindexPrev->stakeModifier);
+        finMsg.nextTeam = GetNextTeamCached(pindexPrev->stakeModifier);
         finMsg.currentTeam = currentTeam;
         for (auto const & msg : confirms) {
             finMsg.sigs.push_back(msg.signature);
@@ -226,7 +227,13 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    {
+        // custom txs are applied to the block's state as their packages get selected
+        CCustomCSView mnview(*pcustomcsview);
+        CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), mempool);
+        CCoinsViewCache coins(&viewMemPool);
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated, mnview, coins);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -339,6 +346,26 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::TestPackageCustomTxs(const std::vector<CTxMemPool::txiter>& sortedEntries, CCustomCSView& mnview, const CCoinsViewCache& coins)
+{
+    CCustomCSViewLayer packageView(mnview);
+    uint32_t txn = pblock->vtx.size();
+    for (CTxMemPool::txiter it : sortedEntries) {
+        const CTransaction& tx = it->GetTx();
+        if (customTxDecodeCache.Decode(tx)->type != CustomTxType::None) {
+            auto res = ApplyCustomTx(*packageView, coins, tx, chainparams.GetConsensus(), nHeight, txn, false);
+            if (!res.ok) {
+                LogPrint(BCLog::STAKING, "%s: skipping package of %s, custom tx %s fails: %s\n", __func__,
+                         sortedEntries.back()->GetTx().GetHash().ToString(), tx.GetHash().ToString(), res.msg);
+                return false;
+            }
+        }
+        ++txn;
+    }
+    packageView->Flush();
+    return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -421,7 +448,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, CCustomCSView& mnview, const CCoinsViewCache& coins)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -531,13 +558,21 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
-        // This transaction will make it in; reset the failed counter.
-        nConsecutiveFailed = 0;
-
         // Package can be added. Sort the entries in a valid order.
         std::vector<CTxMemPool::txiter> sortedEntries;
         SortForBlock(ancestors, sortedEntries);
 
+        if (!TestPackageCustomTxs(sortedEntries, mnview, coins)) {
+            if (fUsingModified) {
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
+
+        // This transaction will make it in; reset the failed counter.
+        nConsecutiveFailed = 0;
+
         for (size_t i=0; i<sortedEntries.size(); ++i) {
             AddToBlock(sortedEntries[i]);
             // Erase from the modified set, if present
@@ -571,7 +606,10 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 }
 
 namespace pos {
-    Staker::Status Staker::stake(CChainParams chainparams, const ThreadStaker::Args& args) {
+    CCriticalSection cs_stakerStats;
+    std::map<CKeyID, StakerStats> stakerStats;
+
+    Staker::Status Staker::stake(CChainParams chainparams, const std::vector<ThreadStaker::Args>& args) {
         if (!chainparams.GetConsensus().pos.allowMintingWithoutPeers) {
             if(!g_connman)
                 throw std::runtime_error("Error: Peer-to-peer functionality missing or disabled");
@@ -602,85 +640,168 @@ namespace pos {
 
         CBlockIndex* tip = getTip();
 
+        // lookahead of the previous tip is meaningless for the new one
+        if (tip->GetBlockHash() != lookaheadTip) {
+            lookaheadTip = tip->GetBlockHash();
+            nLastLookaheadTime = 0;
+            preparedBlock.reset();
+        }
+
         // this part of code stay valid until tip got changed
         /// @todo is 'tip' can be changed here? is it possible to pull 'getTip()' and mnview access to the upper (calling 'stake()') block?
-        uint32_t mintedBlocks(0);
-        uint256 masternodeID{};
-        CScript defaultScript;
+        struct Operator {
+            const ThreadStaker::Args* args;
+            uint256 masternodeID;
+            uint32_t mintedBlocks;
+            CScript coinbaseScript;
+            uint256 stakeModifier;
+        };
+        std::vector<Operator> operators;
         {
             LOCK(cs_main);
-            auto optMasternodeID = pcustomcsview->GetMasternodeIdByOperator(args.operatorID);
-            if (!optMasternodeID)
-            {
-                return Status::initWaiting;
-            }
-            masternodeID = *optMasternodeID;
-            auto nodePtr = pcustomcsview->GetMasternode(masternodeID);
-            if (!nodePtr || !nodePtr->IsActive(tip->height)) /// @todo miner: height+1 or nHeight+1 ???
-            {
-                /// @todo may be new status for not activated (or already resigned) MN??
-                return Status::initWaiting;
-            }
-            mintedBlocks = nodePtr->mintedBlocks;
-            if (args.coinbaseScript.empty()) {
-                // this is safe cause MN was found
-                defaultScript = GetScriptForDestination(nodePtr->ownerType == 1 ? CTxDestination(PKHash(nodePtr->ownerAuthAddress)) : CTxDestination(WitnessV0KeyHash(nodePtr->ownerAuthAddress)));
+            auto const registry = GetMasternodesRegistry();
+            for (auto const & arg : args) {
+                auto entry = registry->GetByOperator(arg.operatorID);
+                if (!entry) {
+                    continue;
+                }
+                auto const & node = entry->node;
+                if (!node.IsActive(tip->height)) /// @todo miner: height+1 or nHeight+1 ???
+                {
+                    /// @todo may be new status for not activated (or already resigned) MN??
+                    continue;
+                }
+                Operator op{&arg, entry->id, node.mintedBlocks, arg.coinbaseScript, {}};
+                if (op.coinbaseScript.empty()) {
+                    // this is safe cause MN was found
+                    op.coinbaseScript = GetScriptForDestination(node.ownerType == 1 ? CTxDestination(PKHash(node.ownerAuthAddress)) : CTxDestination(WitnessV0KeyHash(node.ownerAuthAddress)));
+                }
+                op.stakeModifier = pos::ComputeStakeModifier(tip->stakeModifier, arg.minterKey.GetPubKey().GetID());
+                operators.push_back(std::move(op));
             }
         }
+        if (operators.empty()) {
+            return Status::initWaiting;
+        }
 
         withSearchInterval([&](int64_t coinstakeTime, int64_t nSearchInterval) {
             if (fCriminals) {
-                std::map <uint256, CBlockHeader> blockHeaders{};
-                {
-                    LOCK(cs_main);
-                    pcriminals->FetchMintedHeaders(masternodeID, mintedBlocks + 1, blockHeaders, fIsFakeNet);
-                }
-                for (std::pair <uint256, CBlockHeader> const & blockHeader : blockHeaders) {
-                    if (IsDoubleSignRestricted(blockHeader.second.height, tip->nHeight + (uint64_t)1)) {
+                std::vector<Operator> allowed;
+                for (auto & op : operators) {
+                    std::map <uint256, CBlockHeader> blockHeaders{};
+                    {
+                        LOCK(cs_main);
+                        pcriminals->FetchMintedHeaders(op.masternodeID, op.mintedBlocks + 1, blockHeaders, fIsFakeNet);
+                    }
+                    bool restricted = false;
+                    for (std::pair <uint256, CBlockHeader> const & blockHeader : blockHeaders) {
+                        if (IsDoubleSignRestricted(blockHeader.second.height, tip->nHeight + (uint64_t)1)) {
+                            restricted = true;
+                            break;
+                        }
+                    }
+                    if (restricted) {
                         potentialCriminalBlock = true;
-                        return;
+                    } else {
+                        allowed.push_back(std::move(op));
                     }
                 }
+                operators.swap(allowed);
+                if (operators.empty()) {
+                    return;
+                }
             }
             //
-            // Create block template
+            // Search for the kernel first, it doesn't depend on block contents
             //
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(args.coinbaseScript.empty() ? defaultScript : args.coinbaseScript));
-            if (!pblocktemplate.get()) {
-                throw std::runtime_error("Error in WalletStaker: Keypool ran out, please call keypoolrefill before restarting the staking thread");
+            CBlockHeader header;
+            header.nTime = (uint32_t) coinstakeTime;
+            {
+                LOCK(cs_main);
+                header.nBits = pos::GetNextWorkRequired(tip, &header, chainparams.GetConsensus().pos);
             }
-            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
-
-            LogPrint(BCLog::STAKING, "Running Staker with %u common transactions in block (%u bytes)\n", pblock->vtx.size() - 1,
-                     ::GetSerializeSize(*pblock, PROTOCOL_VERSION));
 
-            // find matching Hash
-            pblock->height = tip->nHeight + 1;
-            pblock->mintedBlocks = mintedBlocks + 1;
-            pblock->stakeModifier = pos::ComputeStakeModifier(tip->stakeModifier, args.minterKey.GetPubKey().GetID());
+            // every operator is checked for each timestamp, the latest kernel wins
+            auto findKernel = [&](int64_t time) -> const Operator* {
+                for (auto const & op : operators) {
+                    if (pos::CheckKernelHash(op.stakeModifier, header.nBits, time, chainparams.GetConsensus(), op.masternodeID).hashOk) {
+                        return &op;
+                    }
+                }
+                return nullptr;
+            };
 
-            bool found = false;
-            for (uint32_t t = 0; t < nSearchInterval; t++) {
+            const Operator* winner = nullptr;
+            int64_t kernelTime = 0;
+            for (int64_t t = 0; t < nSearchInterval && !winner; t++) {
                 boost::this_thread::interruption_point();
 
-                pblock->nTime = ((uint32_t)coinstakeTime - t);
-
-                if (pos::CheckKernelHash(pblock->stakeModifier, pblock->nBits,  (int64_t) pblock->nTime, chainparams.GetConsensus(), masternodeID).hashOk) {
-                    LogPrint(BCLog::STAKING, "MakeStake: kernel found\n");
+                kernelTime = coinstakeTime - t;
+                winner = findKernel(kernelTime);
+            }
+            if (winner) {
+                LogPrint(BCLog::STAKING, "MakeStake: kernel found for operator %s\n", winner->args->operatorID.GetHex());
+                LOCK(cs_stakerStats);
+                stakerStats[winner->args->operatorID].kernelsFound++;
+            }
 
-                    found = true;
-                    break;
+            auto createBlock = [&](const Operator& op) {
+                std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(op.coinbaseScript, op.args->operatorID));
+                if (!pblocktemplate.get()) {
+                    throw std::runtime_error("Error in WalletStaker: Keypool ran out, please call keypoolrefill before restarting the staking thread");
                 }
+                auto pblock = std::make_shared<CBlock>(pblocktemplate->block);
+                LogPrint(BCLog::STAKING, "Running Staker with %u common transactions in block (%u bytes)\n", pblock->vtx.size() - 1,
+                         ::GetSerializeSize(*pblock, PROTOCOL_VERSION));
+                return pblock;
+            };
+
+            std::shared_ptr<CBlock> pblock;
+            if (preparedBlock && preparedBlock->hashPrevBlock == tip->GetBlockHash() && preparedTime + STAKER_TEMPLATE_LEAD * 2 >= coinstakeTime
+            && (!winner || winner->args->operatorID == preparedOperator)) {
+                pblock = preparedBlock;
+            }
+            preparedBlock.reset();
+
+            if (!winner) {
+                // look a few seconds ahead, to have the block assembled by the time the kernel becomes valid
+                preparedBlock = pblock;
+                for (int64_t t = std::max(coinstakeTime, nLastLookaheadTime) + 1; !preparedBlock && t <= coinstakeTime + STAKER_TEMPLATE_LEAD; t++) {
+                    boost::this_thread::interruption_point();
+
+                    if (auto op = findKernel(t)) {
+                        LogPrint(BCLog::STAKING, "MakeStake: upcoming kernel found in %d sec., preparing block\n", t - coinstakeTime);
+                        preparedBlock = createBlock(*op);
+                        preparedOperator = op->args->operatorID;
+                        preparedTime = coinstakeTime;
+                    }
+                }
+                nLastLookaheadTime = coinstakeTime + STAKER_TEMPLATE_LEAD;
+                return;
+            }
+
+            //
+            // Create block template
+            //
+            if (!pblock) {
+                pblock = createBlock(*winner);
             }
 
-            if (!found) {
+            // find matching Hash
+            pblock->height = tip->nHeight + 1;
+            pblock->mintedBlocks = winner->mintedBlocks + 1;
+            pblock->stakeModifier = winner->stakeModifier;
+            pblock->nTime = (uint32_t) kernelTime;
+
+            // template could be built with different target (min difficulty rules), recheck the kernel
+            if (pblock->nBits != header.nBits && !pos::CheckKernelHash(pblock->stakeModifier, pblock->nBits, (int64_t) pblock->nTime, chainparams.GetConsensus(), winner->masternodeID).hashOk) {
                 return;
             }
 
             //
             // Trying to sign a block
             //
-            auto err = pos::SignPosBlock(pblock, args.minterKey);
+            auto err = pos::SignPosBlock(pblock, winner->args->minterKey);
             if (err) {
                 LogPrint(BCLog::STAKING, "SignPosBlock(): %s \n", *err);
                 return;
@@ -703,12 +824,22 @@ namespace pos {
                 return;
             }
 
+            {
+                LOCK(cs_stakerStats);
+                auto & stats = stakerStats[winner->args->operatorID];
+                stats.blocksMinted++;
+                stats.lastMintedTime = kernelTime;
+            }
             minted = true;
         });
 
         return minted ? Status::minted : (potentialCriminalBlock? Status::criminalWaiting : Status::stakeWaiting);
     }
 
+    Staker::Status Staker::stake(CChainParams chainparams, const ThreadStaker::Args& args) {
+        return stake(chainparams, std::vector<ThreadStaker::Args>{args});
+    }
+
     CBlockIndex* Staker::getTip() {
         LOCK(cs_main);
         return ::ChainActive().Tip();
@@ -726,17 +857,21 @@ namespace pos {
         return false;
     }
 
-int32_t ThreadStaker::operator()(ThreadStaker::Args args, CChainParams chainparams) {
+int32_t ThreadStaker::operator()(std::vector<ThreadStaker::Args> args, CChainParams chainparams) {
     pos::Staker staker{};
     int32_t nMinted = 0;
     int32_t nTried = 0;
 
+    // limits are common for all operators
+    auto const nMaxTries = args.front().nMaxTries;
+    auto const nMint = args.front().nMint;
+
     auto trying = [&]() {
-        return args.nMaxTries == -1 || nTried < args.nMaxTries;
+        return nMaxTries == -1 || nTried < nMaxTries;
     };
 
     auto notDone = [&]() {
-        return args.nMint == -1 || nMinted < args.nMint;
+        return nMint == -1 || nMinted < nMint;
     };
 
     while (true) {
@@ -30,6 +30,9 @@ static const bool DEFAULT_GENERATE = false;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
+/** Seconds to look ahead for kernel hits, to assemble the block before the kernel becomes valid */
+static const int64_t STAKER_TEMPLATE_LEAD = 5;
+
 struct CBlockTemplate
 {
     CBlock block;
@@ -163,8 +166,8 @@ public:
     explicit BlockAssembler(const CChainParams& params);
     BlockAssembler(const CChainParams& params, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+    /** Construct a new block template with coinbase to scriptPubKeyIn, minted by operatorID (first of -masternode_operator if null) */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const CKeyID& operatorID = {});
 
     static Optional<int64_t> m_last_block_num_txs;
     static Optional<int64_t> m_last_block_weight;
@@ -180,7 +183,7 @@ private:
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, CCustomCSView& mnview, const CCoinsViewCache& coins) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -192,6 +195,9 @@ private:
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Apply custom txs of the sorted package to the block's DeFi state 'mnview'.
+      * False (and nothing applied) if any of them fails, ConnectBlock would skip it and it just wastes the block space */
+    bool TestPackageCustomTxs(const std::vector<CTxMemPool::txiter>& sortedEntries, CCustomCSView& mnview, const CCoinsViewCache& coins);
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
@@ -223,16 +229,35 @@ namespace pos {
         };
 
         /// always forward by value to avoid dangling pointers
+        /// all operators are staked by the single thread, nMint and nMaxTries are taken from the first one
         /// @return number of minted blocks
-        int32_t operator()(Args stakerParams, CChainParams chainparams);
+        int32_t operator()(std::vector<Args> stakerParams, CChainParams chainparams);
+    };
+
+    struct StakerStats {
+        uint64_t kernelsFound = 0;
+        uint64_t blocksMinted = 0;
+        int64_t lastMintedTime = 0;
     };
 
+    /** Per operator staking stats of this node */
+    extern CCriticalSection cs_stakerStats;
+    extern std::map<CKeyID, StakerStats> stakerStats GUARDED_BY(cs_stakerStats);
+
     class Staker {
     private:
         std::chrono::system_clock::time_point nLastSystemTime;
         std::chrono::steady_clock::time_point nLastSteadyTime;
 
         int64_t nLastCoinStakeSearchTime = GetAdjustedTime() - 60;
+        // tip the lookahead state below belongs to
+        uint256 lookaheadTip;
+        int64_t nLastLookaheadTime = 0;
+
+        // block assembled ahead of the upcoming kernel
+        std::shared_ptr<CBlock> preparedBlock;
+        CKeyID preparedOperator;
+        int64_t preparedTime = 0;
 
     public:
         enum class Status {
@@ -244,6 +269,7 @@ namespace pos {
         };
 
         Staker::Status stake(CChainParams chainparams, const ThreadStaker::Args& args);
+        Staker::Status stake(CChainParams chainparams, const std::vector<ThreadStaker::Args>& args);
     private:
         CBlockIndex* getTip();
         template <typename F>
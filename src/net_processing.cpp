@@ -2407,29 +2407,34 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CAnchorAuthMessage auth;
         vRecv >> auth;
 
-        // don't check spv here, but only our anchor index!
-        {
-            LOCK(cs_main);
-            if (panchorauths->GetAuth(auth.GetHash())) {
-                // reject ? or just skip&
-                return false;
-            }
-            if (panchorauths->GetVote(auth.GetSignHash(), auth.GetSigner())) {
+        NodeId const fromId = pfrom->GetId();
+        auto onVerified = [connman, fromId] (CAnchorAuthMessage const & auth, CAnchorAuthVerifier::Result result) {
+            if (result == CAnchorAuthVerifier::Result::DoubleSign) {
                 // disconnect immidiately! possible even ban here, but only if sender peer is an author itself
-                pfrom->fDisconnect = true;
-                return false;
+                connman->ForNode(fromId, [] (CNode* pnode) {
+                    pnode->fDisconnect = true;
+                    return true;
+                });
+            } else if (result == CAnchorAuthVerifier::Result::Accepted) {
+                // rebroadcast
+                std::vector<CInv> const vInv{CInv(MSG_ANCHOR_AUTH, auth.GetHash())};
+                if (!connman->ForNode(fromId, [&] (CNode* pnode) {
+                    RelayAnchorAuths(vInv, *connman, pnode);
+                    return true;
+                })) {
+                    RelayAnchorAuths(vInv, *connman);
+                }
             }
-
-            LogPrintf("Got anchor auth, hash %s, blockheight: %d\n", auth.GetHash().ToString(), auth.height);
-
-            // if valid, add and rebroadcast
-            if (panchorauths->ValidateAuth(auth)) {
-                panchorauths->AddAuth(auth);
-                RelayAnchorAuths({CInv(MSG_ANCHOR_AUTH, auth.GetHash())}, *connman, pfrom);
-                return true;
+        };
+        // signature recovery is done by the verifier threads, off cs_main
+        if (panchorAuthVerifier) {
+            if (!panchorAuthVerifier->Enqueue(auth, onVerified)) {
+                LogPrint(BCLog::NET, "Anchor auths queue is full, dropping auth %s from peer=%d\n", auth.GetHash().ToString(), fromId);
             }
+        } else {
+            CAnchorAuthVerifier::Process({{auth, onVerified}});
         }
-        return false;
+        return true;
     }
 
     if (strCommand == NetMsgType::ANCHORCONFIRM) {
@@ -57,13 +57,17 @@ bool ContextualCheckProofOfStake(const CBlockHeader& blockHeader, const Consensu
         return false;
     }
     uint256 masternodeID;
+    boost::optional<CMasternode> node;
     {
         // check that block minter exists and active at the height of the block
         AssertLockHeld(cs_main);
         auto it = mnView->GetMasternodeIdByOperator(minter);
+        if (it) {
+            node = mnView->GetMasternode(*it);
+        }
 
         /// @todo check height of history frame here (future and past)
-        if (!it || !mnView->GetMasternode(*it)->IsActive(blockHeader.height))
+        if (!node || !node->IsActive(blockHeader.height))
         {
             return false;
         }
@@ -77,8 +81,8 @@ bool ContextualCheckProofOfStake(const CBlockHeader& blockHeader, const Consensu
     {
         AssertLockHeld(cs_main);
         uint32_t const mintedBlocksMaxDiff = static_cast<uint64_t>(mnView->GetLastHeight()) > blockHeader.height ? mnView->GetLastHeight() - blockHeader.height : blockHeader.height - mnView->GetLastHeight();
-        // minter exists and active at the height of the block - it was checked before
-        uint32_t const mintedBlocks = mnView->GetMasternode(masternodeID)->mintedBlocks;
+        // minter exists and active at the height of the block - it was checked before, the node is read once
+        uint32_t const mintedBlocks = node->mintedBlocks;
         uint32_t const mintedBlocksDiff = mintedBlocks > blockHeader.mintedBlocks ? mintedBlocks - blockHeader.mintedBlocks : blockHeader.mintedBlocks - mintedBlocks;
 
         /// @todo this is not so trivial as it seems! do we need an additional check?
@@ -15,6 +15,7 @@
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <masternodes/mn_checks.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -1423,6 +1424,12 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool)
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
 
+    UniValue cache(UniValue::VOBJ);
+    cache.pushKV("size", (uint64_t) customTxDecodeCache.Size());
+    cache.pushKV("hits", customTxDecodeCache.GetHits());
+    cache.pushKV("misses", customTxDecodeCache.GetMisses());
+    ret.pushKV("customtxcache", cache);
+
     return ret;
 }
 
@@ -1440,6 +1447,11 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+            "  \"customtxcache\": {           (json object) Decoded custom transactions cache\n"
+            "    \"size\": xxxxx,             (numeric) Number of cached transactions\n"
+            "    \"hits\": xxxxx,             (numeric) Lookups served from the cache\n"
+            "    \"misses\": xxxxx            (numeric) Lookups which required decoding\n"
+            "  }\n"
             "}\n"
                 },
                 RPCExamples{
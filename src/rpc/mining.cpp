@@ -10,6 +10,7 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <key_io.h>
 #include <masternodes/masternodes.h>
 #include <miner.h>
 #include <net.h>
@@ -190,7 +191,7 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Error: Invalid address");
     }
 
-    auto myIDs = pcustomcsview->AmIOperator();
+    auto myIDs = GetMasternodesRegistry()->AmIOperator();
     if (!myIDs) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Error: I am not masternode operator");
     }
@@ -230,6 +231,17 @@ static UniValue getmintinginfo(const JSONRPCRequest& request)
                     "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
                     "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
                     "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
+                    "  \"operators\": [             (array) Staking stats for each of -masternode_operator\n"
+                    "    {\n"
+                    "      \"operator\": \"xxxx\",      (string) Operator address\n"
+                    "      \"masternodeid\": \"xxxx\",  (string, optional) Masternode id of the operator\n"
+                    "      \"masternodestate\": \"xxxx\",(string, optional) Masternode state\n"
+                    "      \"mintedblocks\": nnn,       (numeric, optional) Number of blocks minted by the masternode\n"
+                    "      \"kernelsfound\": nnn,       (numeric) Kernels found by this node since start\n"
+                    "      \"blocksminted\": nnn,       (numeric) Blocks minted by this node since start\n"
+                    "      \"lastblocktime\": nnn,      (numeric) Time of the last block minted by this node\n"
+                    "    }, ...\n"
+                    "  ]\n"
                     "  \"pooledtx\": n              (numeric) The size of the mempool\n"
                     "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
                     "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
@@ -249,17 +261,47 @@ static UniValue getmintinginfo(const JSONRPCRequest& request)
     if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
     obj.pushKV("difficulty",       (double)GetDifficulty(::ChainActive().Tip()));
 
-    auto mnIds = pcustomcsview->AmIOperator();
+    auto const registry = GetMasternodesRegistry();
+    auto mnIds = registry->AmIOperator();
     obj.pushKV("isoperator",       (bool) mnIds);
     if (mnIds) {
         obj.pushKV("masternodeid", mnIds->second.GetHex());
-        CMasternode const & node = *pcustomcsview->GetMasternode(mnIds->second);
+        CMasternode const & node = registry->Get(mnIds->second)->node;
         auto state = node.GetState();
         obj.pushKV("masternodeoperator", node.operatorAuthAddress.GetHex());
         obj.pushKV("masternodestate", CMasternode::GetHumanReadableState(state));
         obj.pushKV("generate", node.IsActive() && gArgs.GetBoolArg("-gen", DEFAULT_GENERATE));
         obj.pushKV("mintedblocks", (uint64_t)node.mintedBlocks);
     }
+
+    UniValue operators(UniValue::VARR);
+    for (auto const & address : GetOperatorAddressesFromArgs()) {
+        CKeyID const & operatorID = address.second;
+        if (operatorID.IsNull()) {
+            continue;
+        }
+        UniValue op(UniValue::VOBJ);
+        op.pushKV("operator", address.first);
+        if (auto ids = registry->AmIOperator(operatorID)) {
+            CMasternode const & node = registry->Get(ids->second)->node;
+            op.pushKV("masternodeid", ids->second.GetHex());
+            op.pushKV("masternodestate", CMasternode::GetHumanReadableState(node.GetState()));
+            op.pushKV("mintedblocks", (uint64_t)node.mintedBlocks);
+        }
+        pos::StakerStats stats;
+        {
+            LOCK(pos::cs_stakerStats);
+            auto it = pos::stakerStats.find(operatorID);
+            if (it != pos::stakerStats.end()) {
+                stats = it->second;
+            }
+        }
+        op.pushKV("kernelsfound", stats.kernelsFound);
+        op.pushKV("blocksminted", stats.blocksMinted);
+        op.pushKV("lastblocktime", stats.lastMintedTime);
+        operators.push_back(op);
+    }
+    obj.pushKV("operators",        operators);
     obj.pushKV("networkhashps",    getnetworkhashps(request));
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
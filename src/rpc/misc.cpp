@@ -6,6 +6,7 @@
 #include <chainparams.h>
 #include <crypto/ripemd160.h>
 #include <httpserver.h>
+#include <masternodes/masternodes.h>
 #include <outputtype.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
@@ -14,6 +15,7 @@
 #include <util/system.h>
 #include <util/strencodings.h>
 #include <util/validation.h>
+#include <validation.h>
 
 #include <stdint.h>
 #include <tuple>
@@ -398,6 +400,25 @@ static std::string RPCMallocInfo()
 }
 #endif
 
+static UniValue RPCEnhancedCSCacheInfo()
+{
+    LOCK(cs_main);
+    UniValue obj(UniValue::VOBJ);
+    if (!pcustomcsDB) {
+        return obj;
+    }
+    obj.pushKV("dbcache", (uint64_t) pcustomcsDB->DynamicMemoryUsage());
+    if (auto rowCache = pcustomcsDB->GetRowCache()) {
+        auto const stats = rowCache->GetStats();
+        obj.pushKV("rowcache_used", (uint64_t) stats.usage);
+        obj.pushKV("rowcache_limit", (uint64_t) stats.limit);
+        obj.pushKV("rowcache_entries", (uint64_t) stats.entries);
+        obj.pushKV("rowcache_hits", stats.hits);
+        obj.pushKV("rowcache_misses", stats.misses);
+    }
+    return obj;
+}
+
 static UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -420,6 +441,14 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"enhancedcs\": {           (json object) Information about enhanced chainstate database caches\n"
+            "    \"dbcache\": xxxxx,       (numeric) Approximate bytes used by the database cache\n"
+            "    \"rowcache_used\": xxxxx, (numeric) Approximate bytes used by the hot records cache\n"
+            "    \"rowcache_limit\": xxxxx, (numeric) Hot records cache size limit in bytes\n"
+            "    \"rowcache_entries\": xxxxx, (numeric) Number of cached records\n"
+            "    \"rowcache_hits\": xxxxx, (numeric) Number of reads served by the hot records cache\n"
+            "    \"rowcache_misses\": xxxxx, (numeric) Number of reads of hot records that went to the database\n"
             "  }\n"
             "}\n"
                     },
@@ -437,6 +466,7 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("enhancedcs", RPCEnhancedCSCacheInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
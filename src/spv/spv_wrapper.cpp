@@ -35,9 +35,13 @@ std::unique_ptr<CSpvWrapper> pspv;
 using namespace std;
 
 // Prefixes to the masternodes database (masternodes/)
-static const char DB_SPVBLOCKS = 'B';     // spv "blocks" table
+static const char DB_SPVBLOCKS = 'B';     // spv "blocks" table (legacy, by hash)
+static const char DB_SPVHEADERS = 'b';    // spv "blocks" table, by height
+static const char DB_SPVTIP    = 'H';     // height of the last saved block
 static const char DB_SPVPEERS  = 'P';     // spv "peers" table
-static const char DB_SPVTXS    = 'T';     // spv "tx2msg" table
+static const char DB_SPVTXS    = 'T';     // spv "tx2msg" table (legacy, tx with height)
+static const char DB_SPVTXDATA = 't';     // spv raw txs
+static const char DB_SPVTXHEIGHTS = 'h';  // spv txs heights and timestamps, updated separately from the txs
 
 uint64_t const DEFAULT_BTC_FEERATE = TX_FEE_PER_KB;
 
@@ -213,25 +217,35 @@ CSpvWrapper::CSpvWrapper(bool isMainnet, size_t nCacheSize, bool fMemory, bool f
     BRBIP32SerializeMasterPubKey(xpub_buf.data(), xpub_buf.size(), mpk);
     LogPrintf("spv: debug xpub: %s\n", &xpub_buf[0]);
 
+    UpgradeBlocksTable();
+    UpgradeTxsTable();
+
+    // the peer manager builds the chain from the last difficulty transition block, so only the blocks since it are loaded.
+    // older txs are settled: anchors are already in the anchors index and rescans go from the checkpoints anyway
+    uint32_t tipHeight = 0;
+    db->Read(DB_SPVTIP, tipHeight);
+    BlockHeightKey const windowStart{tipHeight - tipHeight % BLOCK_DIFFICULTY_INTERVAL};
+
     std::vector<BRTransaction *> txs;
+    size_t txsTotal = 0;
     // load txs
     {
-        std::function<void (uint256 const &, db_tx_rec &)> onLoadTx = [&txs, this] (uint256 const & hash, db_tx_rec & rec) {
-            BRTransaction *tx = BRTransactionParse(rec.first.data(), rec.first.size());
-            tx->blockHeight = rec.second.first;
-            tx->timestamp = rec.second.second;
-            txs.push_back(tx);
-
-            LogPrintf("spv: load tx: %s, height: %d\n", to_uint256(tx->txHash).ToString(), tx->blockHeight);
-
-            CAnchor anchor;
-            if (IsAnchorTx(tx, anchor)) {
-                LogPrintf("spv: LOAD POSSIBLE ANCHOR TX, tx: %s, blockHash: %s, height: %d, btc height: %d\n", to_uint256(tx->txHash).ToString(), anchor.blockHash.ToString(), anchor.height, tx->blockHeight);
+        std::function<void (uint256 const &, db_tx_height &)> onLoadTx = [&txs, &txsTotal, &windowStart, this] (uint256 const & hash, db_tx_height & rec) {
+            ++txsTotal;
+            // unconfirmed ones are TX_UNCONFIRMED high
+            TBytes raw;
+            if (rec.first < windowStart.height || !db->Read(std::make_pair(DB_SPVTXDATA, hash), raw)) {
+                return;
             }
+            BRTransaction *tx = BRTransactionParse(raw.data(), raw.size());
+            tx->blockHeight = rec.first;
+            tx->timestamp = rec.second;
+            txs.push_back(tx);
         };
         // can't deduce lambda here:
-        IterateTable(DB_SPVTXS, onLoadTx);
+        IterateTable(DB_SPVTXHEIGHTS, onLoadTx);
     }
+    LogPrintf("spv: loaded %d of %d txs since block %d\n", txs.size(), txsTotal, windowStart.height);
 
     wallet = BRWalletNew(txs.data(), txs.size(), mpk, 0);
     BRWalletSetCallbacks(wallet, this, balanceChanged, txAdded, txUpdated, txDeleted);
@@ -240,14 +254,15 @@ CSpvWrapper::CSpvWrapper(bool isMainnet, size_t nCacheSize, bool fMemory, bool f
     std::vector<BRMerkleBlock *> blocks;
     // load blocks
     {
-        std::function<void (uint256 const &, db_block_rec &)> onLoadBlock = [&blocks] (uint256 const & hash, db_block_rec & rec) {
-            BRMerkleBlock *block = BRMerkleBlockParse (rec.first.data(), rec.first.size());
-            block->height = rec.second;
+        std::function<void (BlockHeightKey const &, TBytes &)> onLoadBlock = [&blocks] (BlockHeightKey const & key, TBytes & rec) {
+            BRMerkleBlock *block = BRMerkleBlockParse (rec.data(), rec.size());
+            block->height = key.height;
             blocks.push_back(block);
         };
         // can't deduce lambda here:
-        IterateTable(DB_SPVBLOCKS, onLoadBlock);
+        IterateTable(DB_SPVHEADERS, onLoadBlock, windowStart);
     }
+    LogPrintf("spv: loaded %d blocks, last block %d\n", blocks.size(), tipHeight);
 
     // no need to load|keep peers!!!
     manager = BRPeerManagerNew(BRGetChainParams(), wallet, 1588291200, blocks.data(), blocks.size(), NULL, 0); // date is 1 May 2020
@@ -269,6 +284,7 @@ CSpvWrapper::~CSpvWrapper()
         BRWalletFree(wallet);
         wallet = nullptr;
     }
+    CommitBatch();
 }
 
 void CSpvWrapper::Connect()
@@ -306,6 +322,7 @@ bool CSpvWrapper::Rescan(int height)
     BRPeerManagerRescanFromBlockNumber(manager, static_cast<uint32_t>(height));
     curHeight = BRPeerManagerLastBlockHeight(manager);
     LogPrintf("spv: actual new current block %u\n", curHeight);
+    CommitBatch();
 
     LOCK(cs_main);
     panchors->ActivateBestAnchor(true);
@@ -424,6 +441,7 @@ void CSpvWrapper::OnSyncStarted()
 
 void CSpvWrapper::OnSyncStopped(int error)
 {
+    CommitBatch();
     initialSync = false;
     LogPrintf("spv: sync stopped!\n");
 }
@@ -431,22 +449,28 @@ void CSpvWrapper::OnSyncStopped(int error)
 void CSpvWrapper::OnTxStatusUpdate()
 {
     LogPrintf("spv: tx status update\n");
+    CommitBatch();
     panchors->CheckActiveAnchor();
 }
 
 void CSpvWrapper::OnSaveBlocks(int replace, BRMerkleBlock * blocks[], size_t blocksCount)
 {
     /// @attention called under spv manager lock!!!
+    uint32_t tipHeight = 0;
     if (replace)
     {
         LogPrintf("spv: BLOCK: 'replace' requested, deleting...\n");
-        DeleteTable<uint256>(DB_SPVBLOCKS);
+        DeleteTable<BlockHeightKey>(DB_SPVHEADERS);
+    } else {
+        db->Read(DB_SPVTIP, tipHeight);
     }
     for (size_t i = 0; i < blocksCount; ++i) {
         WriteBlock(blocks[i]);
-        LogPrintf("spv: BLOCK: %u, %s saved\n", blocks[i]->height, to_uint256(blocks[i]->blockHash).ToString());
+        tipHeight = std::max(tipHeight, blocks[i]->height);
     }
+    BatchWrite(DB_SPVTIP, tipHeight);
     CommitBatch();
+    LogPrintf("spv: BLOCK: %u blocks saved, last block %u\n", blocksCount, tipHeight);
 
     /// @attention don't call ANYTHING that could call back to spv here! cause OnSaveBlocks works under spv lock!!!
 //    CAnchorIndex::CheckActiveAnchor();
@@ -463,6 +487,7 @@ void CSpvWrapper::OnThreadCleanup()
 
 void CSpvWrapper::CommitBatch()
 {
+    LOCK(cs_batch);
     if (batch)
     {
         db->WriteBatch(*batch);
@@ -475,23 +500,21 @@ void CSpvWrapper::WriteTx(const BRTransaction *tx)
     static TBytes buf;
     buf.resize(BRTransactionSerialize(tx, NULL, 0));
     BRTransactionSerialize(tx, buf.data(), buf.size());
-    db->Write(make_pair(DB_SPVTXS, to_uint256(tx->txHash)), std::make_pair(buf, std::make_pair(tx->blockHeight, tx->timestamp)) );
+    uint256 const hash{to_uint256(tx->txHash)};
+    BatchWrite(make_pair(DB_SPVTXDATA, hash), buf);
+    BatchWrite(make_pair(DB_SPVTXHEIGHTS, hash), db_tx_height{tx->blockHeight, tx->timestamp});
 }
 
 void CSpvWrapper::UpdateTx(uint256 const & hash, uint32_t blockHeight, uint32_t timestamp)
 {
-    std::pair<char, uint256> const key{std::make_pair(DB_SPVTXS, hash)};
-    std::pair<TBytes, std::pair<uint32_t, uint32_t> > txrec;
-    if (db->Read(key, txrec)) {
-        txrec.second.first = blockHeight;
-        txrec.second.second = timestamp;
-        db->Write(key, txrec);
-    }
+    // wallet txs are always written before (may be in the same batch), the loader skips heights without a tx anyway
+    BatchWrite(make_pair(DB_SPVTXHEIGHTS, hash), db_tx_height{blockHeight, timestamp});
 }
 
 void CSpvWrapper::EraseTx(uint256 const & hash)
 {
-    db->Erase(make_pair(DB_SPVTXS, hash));
+    BatchErase(make_pair(DB_SPVTXDATA, hash));
+    BatchErase(make_pair(DB_SPVTXHEIGHTS, hash));
 }
 
 void CSpvWrapper::WriteBlock(const BRMerkleBlock * block)
@@ -501,7 +524,72 @@ void CSpvWrapper::WriteBlock(const BRMerkleBlock * block)
     buf.resize(blockSize);
     BRMerkleBlockSerialize(block, buf.data(), blockSize);
 
-    BatchWrite(make_pair(DB_SPVBLOCKS, to_uint256(block->blockHash)), make_pair(buf, block->height));
+    BatchWrite(make_pair(DB_SPVHEADERS, BlockHeightKey{block->height}), buf);
+}
+
+std::map<uint32_t, TBytes> SelectChainBlocks(std::map<uint256, std::pair<TBytes, uint32_t>> const & blocks)
+{
+    std::map<uint32_t, TBytes> chain;
+    auto tip = blocks.end();
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        if (tip == blocks.end() || it->second.second > tip->second.second) {
+            tip = it;
+        }
+    }
+    // prevBlock follows the 4 bytes of version in the serialized header
+    for (auto it = tip; it != blocks.end() && it->second.first.size() >= 80; ) {
+        uint32_t const height = it->second.second;
+        chain.emplace(height, it->second.first);
+        auto prev = blocks.find(to_uint256(UInt256Get(&it->second.first[sizeof(uint32_t)])));
+        if (prev == blocks.end() || prev->second.second >= height) {
+            break;
+        }
+        it = prev;
+    }
+    uint32_t const chainStart = chain.empty() ? 0 : chain.begin()->first;
+    for (auto const & block : blocks) {
+        if (block.second.second < chainStart) {
+            chain.emplace(block.second.second, block.second.first);
+        }
+    }
+    return chain;
+}
+
+void CSpvWrapper::UpgradeBlocksTable()
+{
+    std::map<uint256, db_block_rec> legacy;
+    std::function<void (uint256 const &, db_block_rec &)> onBlock = [&] (uint256 const & hash, db_block_rec & rec) {
+        legacy.emplace(hash, std::move(rec));
+    };
+    IterateTable(DB_SPVBLOCKS, onBlock);
+    if (legacy.empty()) {
+        return;
+    }
+    // several blocks of the legacy table may share a height (forks), only the main chain ones are kept
+    auto const chain = SelectChainBlocks(legacy);
+    for (auto const & block : chain) {
+        BatchWrite(make_pair(DB_SPVHEADERS, BlockHeightKey{block.first}), block.second);
+    }
+    DeleteTable<uint256>(DB_SPVBLOCKS);
+    BatchWrite(DB_SPVTIP, chain.empty() ? 0 : chain.rbegin()->first);
+    CommitBatch();
+    LogPrintf("spv: upgraded blocks table, %d blocks, %d fork blocks dropped\n", chain.size(), legacy.size() - chain.size());
+}
+
+void CSpvWrapper::UpgradeTxsTable()
+{
+    size_t count = 0;
+    std::function<void (uint256 const &, db_tx_rec &)> onTx = [&] (uint256 const & hash, db_tx_rec & rec) {
+        BatchWrite(make_pair(DB_SPVTXDATA, hash), rec.first);
+        BatchWrite(make_pair(DB_SPVTXHEIGHTS, hash), rec.second);
+        ++count;
+    };
+    IterateTable(DB_SPVTXS, onTx);
+    if (count > 0) {
+        DeleteTable<uint256>(DB_SPVTXS);
+        CommitBatch();
+        LogPrintf("spv: upgraded txs table, %d txs\n", count);
+    }
 }
 
 void publishedTxCallback(void *info, int error)
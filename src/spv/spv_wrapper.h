@@ -7,6 +7,7 @@
 
 #include <dbwrapper.h>
 #include <shutdown.h>
+#include <sync.h>
 #include <uint256.h>
 
 #include <spv/support/BRLargeInt.h>
@@ -56,18 +57,39 @@ extern uint64_t const DEFAULT_BTC_FEERATE;
 
 using namespace boost::multi_index;
 
+// big endian, so the blocks table is ordered by height
+struct BlockHeightKey
+{
+    uint32_t height;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(WrapBigEndian(height));
+    }
+};
+
+/// Picks the blocks of the legacy blocks table (hash -> serialized block, height) for the table by height.
+/// Walks back from the highest block by the parent hashes, so the blocks of stale forks at the same heights are dropped.
+/// Heights below the walked chain (its parent isn't saved) keep the first block met.
+std::map<uint32_t, TBytes> SelectChainBlocks(std::map<uint256, std::pair<TBytes, uint32_t>> const & blocks);
+
 class CSpvWrapper
 {
 private:
     boost::shared_ptr<CDBWrapper> db;
-    boost::scoped_ptr<CDBBatch> batch;
+    // write-behind batch, committed on the sync progress (saved blocks, tx status update, sync stop)
+    Mutex cs_batch;
+    boost::scoped_ptr<CDBBatch> batch GUARDED_BY(cs_batch);
 
     BRWallet *wallet = nullptr;
     BRPeerManager *manager = nullptr;
     std::string spv_internal_logfilename;
 
-    using db_tx_rec    = std::pair<TBytes, std::pair<uint32_t, uint32_t>>;  // serialized tx, blockHeight, timeStamp
-    using db_block_rec = std::pair<TBytes, uint32_t>;                       // serialized block, blockHeight
+    using db_tx_rec    = std::pair<TBytes, std::pair<uint32_t, uint32_t>>;  // serialized tx, blockHeight, timeStamp (legacy txs table)
+    using db_tx_height = std::pair<uint32_t, uint32_t>;                     // blockHeight, timeStamp
+    using db_block_rec = std::pair<TBytes, uint32_t>;                       // serialized block, blockHeight (legacy blocks table)
 
     bool initialSync = true;
 
@@ -113,6 +135,7 @@ private:
     template <typename K, typename V>
     void BatchWrite(const K& key, const V& value)
     {
+        LOCK(cs_batch);
         if (!batch)
         {
             batch.reset(new CDBBatch(*db));
@@ -122,6 +145,7 @@ private:
     template <typename K>
     void BatchErase(const K& key)
     {
+        LOCK(cs_batch);
         if (!batch)
         {
             batch.reset(new CDBBatch(*db));
@@ -130,10 +154,10 @@ private:
     }
 
     template <typename Key, typename Value>
-    bool IterateTable(char prefix, std::function<void(Key const &, Value &)> callback)
+    bool IterateTable(char prefix, std::function<void(Key const &, Value &)> callback, Key const & start = Key())
     {
         boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&*db)->NewIterator());
-        pcursor->Seek(prefix);
+        pcursor->Seek(std::make_pair(prefix, start));
 
         while (pcursor->Valid())
         {
@@ -178,6 +202,11 @@ private:
         return true;
     }
 
+    // converts the legacy blocks table (by hash) to the one by height
+    void UpgradeBlocksTable();
+    // splits the legacy txs table into the raw txs and their heights
+    void UpgradeTxsTable();
+
 protected:
     void CommitBatch();
 
@@ -163,4 +163,70 @@ BOOST_AUTO_TEST_CASE(best_anchor_activation_logic)
 }
 
 
+BOOST_AUTO_TEST_CASE(auth_verifier)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CAnchorAuthMessage auth;
+    {
+        LOCK(cs_main);
+        auto const stakeModifier = ::ChainActive()[0]->stakeModifier;
+        auth = CAnchorAuthMessage({uint256(), 0, ::ChainActive()[0]->GetBlockHash(), GetNextTeamCached(stakeModifier)});
+        BOOST_CHECK(auth.nextTeam == pcustomcsview->CalcNextTeam(stakeModifier));
+    }
+    BOOST_CHECK(auth.GetSigner().IsNull());
+    BOOST_REQUIRE(auth.SignWithKey(key));
+    BOOST_CHECK(auth.GetSigner() == key.GetPubKey().GetID()); // cached signer is reset by signing
+
+    std::vector<CAnchorAuthVerifier::Result> results;
+    auto const callback = [&results] (CAnchorAuthMessage const &, CAnchorAuthVerifier::Result result) {
+        results.push_back(result);
+    };
+    // not a team member
+    CAnchorAuthVerifier::Process({{auth, callback}});
+    {
+        LOCK(cs_main);
+        panchorauths->AddAuth(auth);
+    }
+    CAnchorAuthVerifier::Process({{auth, callback}});
+    BOOST_CHECK(results == (std::vector<CAnchorAuthVerifier::Result>{CAnchorAuthVerifier::Result::Invalid, CAnchorAuthVerifier::Result::Known}));
+}
+
+BOOST_AUTO_TEST_CASE(spv_blocks_table_upgrade)
+{
+    // serialized header with the parent hash, the rest of the block isn't looked at
+    auto const header = [] (uint256 const & prev, uint8_t tag) {
+        TBytes buf(80, tag);
+        std::copy(prev.begin(), prev.end(), buf.begin() + 4);
+        return buf;
+    };
+    uint256 const b0 = uint256S("f0"), b1 = uint256S("f1"), b2 = uint256S("f2"), b3 = uint256S("f3");
+    uint256 const fork2 = uint256S("02"); // a stale block at height 2, goes first in the hash order
+
+    std::map<uint256, std::pair<TBytes, uint32_t>> legacy;
+    legacy[b0] = {header(uint256S("aa"), 0), 0};
+    legacy[b1] = {header(b0, 1), 1};
+    legacy[b2] = {header(b1, 2), 2};
+    legacy[b3] = {header(b2, 3), 3};
+    legacy[fork2] = {header(b1, 0xf2), 2};
+
+    auto const chain = spv::SelectChainBlocks(legacy);
+    BOOST_REQUIRE_EQUAL(chain.size(), 4);
+    BOOST_CHECK(chain.at(0) == legacy[b0].first);
+    BOOST_CHECK(chain.at(1) == legacy[b1].first);
+    BOOST_CHECK(chain.at(2) == legacy[b2].first);
+    BOOST_CHECK(chain.at(3) == legacy[b3].first);
+
+    // the fork is longer now: its block replaces the main chain one at height 2
+    uint256 const fork3 = uint256S("03"), fork4 = uint256S("04");
+    legacy[fork3] = {header(fork2, 0xf3), 3};
+    legacy[fork4] = {header(fork3, 0xf4), 4};
+    auto const reorged = spv::SelectChainBlocks(legacy);
+    BOOST_REQUIRE_EQUAL(reorged.size(), 5);
+    BOOST_CHECK(reorged.at(2) == legacy[fork2].first);
+    BOOST_CHECK(reorged.at(3) == legacy[fork3].first);
+    BOOST_CHECK(reorged.at(1) == legacy[b1].first);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include <masternodes/masternodes.h>
 #include <masternodes/mn_checks.h>
 #include <test/setup_common.h>
+#include <txmempool.h>
 #include <validation.h>
 
 #include <boost/test/unit_test.hpp>
@@ -176,5 +177,169 @@ BOOST_AUTO_TEST_CASE(apply_a2a_neg)
     }
 }
 
+BOOST_AUTO_TEST_CASE(custom_tx_decode_cache)
+{
+    CCustomTxDecodeCache cache(2);
+
+    CAccountToAccountMessage msg{};
+    msg.from = CScript(424242);
+    msg.to = {{ CScript(0xA), CBalances{{ {DCT_ID{0}, 10} }} }};
+    CMutableTransaction rawTx;
+    rawTx.vout = { CTxOut(0, CreateMetaA2A(msg)) };
+    CTransaction const tx(rawTx);
+
+    auto decoded = cache.Decode(tx);
+    BOOST_CHECK(decoded->type == CustomTxType::AccountToAccount);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 1);
+    BOOST_CHECK(cache.Decode(tx) == decoded);
+    BOOST_CHECK_EQUAL(cache.GetHits(), 1);
+
+    // message is served only for the same metadata
+    CAccountToAccountMessage cached{};
+    BOOST_CHECK(cache.Get(tx, decoded->metadata, cached));
+    BOOST_CHECK(cached.to == msg.to);
+    BOOST_CHECK(!cache.Get(tx, std::vector<unsigned char>{}, cached));
+
+    // oldest entries are evicted
+    for (int i = 0; i < 2; ++i) {
+        rawTx.nLockTime = i + 1;
+        cache.Decode(CTransaction(rawTx));
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), 2);
+    BOOST_CHECK(!cache.Get(tx, decoded->metadata, cached));
+
+    // plain txs are decoded but not cached
+    CMutableTransaction plainTx;
+    plainTx.vout = { CTxOut(1, CScript() << OP_TRUE) };
+    BOOST_CHECK(cache.Decode(CTransaction(plainTx))->type == CustomTxType::None);
+    BOOST_CHECK_EQUAL(cache.Size(), 2);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 3);
+}
+
+static std::map<TBytes, boost::optional<TBytes>> GetChanges(CCustomCSView & view)
+{
+    std::map<TBytes, boost::optional<TBytes>> changes;
+    for (auto const & kv : dynamic_cast<CFlushableStorageKV&>(view.GetRaw()).GetRaw()) {
+        changes.emplace(kv.first, kv.second);
+    }
+    return changes;
+}
+
+BOOST_AUTO_TEST_CASE(speculative_apply)
+{
+    Consensus::Params amkCheated = Params().GetConsensus();
+    amkCheated.AMKHeight = 0;
+
+    CCustomCSView base(*pcustomcsview);
+    CCoinsViewCache coinview(&::ChainstateActive().CoinsTip());
+
+    DCT_ID DFI{0};
+    std::vector<CScript> owners{CScript(0x1001), CScript(0x1002), CScript(0x1003)};
+    for (auto const & owner : owners) {
+        BOOST_REQUIRE(base.AddBalance(owner, CTokenAmount{DFI, 100}).ok);
+    }
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout = { CTxOut(0, CScript()) };
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    // owner1 -> A, owner2 -> B, owner1 -> C (reads the balance written by the 1st), owner3 -> A (and this one too)
+    std::vector<std::pair<size_t, CScript>> transfers{{0, CScript(0xA)}, {1, CScript(0xB)}, {0, CScript(0xC)}, {2, CScript(0xA)}};
+    for (size_t i = 0; i < transfers.size(); ++i) {
+        auto const & owner = owners[transfers[i].first];
+        auto const auth = COutPoint(uint256S("0xafaf"), i);
+        coinview.AddCoin(auth, Coin(CTxOut(1, owner, DFI), 1, false), false);
+
+        CAccountToAccountMessage msg{};
+        msg.from = owner;
+        msg.to = {{ transfers[i].second, CBalances{{ {DFI, 10} }} }};
+        CMutableTransaction rawTx;
+        rawTx.vin = { CTxIn(auth) };
+        rawTx.vout = { CTxOut(0, CreateMetaA2A(msg)) };
+        block.vtx.push_back(MakeTransactionRef(rawTx));
+    }
+
+    CCustomCSView sequential(base);
+    for (uint32_t i = 1; i < block.vtx.size(); ++i) {
+        BOOST_CHECK(ApplyCustomTx(sequential, coinview, *block.vtx[i], amkCheated, 1, i, false).ok);
+    }
+
+    CCustomTxSpeculator speculator(base, 1, amkCheated, false);
+    auto checks = speculator.Prepare(block, coinview);
+    BOOST_REQUIRE_EQUAL(checks.size(), transfers.size());
+    for (auto & check : checks) {
+        BOOST_CHECK(check());
+    }
+    CCustomCSView blockview(base);
+    for (uint32_t i = 1; i < block.vtx.size(); ++i) {
+        BOOST_CHECK(speculator.Apply(blockview, coinview, *block.vtx[i], i).ok);
+    }
+
+    BOOST_CHECK_EQUAL(speculator.GetCommitted(), 2);
+    BOOST_CHECK_EQUAL(speculator.GetReapplied(), 2);
+    BOOST_CHECK(GetChanges(blockview) == GetChanges(sequential));
+    BOOST_CHECK_EQUAL(blockview.GetBalance(owners[0], DFI), CTokenAmount({DFI, 80}));
+    BOOST_CHECK_EQUAL(blockview.GetBalance(CScript(0xA), DFI), CTokenAmount({DFI, 20}));
+}
+
+BOOST_AUTO_TEST_CASE(mempool_custom_view)
+{
+    Consensus::Params amkCheated = Params().GetConsensus();
+    amkCheated.AMKHeight = 0;
+
+    LOCK(cs_main);
+    CTxMemPool pool;
+    LOCK(pool.cs);
+
+    CScript const owner = CScript(424242);
+    DCT_ID DFI{0};
+    BOOST_REQUIRE(pcustomcsview->AddBalance(owner, CTokenAmount{DFI, 100}).ok);
+
+    // two transfers of 60 from the same account
+    auto& coinsTip = ::ChainstateActive().CoinsTip();
+    std::vector<CTransactionRef> txs;
+    for (uint32_t i = 0; i < 2; ++i) {
+        auto const auth = COutPoint(uint256S("0xfafa"), i);
+        coinsTip.AddCoin(auth, Coin(CTxOut(1, owner, DFI), 1, false), false);
+
+        CAccountToAccountMessage msg{};
+        msg.from = owner;
+        msg.to = {{ CScript(0xA + i), CBalances{{ {DFI, 60} }} }};
+        CMutableTransaction rawTx;
+        rawTx.vin = { CTxIn(auth) };
+        rawTx.vout = { CTxOut(0, CreateMetaA2A(msg)) };
+        txs.push_back(MakeTransactionRef(rawTx));
+    }
+
+    // as AcceptToMemoryPool does
+    auto accept = [&] (CTransactionRef const & tx) {
+        CCoinsViewMemPool viewMemPool(&coinsTip, pool);
+        CCoinsViewCache coins(&viewMemPool);
+        CCustomCSViewLayer layer(pool.GetCustomView(amkCheated));
+        if (!ApplyCustomTx(*layer, coins, *tx, amkCheated, ::ChainActive().Height() + 1, 0, false).ok) {
+            return false;
+        }
+        pool.addUnchecked(TestMemPoolEntryHelper().FromTx(tx));
+        pool.AddToCustomView(tx, &*layer);
+        return true;
+    };
+
+    BOOST_CHECK(accept(txs[0]));
+    BOOST_CHECK_EQUAL(pool.GetCustomView(amkCheated).GetBalance(owner, DFI), CTokenAmount({DFI, 40}));
+    // fits the tip, but not the pool
+    BOOST_CHECK(!accept(txs[1]));
+    BOOST_CHECK_EQUAL(pcustomcsview->GetBalance(owner, DFI), CTokenAmount({DFI, 100}));
+
+    // the view is built anew once the tx leaves the pool
+    pool.removeRecursive(*txs[0], MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK_EQUAL(pool.GetCustomView(amkCheated).GetBalance(owner, DFI), CTokenAmount({DFI, 100}));
+    BOOST_CHECK(accept(txs[1]));
+    BOOST_CHECK_EQUAL(pool.GetCustomView(amkCheated).GetBalance(CScript(0xB), DFI), CTokenAmount({DFI, 60}));
+    BOOST_CHECK_EQUAL(pool.GetCustomView(amkCheated).GetBalance(CScript(0xA), DFI), CTokenAmount{});
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
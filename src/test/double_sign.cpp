@@ -144,4 +144,38 @@ BOOST_AUTO_TEST_CASE(check_blocking_criminal_coins)
    // BOOST_CHECK(penhancedview->FindBlockedCriminalCoins(masternodeID, 0, false));
 }
 
+BOOST_AUTO_TEST_CASE(prune_minted_headers)
+{
+    CCriminalsView criminals(GetDataDir() / "criminals_prune", 1 << 20, true, true);
+    uint256 const masternodeID = uint256S("1");
+    for (uint32_t height = 0; height < 10; ++height) {
+        CBlockHeader header;
+        header.height = height;
+        criminals.WriteMintedBlockHeader(masternodeID, height, uint256S(std::to_string(height + 1)), header, false);
+    }
+    BOOST_CHECK(criminals.Flush());
+
+    // a few scans to get through
+    DBMNBlockHeadersKey cursor{};
+    size_t pruned = 0;
+    for (int i = 0; i < 4; ++i) {
+        pruned += criminals.PruneMintedHeaders(5, 3, cursor);
+    }
+    BOOST_CHECK(cursor.masternodeID.IsNull());
+    BOOST_CHECK_EQUAL(pruned, 5);
+
+    std::map<uint256, CBlockHeader> blockHeaders;
+    criminals.FetchMintedHeaders(masternodeID, 4, blockHeaders, false);
+    BOOST_CHECK(blockHeaders.empty());
+    criminals.FetchMintedHeaders(masternodeID, 5, blockHeaders, false);
+    BOOST_CHECK_EQUAL(blockHeaders.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(criminals_clean_shutdown)
+{
+    auto const path = GetDataDir() / "criminals_shutdown";
+    BOOST_CHECK(!CCriminalsView(path, 1 << 20, false, true).WasCleanShutdown());
+    BOOST_CHECK(CCriminalsView(path, 1 << 20).WasCleanShutdown());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,7 @@
 #include <chainparams.h>
+#include <arith_uint256.h>
 #include <masternodes/masternodes.h>
+#include <masternodes/poolmath.h>
 #include <validation.h>
 
 #include <test/setup_common.h>
@@ -72,6 +74,81 @@ Res AddPoolLiquidity(CCustomCSView &mnview, DCT_ID idPool, CAmount amountA, CAmo
     return mnview.SetPoolPair(idPool, *optPool);
 }
 
+// the former arith_uint256 pool math, kept as the reference for the differential tests of the PoolMath kernel
+static CAmount RefSlopeSwap(CAmount unswapped, CAmount &poolFrom, CAmount &poolTo, bool postBayfrontGardens)
+{
+    arith_uint256 poolF = arith_uint256(poolFrom);
+    arith_uint256 poolT = arith_uint256(poolTo);
+
+    arith_uint256 swapped = 0;
+    if (!postBayfrontGardens) {
+        CAmount chunk = poolFrom/CPoolPair::SLOPE_SWAP_RATE < unswapped ? poolFrom/CPoolPair::SLOPE_SWAP_RATE : unswapped;
+        while (unswapped > 0) {
+            CAmount stepFrom = std::min(chunk, unswapped);
+            arith_uint256 stepFrom256(stepFrom);
+            arith_uint256 stepTo = poolT * stepFrom256 / poolF;
+            poolF += stepFrom256;
+            poolT -= stepTo;
+            unswapped -= stepFrom;
+            swapped += stepTo;
+        }
+    } else {
+        arith_uint256 unswappedA = arith_uint256(unswapped);
+
+        swapped = poolT - (poolT * poolF / (poolF + unswappedA));
+        poolF += unswappedA;
+        poolT -= swapped;
+    }
+
+    poolFrom = poolF.GetLow64();
+    poolTo = poolT.GetLow64();
+    return swapped.GetLow64();
+}
+
+static Res RefSwap(CPoolPair & pool, CTokenAmount in, PoolPrice const & maxPrice, bool postBayfrontGardens, CTokenAmount & out)
+{
+    if (in.nValue <= 0)
+        return Res::Err("Input amount should be positive!");
+
+    bool const forward = in.nTokenId == pool.idTokenA;
+    if (pool.reserveA < CPoolPair::SLOPE_SWAP_RATE || pool.reserveB < CPoolPair::SLOPE_SWAP_RATE)
+        return Res::Err("Lack of liquidity.");
+
+    arith_uint256 maxPrice256 = arith_uint256(maxPrice.integer) * CPoolPair::PRECISION + maxPrice.fraction;
+    arith_uint256 priceAB = (arith_uint256(pool.reserveA) * CPoolPair::PRECISION / arith_uint256(pool.reserveB));
+    arith_uint256 priceBA = (arith_uint256(pool.reserveB) * CPoolPair::PRECISION / arith_uint256(pool.reserveA));
+    arith_uint256 curPrice = forward ? priceBA : priceAB;
+    if (curPrice > maxPrice256)
+        return Res::Err("Price is higher than indicated.");
+
+    if (pool.commission) {
+        CAmount const tradeFee = (arith_uint256(in.nValue) * arith_uint256(pool.commission) / arith_uint256(COIN)).GetLow64();
+        in.nValue -= tradeFee;
+        if (forward) {
+            pool.blockCommissionA += tradeFee;
+        }
+        else {
+            pool.blockCommissionB += tradeFee;
+        }
+    }
+    auto checkRes = forward ? SafeAdd(pool.reserveA, in.nValue) : SafeAdd(pool.reserveB, in.nValue);
+    if (!checkRes.ok) {
+        return Res::Err("Swapping will lead to pool's reserve overflow");
+    }
+
+    CAmount result = forward ? RefSlopeSwap(in.nValue, pool.reserveA, pool.reserveB, postBayfrontGardens) : RefSlopeSwap(in.nValue, pool.reserveB, pool.reserveA, postBayfrontGardens);
+    pool.swapEvent = true;
+    out = { forward ? pool.idTokenB : pool.idTokenA, result };
+    return Res::Ok();
+}
+
+// log-uniform in [min, max], so all the magnitudes of the amounts are covered
+static CAmount RandAmount(CAmount min, CAmount max)
+{
+    uint64_t const range = uint64_t(max - min) + 1;
+    return min + CAmount(InsecureRandBits(1 + InsecureRandRange(63)) % range);
+}
+
 BOOST_FIXTURE_TEST_SUITE(liquidity_tests, TestingSetup)
 
 BOOST_AUTO_TEST_CASE(math_liquidity_and_trade)
@@ -369,4 +446,221 @@ BOOST_AUTO_TEST_CASE(math_rewards)
 }
 
 
+BOOST_AUTO_TEST_CASE(math_kernel_differential)
+{
+    CAmount const MAX = std::numeric_limits<CAmount>::max();
+
+    // kernel primitives on the edges and random operands
+    std::vector<uint64_t> values{0, 1, 2, 999, 1000, 1001, COIN - 1, COIN, uint64_t(MAX) - 1, uint64_t(MAX), uint64_t(MAX) + 1, std::numeric_limits<uint64_t>::max()};
+    for (int i = 0; i < 20; ++i) {
+        values.push_back(RandAmount(0, MAX));
+        values.push_back(InsecureRandBits(64));
+    }
+    for (auto a : values) {
+        for (auto b : values) {
+            BOOST_REQUIRE_EQUAL(PoolMath::SqrtMul(a, b), (arith_uint256(a) * arith_uint256(b)).sqrt().GetLow64());
+            for (auto c : values) {
+                if (c == 0) {
+                    BOOST_CHECK_THROW(PoolMath::MulDiv(a, b, c), uint_error);
+                    continue;
+                }
+                BOOST_REQUIRE_EQUAL(PoolMath::MulDiv(a, b, c), (arith_uint256(a) * arith_uint256(b) / arith_uint256(c)).GetLow64());
+            }
+        }
+    }
+
+    // swaps, both slope modes
+    for (bool postBayfrontGardens : {false, true}) {
+        for (int i = 0; i < 2000; ++i) {
+            CPoolPair pool;
+            pool.idTokenA = DCT_ID{0};
+            pool.idTokenB = DCT_ID{1};
+            pool.status = true;
+            pool.commission = InsecureRandBool() ? 0 : RandAmount(0, COIN);
+            pool.reserveA = RandAmount(CPoolPair::SLOPE_SWAP_RATE / 2, MAX);
+            pool.reserveB = RandAmount(CPoolPair::SLOPE_SWAP_RATE / 2, MAX);
+
+            bool const forward = InsecureRandBool();
+            CTokenAmount in{forward ? pool.idTokenA : pool.idTokenB, RandAmount(1, MAX)};
+            if (!postBayfrontGardens) {
+                // the reference legacy slide is a bignum division per 0.1% chunk, so keep it reasonably short
+                CAmount const reserveFrom = forward ? pool.reserveA : pool.reserveB;
+                in.nValue = std::min(in.nValue, std::max<CAmount>(1, reserveFrom / CPoolPair::SLOPE_SWAP_RATE) * 10000);
+            }
+            PoolPrice const maxPrice = InsecureRandBool() ? PoolPrice{MAX, 0} : PoolPrice{RandAmount(0, MAX), int64_t(InsecureRandBits(64))};
+
+            CPoolPair ref = pool;
+            CTokenAmount out{}, refOut{};
+            auto res = pool.Swap(in, maxPrice, [&] (CTokenAmount const & ta) -> Res {
+                out = ta;
+                return Res::Ok();
+            }, postBayfrontGardens);
+            auto refRes = RefSwap(ref, in, maxPrice, postBayfrontGardens, refOut);
+
+            BOOST_REQUIRE_EQUAL(res.ok, refRes.ok);
+            BOOST_REQUIRE_EQUAL(res.msg, refRes.msg);
+            BOOST_REQUIRE(out.nTokenId == refOut.nTokenId);
+            BOOST_REQUIRE_EQUAL(out.nValue, refOut.nValue);
+            BOOST_REQUIRE_EQUAL(pool.reserveA, ref.reserveA);
+            BOOST_REQUIRE_EQUAL(pool.reserveB, ref.reserveB);
+            BOOST_REQUIRE_EQUAL(pool.blockCommissionA, ref.blockCommissionA);
+            BOOST_REQUIRE_EQUAL(pool.blockCommissionB, ref.blockCommissionB);
+        }
+    }
+
+    // adding and removing liquidity
+    for (int i = 0; i < 2000; ++i) {
+        CPoolPair pool;
+        bool const first = i % 10 == 0;
+        pool.reserveA = first ? 0 : RandAmount(1, MAX);
+        pool.reserveB = first ? 0 : RandAmount(1, MAX);
+        pool.totalLiquidity = first ? 0 : RandAmount(2, MAX);
+        CAmount const amountA = RandAmount(1, MAX);
+        CAmount const amountB = RandAmount(1, MAX);
+
+        CAmount refLiquidity;
+        if (first) {
+            refLiquidity = (CAmount) (arith_uint256(amountA) * arith_uint256(amountB)).sqrt().GetLow64() - CPoolPair::MINIMUM_LIQUIDITY;
+        } else {
+            CAmount liqA = (arith_uint256(amountA) * arith_uint256(pool.totalLiquidity) / pool.reserveA).GetLow64();
+            CAmount liqB = (arith_uint256(amountB) * arith_uint256(pool.totalLiquidity) / pool.reserveB).GetLow64();
+            refLiquidity = std::min(liqA, liqB);
+        }
+        CPoolPair added = pool;
+        auto res = added.AddLiquidity(amountA, amountB, {}, [&] (CScript const &, CAmount liqAmount) -> Res {
+            BOOST_REQUIRE_EQUAL(liqAmount, refLiquidity);
+            return Res::Ok();
+        });
+        if (refLiquidity <= 0) {
+            BOOST_REQUIRE(!res.ok);
+        }
+
+        if (first) {
+            continue;
+        }
+        CAmount const liqAmount = RandAmount(1, pool.totalLiquidity - 1);
+        CAmount const refA = (arith_uint256(liqAmount) * arith_uint256(pool.reserveA) / pool.totalLiquidity).GetLow64();
+        CAmount const refB = (arith_uint256(liqAmount) * arith_uint256(pool.reserveB) / pool.totalLiquidity).GetLow64();
+        res = pool.RemoveLiquidity({}, liqAmount, [&] (CScript const &, CAmount amountA, CAmount amountB) -> Res {
+            BOOST_REQUIRE_EQUAL(amountA, refA);
+            BOOST_REQUIRE_EQUAL(amountB, refB);
+            return Res::Ok();
+        });
+        BOOST_REQUIRE(res.ok);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pool_graph_quotes)
+{
+    CCustomCSView mnview(*pcustomcsview);
+
+    // A-B and B-C are deep, A-C is shallow, so A->B->C gives more than A->C
+    DCT_ID idA, idB, idAB, idC, idBC, idAC;
+    std::tie(idA, idB, idAB) = CreatePoolNTokens(mnview, "A", "B");
+    idC = CreateToken(mnview, "C");
+    idBC = CreateToken(mnview, "B-C", (uint8_t)CToken::TokenFlags::Default | (uint8_t)CToken::TokenFlags::DAT | (uint8_t)CToken::TokenFlags::LPS);
+    idAC = CreateToken(mnview, "A-C", (uint8_t)CToken::TokenFlags::Default | (uint8_t)CToken::TokenFlags::DAT | (uint8_t)CToken::TokenFlags::LPS);
+    for (auto const & pair : {std::make_pair(idBC, std::make_pair(idB, idC)), std::make_pair(idAC, std::make_pair(idA, idC))}) {
+        CPoolPair pool{};
+        pool.idTokenA = pair.second.first;
+        pool.idTokenB = pair.second.second;
+        pool.commission = 1000000;
+        BOOST_REQUIRE(mnview.SetPoolPair(pair.first, pool).ok);
+    }
+    AddPoolLiquidity(mnview, idAB, 1000 * COIN, 1000 * COIN, CScript(1));
+    AddPoolLiquidity(mnview, idBC, 1000 * COIN, 1000 * COIN, CScript(1));
+    AddPoolLiquidity(mnview, idAC, 10 * COIN, 10 * COIN, CScript(1));
+
+    CPoolGraph const graph(mnview, 0, true);
+    BOOST_REQUIRE_EQUAL(graph.GetPools().size(), 3);
+    BOOST_CHECK(graph.GetPool(idC, idA) == graph.GetPool(idAC));
+    BOOST_CHECK(!graph.GetPool(idA, DCT_ID{100}));
+
+    // the direct quote is exactly what the pool itself gives
+    CTokenAmount const in{idA, COIN};
+    PoolPrice const noLimit{std::numeric_limits<CAmount>::max(), 0};
+    auto direct = graph.QuoteDirect(in, idC, noLimit);
+    BOOST_REQUIRE(direct.ok);
+    CPoolPair pool = *mnview.GetPoolPair(idAC);
+    CTokenAmount out{};
+    BOOST_REQUIRE(pool.Swap(in, noLimit, [&] (CTokenAmount const & ta) -> Res {
+        out = ta;
+        return Res::Ok();
+    }).ok);
+    BOOST_CHECK(direct.val->poolIds == std::vector<DCT_ID>{idAC});
+    BOOST_CHECK(direct.val->out.nTokenId == idC);
+    BOOST_CHECK_EQUAL(direct.val->out.nValue, out.nValue);
+    BOOST_CHECK(!graph.QuoteDirect(in, idC, PoolPrice{0, 1}).ok);
+
+    auto best = graph.QuoteBest(in, idC);
+    BOOST_REQUIRE(best.ok);
+    BOOST_CHECK((best.val->poolIds == std::vector<DCT_ID>{idAB, idBC}));
+    BOOST_CHECK(best.val->out.nValue > direct.val->out.nValue);
+
+    // a single hop is allowed only
+    best = graph.QuoteBest(in, idC, 1);
+    BOOST_REQUIRE(best.ok);
+    BOOST_CHECK(best.val->poolIds == std::vector<DCT_ID>{idAC});
+    BOOST_CHECK(!graph.QuoteBest(in, DCT_ID{100}).ok);
+
+    // the graph is a copy, pools changes don't affect it
+    AddPoolLiquidity(mnview, idAC, 10000 * COIN, 10000 * COIN, CScript(1));
+    BOOST_CHECK_EQUAL(graph.GetPool(idAC)->pool.reserveA, 10 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(pool_graph_high_ids)
+{
+    CCustomCSView mnview(*pcustomcsview);
+
+    // varint keys of ids from 16512 go before the smaller ones
+    std::vector<DCT_ID> const poolIds{DCT_ID{20000}, DCT_ID{129}, DCT_ID{16512}, DCT_ID{300}};
+    uint32_t token = 1000;
+    for (auto const & poolId : poolIds) {
+        CPoolPair pool{};
+        pool.idTokenA = DCT_ID{token++};
+        pool.idTokenB = DCT_ID{token++};
+        BOOST_REQUIRE(mnview.SetPoolPair(poolId, pool).ok);
+    }
+
+    CPoolGraph const graph(mnview, 0, true);
+    BOOST_REQUIRE_EQUAL(graph.GetPools().size(), poolIds.size());
+    BOOST_CHECK(std::is_sorted(graph.GetPools().begin(), graph.GetPools().end(), [] (CPoolGraph::Pool const & a, CPoolGraph::Pool const & b) {
+        return a.id < b.id;
+    }));
+    token = 1000;
+    for (auto const & poolId : poolIds) {
+        auto const pool = graph.GetPool(poolId);
+        BOOST_REQUIRE(pool);
+        BOOST_CHECK(pool->id == poolId);
+        BOOST_CHECK(graph.GetPool(DCT_ID{token + 1}, DCT_ID{token}) == pool);
+        token += 2;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pool_graph_update)
+{
+    LOCK(cs_main);
+    DCT_ID idA, idB, idAB;
+    {
+        CCustomCSView mnview(*pcustomcsview);
+        std::tie(idA, idB, idAB) = CreatePoolNTokens(mnview, "A", "B");
+        AddPoolLiquidity(mnview, idAB, 1000 * COIN, 1000 * COIN, CScript(1));
+        BOOST_REQUIRE(mnview.Flush());
+    }
+    UpdatePoolGraph(*pcustomcsview);
+
+    CCustomCSView mnview(*pcustomcsview);
+    auto const & changes = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw();
+    BOOST_CHECK(!IsPoolGraphChanged(mnview, changes));
+
+    // rewritten with the same values, as pools rewards do
+    CPoolPair pool = *mnview.GetPoolPair(idAB);
+    BOOST_REQUIRE(mnview.SetPoolPair(idAB, pool).ok);
+    BOOST_CHECK(!IsPoolGraphChanged(mnview, changes));
+
+    pool.blockCommissionA += 1;
+    BOOST_REQUIRE(mnview.SetPoolPair(idAB, pool).ok);
+    BOOST_CHECK(IsPoolGraphChanged(mnview, changes));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -117,6 +117,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         pcriminals.reset();
         pcriminals = MakeUnique<CCriminalsView>(GetDataDir() / "criminals", nMinDbCache << 20, true, true);
 
+        ResetViewSnapshot();
         pcustomcsDB.reset();
         pcustomcsDB = MakeUnique<CStorageLevelDB>(GetDataDir() / "enhancedcs", nMinDbCache << 20, true, true);
         pcustomcsview = MakeUnique<CCustomCSView>(*pcustomcsDB.get());
@@ -161,6 +162,7 @@ TestingSetup::~TestingSetup()
     panchors.reset();
     panchorAwaitingConfirms.reset();
     panchorauths.reset();
+    ResetViewSnapshot();
     pcustomcsview.reset();
     pcustomcsDB.reset();
     pcriminals.reset();
@@ -7,6 +7,7 @@
 #include <masternodes/masternodes.h>
 #include <rpc/rawtransaction_util.h>
 #include <test/setup_common.h>
+#include <validation.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
@@ -332,4 +333,494 @@ BOOST_AUTO_TEST_CASE(for_each_order)
     }
 }
 
+BOOST_AUTO_TEST_CASE(write_buffer)
+{
+    // both flat and tree modes should act as the sorted map
+    for (size_t count : {MapKV::FLAT_LIMIT / 2, MapKV::FLAT_LIMIT * 4}) {
+        MapKV buffer;
+        std::map<TBytes, boost::optional<TBytes>> reference;
+        for (size_t i = 0; i < count; ++i) {
+            auto key = DbTypeToBytes(TestForward{(uint32_t) ((i * 7919) % count)});
+            buffer[key] = {key};
+            reference[key] = {key};
+            if (i % 3 == 0) {
+                buffer[key] = {};
+                reference[key] = {};
+            }
+        }
+        BOOST_CHECK_EQUAL(buffer.size(), reference.size());
+        auto refIt = reference.begin();
+        for (auto it = buffer.begin(); it != buffer.end(); ++it, ++refIt) {
+            BOOST_CHECK(it->first == refIt->first);
+            BOOST_CHECK(it->second == refIt->second);
+        }
+        auto middle = DbTypeToBytes(TestForward{(uint32_t) (count / 2)});
+        BOOST_CHECK(buffer.lower_bound(middle)->first == reference.lower_bound(middle)->first);
+        BOOST_CHECK(buffer.upper_bound(middle)->first == reference.upper_bound(middle)->first);
+        BOOST_CHECK(buffer.find(DbTypeToBytes(std::string("absent"))) == buffer.end());
+
+        buffer.clear();
+        BOOST_CHECK(buffer.empty());
+        BOOST_CHECK(buffer.begin() == buffer.end());
+    }
+
+    // iteration over the layer, which is being modified (and switches to the tree) in process
+    CCustomCSView mnview(*pcustomcsview);
+    for (uint32_t i = 0; i < 10; ++i) {
+        mnview.WriteBy<TestForward>(TestForward{i * 2}, i);
+    }
+    uint32_t test = 0;
+    mnview.ForEach<TestForward, TestForward, int>([&] (TestForward const & key, int & value) {
+        BOOST_CHECK(key.n == test * 2);
+        BOOST_CHECK(value == (int) test);
+        for (size_t i = 0; i < MapKV::FLAT_LIMIT / 4; ++i) {
+            mnview.Write(std::make_pair('a', std::make_pair(test, (uint32_t) i)), test); // out of iterated range
+        }
+        mnview.WriteBy<TestForward>(key, value); // overwrite current
+        ++test;
+        return true;
+    });
+    BOOST_CHECK(test == 10);
+}
+
+BOOST_AUTO_TEST_CASE(layers_reuse)
+{
+    // spare entries of the cleared buffer don't leak their values
+    MapKV buffer;
+    for (uint32_t i = 0; i < 10; ++i) {
+        buffer.Set(DbTypeToBytes(TestForward{i}), ToBytes("value"));
+    }
+    buffer.clear();
+    buffer[DbTypeToBytes(TestForward{5})];
+    buffer.Set(DbTypeToBytes(TestForward{3}), ToBytes("new"));
+    BOOST_CHECK_EQUAL(buffer.size(), 2);
+    BOOST_CHECK(!buffer.find(DbTypeToBytes(TestForward{5}))->second);
+    BOOST_CHECK(*buffer.find(DbTypeToBytes(TestForward{3}))->second == ToBytes("new"));
+    BOOST_CHECK(buffer.find(DbTypeToBytes(TestForward{4})) == buffer.end());
+    BOOST_CHECK(buffer.begin()->first == DbTypeToBytes(TestForward{3}));
+
+    CCustomCSView first(*pcustomcsview), second(*pcustomcsview);
+    first.Write(std::string("layerkey"), std::string("first"));
+    second.Write(std::string("layerkey"), std::string("second"));
+
+    // the layer is returned to the pool and comes back clean over the new parent
+    CCustomCSView * pooled;
+    {
+        CCustomCSViewLayer layer(first);
+        pooled = &*layer;
+        layer->Write(std::string("layerkey2"), std::string("value"));
+
+        // serialized undo is the same as the one of CUndo
+        auto& flushable = dynamic_cast<CFlushableStorageKV&>(layer->GetRaw());
+        CUndoBuilder builder;
+        BOOST_CHECK(builder.Construct(first.GetRaw(), flushable.GetRaw()));
+        BOOST_CHECK(builder.GetBytes() == DbTypeToBytes(CUndo::Construct(first.GetRaw(), flushable.GetRaw())));
+    }
+    {
+        CCustomCSViewLayer layer(second);
+        BOOST_CHECK(&*layer == pooled);
+        std::string value;
+        BOOST_CHECK(layer->Read(std::string("layerkey"), value) && value == "second");
+        BOOST_CHECK(!layer->Exists(std::string("layerkey2")));
+        BOOST_CHECK(!CUndoBuilder().Construct(second.GetRaw(), dynamic_cast<CFlushableStorageKV&>(layer->GetRaw()).GetRaw()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(account_history_index)
+{
+    CCustomCSView mnview(*pcustomcsview);
+    CScript const owner1 = CScript(1), owner2 = CScript(2);
+    mnview.SetAccountHistory(owner1, 10, 1, uint256S("0x1"), 'A', TAmounts{{DCT_ID{0}, 10}});
+    mnview.SetAccountHistory(owner2, 10, 2, uint256S("0x2"), 'A', TAmounts{{DCT_ID{1}, 20}});
+    mnview.SetAccountHistory(owner2, 12, 0, uint256S("0x3"), 'A', TAmounts{{DCT_ID{0}, 30}, {DCT_ID{1}, 30}});
+    mnview.SetAccountHistory(owner1, 15, 0, uint256S("0x4"), 'A', TAmounts{{DCT_ID{1}, 40}});
+
+    // latest heights (and txns) go first, regardless of owners
+    std::vector<uint256> txids;
+    mnview.ForEachAccountHistoryByHeight([&] (CScript const &, uint32_t, uint32_t, uint256 const & txid, unsigned char, TAmounts const &) {
+        txids.push_back(txid);
+        return true;
+    }, 12);
+    BOOST_CHECK(txids == std::vector<uint256>({uint256S("0x3"), uint256S("0x2"), uint256S("0x1")}));
+
+    txids.clear();
+    mnview.ForEachAccountHistoryByToken(DCT_ID{1}, [&] (CScript const &, uint32_t, uint32_t, uint256 const & txid, unsigned char, TAmounts const &) {
+        txids.push_back(txid);
+        return true;
+    }, std::numeric_limits<uint32_t>::max());
+    BOOST_CHECK(txids == std::vector<uint256>({uint256S("0x4"), uint256S("0x3"), uint256S("0x2")}));
+
+    // one-time indexing goes by batches and is idempotent
+    auto start = CAccountsHistoryView::FirstAccountHistoryKey();
+    uint64_t records = 0;
+    BOOST_CHECK(mnview.BuildAccountHistoryIndex(3, start, records));
+    BOOST_CHECK_EQUAL(records, 3);
+    BOOST_CHECK(!mnview.BuildAccountHistoryIndex(3, start, records));
+    BOOST_CHECK_EQUAL(records, 1);
+    BOOST_CHECK(!mnview.BuildAccountHistoryIndex(3, start, records));
+    BOOST_CHECK_EQUAL(records, 0);
+}
+
+BOOST_AUTO_TEST_CASE(undo_pruning)
+{
+    // own db, genesis undos of pcustomcsview would take part in the batches
+    CStorageLevelDB db(fs::path("undo_pruning"), 1 << 20, true);
+    CCustomCSView mnview(db);
+    for (uint32_t height = 1; height <= 5; ++height) {
+        mnview.SetUndo(UndoKey{height, uint256()}, CUndo{});
+        mnview.SetUndo(UndoKey{height, uint256S("0x1")}, CUndo{});
+    }
+
+    uint64_t records = 0, bytes = 0;
+    // batch limit is reached in the middle of height 2, which is pruned up to the end
+    BOOST_CHECK(mnview.PruneUndos(4, 3, records, bytes).ok);
+    BOOST_CHECK_EQUAL(records, 4);
+    BOOST_CHECK(bytes > 0);
+    BOOST_CHECK_EQUAL(mnview.GetUndosPrunedHeight(), 3);
+    BOOST_CHECK(!mnview.GetUndo(UndoKey{2, uint256()}));
+    BOOST_CHECK(!mnview.GetUndo(UndoKey{2, uint256S("0x1")}));
+    BOOST_CHECK(mnview.GetUndo(UndoKey{3, uint256()}));
+
+    BOOST_CHECK(mnview.PruneUndos(4, 100, records, bytes).ok);
+    BOOST_CHECK_EQUAL(records, 2);
+    BOOST_CHECK_EQUAL(mnview.GetUndosPrunedHeight(), 4);
+    BOOST_CHECK(mnview.GetUndo(UndoKey{4, uint256()}));
+
+    // nothing below pruned height anymore
+    BOOST_CHECK(mnview.PruneUndos(3, 100, records, bytes).ok);
+    BOOST_CHECK_EQUAL(records, 0);
+    BOOST_CHECK_EQUAL(mnview.GetUndosPrunedHeight(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(changed_balances)
+{
+    CScript const owner1 = CScript(1), owner2 = CScript(2), owner3 = CScript(3);
+    CCustomCSView base(*pcustomcsview);
+    base.AddBalance(owner1, {DCT_ID{0}, 10});
+    base.AddBalance(owner2, {DCT_ID{1}, 20});
+    base.AddBalance(owner3, {DCT_ID{0}, 30});
+
+    CCustomCSView mnview(base);
+    mnview.AddBalance(owner1, {DCT_ID{0}, 5});
+    mnview.AddBalance(owner1, {DCT_ID{2}, 1});
+    mnview.SubBalance(owner2, {DCT_ID{1}, 20});
+    mnview.Write(std::make_pair((unsigned char) (CAccountsView::ByBalanceKey::prefix + 1), owner3), CAmount{0}); // next prefix isn't a balance
+
+    // absolute values of the touched balances only, erased ones go as zero
+    auto const changed = mnview.GetChangedBalances(dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw());
+    BOOST_CHECK_EQUAL(changed.size(), 2);
+    BOOST_CHECK(changed.at(owner1).balances == (TAmounts{{DCT_ID{0}, 15}, {DCT_ID{2}, 1}}));
+    BOOST_CHECK(changed.at(owner2).balances == (TAmounts{{DCT_ID{1}, 0}}));
+}
+
+BOOST_AUTO_TEST_CASE(disconnect_keeps_interned_owners)
+{
+    CScript const owner = CScript() << OP_TRUE << 0x42;
+    uint32_t const height = 7;
+    uint256 const txid = uint256S("0x7");
+
+    // the block which interns the owner for the first time
+    {
+        CCustomCSView block(*pcustomcsview);
+        CCustomCSView cache(block);
+        cache.AddBalance(owner, {DCT_ID{0}, 10});
+        auto & flushable = dynamic_cast<CFlushableStorageKV&>(cache.GetRaw());
+        CUndoBuilder builder;
+        BOOST_REQUIRE(builder.Construct(block.GetRaw(), flushable.GetRaw()));
+        block.SetUndo(UndoKey{height, txid}, builder.GetBytes());
+        cache.Flush();
+        block.Flush();
+    }
+    BOOST_REQUIRE(pcustomcsview->GetOwner(GetOwnerID(owner)));
+
+    // its disconnect, the same way as DisconnectTip goes
+    CCustomCSView mnview(*pcustomcsview);
+    mnview.OnUndoTx(txid, height);
+    BOOST_CHECK(!mnview.GetUndo(UndoKey{height, txid}));
+    BOOST_CHECK_EQUAL(mnview.GetBalance(owner, DCT_ID{0}).nValue, 0);
+    BOOST_CHECK(mnview.GetOwner(GetOwnerID(owner)));
+
+    auto const changed = mnview.GetChangedBalances(dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw());
+    BOOST_REQUIRE_EQUAL(changed.size(), 1);
+    BOOST_CHECK(changed.at(owner).balances == (TAmounts{{DCT_ID{0}, 0}}));
+}
+
+BOOST_AUTO_TEST_CASE(owner_keys_upgrade)
+{
+    CStorageLevelDB db(fs::path("owner_keys_upgrade"), 1 << 20, true);
+    CCustomCSView mnview(db);
+    CScript const owner1 = CScript(1), owner2 = CScript(2);
+
+    // script keyed records of the older versions
+    auto const legacyBalance = std::make_pair((unsigned char) 'a', BalanceKey{owner1, DCT_ID{1}});
+    mnview.Write(legacyBalance, CAmount{10});
+    mnview.Write(std::make_pair((unsigned char) 'a', BalanceKey{owner2, DCT_ID{0}}), CAmount{20});
+    mnview.Write(std::make_pair((unsigned char) 'k', PoolShareKey{DCT_ID{1}, owner1}), '\0');
+    CUndo undo;
+    undo.before[DbTypeToBytes(legacyBalance)] = DbTypeToBytes(CAmount{5});
+    mnview.SetUndo(UndoKey{1, uint256()}, undo);
+    mnview.SetUndo(UndoKey{2, uint256()}, undo);
+
+    uint32_t undoHeight = 0;
+    uint64_t records = 0, total = 0;
+    int calls = 1;
+    for (; mnview.UpgradeOwnerKeys(2, undoHeight, records); ++calls) {
+        total += records;
+    }
+    total += records;
+    BOOST_CHECK_EQUAL(total, 5);
+    BOOST_CHECK_EQUAL(calls, 3);
+
+    BOOST_CHECK(!mnview.Exists(legacyBalance));
+    BOOST_CHECK_EQUAL(mnview.GetBalance(owner1, DCT_ID{1}).nValue, 10);
+    BOOST_CHECK_EQUAL(mnview.GetBalance(owner2, DCT_ID{0}).nValue, 20);
+    std::vector<CScript> providers;
+    mnview.ForEachPoolShare([&] (DCT_ID const & id, CScript const & provider) {
+        BOOST_CHECK(id == DCT_ID{1});
+        providers.push_back(provider);
+        return true;
+    });
+    BOOST_CHECK(providers == std::vector<CScript>{owner1});
+
+    // undos revert into the compact table
+    CUndo::Revert(mnview.GetRaw(), *mnview.GetUndo(UndoKey{2, uint256()}));
+    BOOST_CHECK_EQUAL(mnview.GetBalance(owner1, DCT_ID{1}).nValue, 5);
+
+    // already up to date
+    BOOST_CHECK(!mnview.UpgradeOwnerKeys(2, undoHeight, records));
+    BOOST_CHECK_EQUAL(records, 0);
+}
+
+BOOST_AUTO_TEST_CASE(view_snapshot)
+{
+    CStorageLevelDB db(fs::path("view_snapshot"), 1 << 20, true);
+    CCustomCSView base(db);
+    CScript const owner1 = CScript(1), owner2 = CScript(2);
+    base.AddBalance(owner1, {DCT_ID{0}, 10});
+    base.Flush();
+    db.Flush();
+
+    CCustomCSView mnview(base);
+    mnview.AddBalance(owner2, {DCT_ID{0}, 20}); // in-memory only
+    CCustomCSView snapshot(mnview.GetRaw().Snapshot());
+
+    // later changes of both the disk and the memory layer aren't visible to the snapshot
+    mnview.AddBalance(owner1, {DCT_ID{0}, 1});
+    mnview.SubBalance(owner2, {DCT_ID{0}, 20});
+    mnview.Flush();
+    base.Flush();
+    db.Flush();
+    BOOST_CHECK_EQUAL(base.GetBalance(owner1, DCT_ID{0}).nValue, 11);
+    BOOST_CHECK_EQUAL(base.GetBalance(owner2, DCT_ID{0}).nValue, 0);
+
+    BOOST_CHECK_EQUAL(snapshot.GetBalance(owner1, DCT_ID{0}).nValue, 10);
+    BOOST_CHECK_EQUAL(snapshot.GetBalance(owner2, DCT_ID{0}).nValue, 20);
+    int count = 0;
+    snapshot.ForEachBalance([&] (CScript const &, CTokenAmount const &) {
+        ++count;
+        return true;
+    });
+    BOOST_CHECK_EQUAL(count, 2);
+}
+
+BOOST_AUTO_TEST_CASE(tokens_table)
+{
+    CCustomCSView mnview(*pcustomcsview);
+    CTokenImplementation dat, token;
+    dat.symbol = "GOLD";
+    dat.flags |= (uint8_t)CToken::TokenFlags::DAT;
+    dat.creationTx = uint256S("0x1111");
+    token.symbol = "SILVER";
+    token.creationTx = uint256S("0x2222");
+    BOOST_REQUIRE(mnview.CreateToken(dat, false).ok);
+    BOOST_REQUIRE(mnview.CreateToken(token, false).ok);
+
+    CTokensTable const table(mnview, 7);
+    BOOST_CHECK_EQUAL(table.GetVersion(), 7);
+    BOOST_REQUIRE_EQUAL(table.GetTokens().size(), 3);
+
+    // the same lookups as the view does
+    for (std::string const & key : std::vector<std::string>{"", "0", "1", "128", "129", "DFI", "GOLD", "SILVER", "SILVER#128", "0x1111", uint256S("0x2222").GetHex(), "  GOLD ", "NONE"}) {
+        DCT_ID id{};
+        auto expected = mnview.GetTokenGuessId(key, id);
+        auto entry = table.GetGuessId(key);
+        BOOST_REQUIRE_MESSAGE(bool(expected) == bool(entry), key);
+        if (entry) {
+            BOOST_CHECK(entry->id == id);
+            BOOST_CHECK_EQUAL(entry->token.symbol, expected->symbol);
+            BOOST_CHECK_EQUAL(entry->token.flags, expected->flags);
+        }
+    }
+    BOOST_CHECK(table.Get(DCT_ID{128})->token.creationTx == uint256S("0x2222"));
+    BOOST_CHECK(!table.Get(DCT_ID{1000}));
+
+    // varint keys of ids from 16512 sort before the smaller ones
+    CTokenImplementation high;
+    high.symbol = "BRONZE";
+    high.creationTx = uint256S("0x3333");
+    mnview.Write(CTokensView::LastDctId::prefix, DCT_ID{20000});
+    auto const highId = mnview.CreateToken(high, false);
+    BOOST_REQUIRE(highId.ok);
+    BOOST_REQUIRE_EQUAL(highId.val->v, 20001);
+    {
+        CTokensTable const highTable(mnview, 0);
+        BOOST_REQUIRE(highTable.Get(DCT_ID{20001}));
+        BOOST_CHECK_EQUAL(highTable.Get(DCT_ID{20001})->token.symbol, "BRONZE");
+        BOOST_CHECK(highTable.Get(DCT_ID{128})->token.creationTx == uint256S("0x2222"));
+        BOOST_CHECK(highTable.GetGuessId("BRONZE#20001")->id == DCT_ID{20001});
+    }
+
+    // only token records make the table outdated
+    auto const & changes = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw();
+    BOOST_CHECK(CTokensView::AreTokensChanged(changes));
+    mnview.Flush();
+    mnview.AddBalance(CScript(1), {DCT_ID{0}, 10});
+    BOOST_CHECK(!CTokensView::AreTokensChanged(changes));
+    BOOST_REQUIRE(mnview.AddMintedTokens(uint256S("0x2222"), 10).ok);
+    BOOST_CHECK(CTokensView::AreTokensChanged(changes));
+
+    // snapshots hold the table they were given, other views build their own
+    auto const shared = std::make_shared<const CTokensTable>(mnview, 8);
+    CCustomCSView snapshot(mnview.GetRaw().Snapshot(), shared);
+    BOOST_CHECK(snapshot.GetTokensTable() == shared);
+    auto const own = mnview.GetTokensTable();
+    BOOST_CHECK(own != shared);
+    BOOST_CHECK_EQUAL(own->Get(DCT_ID{128})->token.minted, 10);
+}
+
+static CKeyID KeyID(std::string const & hex)
+{
+    CKeyID key;
+    key.SetHex(hex);
+    return key;
+}
+
+static void CheckSameRegistry(CMasternodesRegistry const & a, CMasternodesRegistry const & b)
+{
+    BOOST_CHECK_EQUAL(a.GetHeight(), b.GetHeight());
+    BOOST_REQUIRE_EQUAL(a.GetNodesCount(), b.GetNodesCount());
+    std::vector<uint256> ids;
+    a.ForEachNode([&] (CMasternodesRegistry::Entry const & entry) {
+        auto const other = b.Get(entry.id);
+        BOOST_REQUIRE(other);
+        BOOST_CHECK(entry.node == other->node);
+        BOOST_CHECK(a.GetByOperator(entry.node.operatorAuthAddress) == &entry);
+        BOOST_CHECK(b.GetByOwner(entry.node.ownerAuthAddress) == other);
+        ids.push_back(entry.id);
+        return true;
+    });
+    BOOST_CHECK_EQUAL(ids.size(), a.GetNodesCount());
+    BOOST_CHECK(std::is_sorted(ids.begin(), ids.end()));
+    BOOST_CHECK(a.GetCandidates() == b.GetCandidates());
+}
+
+BOOST_AUTO_TEST_CASE(masternodes_registry)
+{
+    CCustomCSView base(*pcustomcsview);
+    CMasternodesRegistry const initial(base, 0);
+    BOOST_REQUIRE(initial.GetNodesCount() != 0); // genesis ones
+    std::vector<CMasternodesRegistry::Entry> initialNodes;
+    initial.ForEachNode([&] (CMasternodesRegistry::Entry const & entry) {
+        initialNodes.push_back(entry);
+        return true;
+    });
+
+    // a block: new nodes, a resign and a minted block
+    CCustomCSView block(base);
+    CMasternode node;
+    node.ownerType = node.operatorType = 1;
+    node.ownerAuthAddress = KeyID("0x1001");
+    node.operatorAuthAddress = KeyID("0x1002");
+    BOOST_REQUIRE(block.CreateMasternode(uint256S("0x0a"), node).ok);
+    node.ownerAuthAddress = KeyID("0x2001");
+    node.operatorAuthAddress = KeyID("0x2001");
+    BOOST_REQUIRE(block.CreateMasternode(uint256S("0xff"), node).ok);
+    auto const & genesisNode = initialNodes.front();
+    BOOST_REQUIRE(block.ResignMasternode(genesisNode.id, uint256S("0x0b"), 0).ok);
+    block.IncrementMintedBy(initialNodes.back().node.operatorAuthAddress);
+
+    auto const & changes = dynamic_cast<CFlushableStorageKV&>(block.GetRaw()).GetRaw();
+    BOOST_CHECK(CMasternodesRegistry::AreMasternodesChanged(changes));
+    CMasternodesRegistry const connected(initial, changes, 0);
+    CheckSameRegistry(connected, CMasternodesRegistry(block, 0));
+    BOOST_CHECK(connected.Get(uint256S("0x0a"))->node.ownerAuthAddress == KeyID("0x1001"));
+    BOOST_CHECK(connected.GetByOperator(KeyID("0x2001"))->id == uint256S("0xff"));
+    BOOST_CHECK(!connected.GetByOperator(KeyID("0x1001")));
+    BOOST_CHECK(connected.AmIOperator(KeyID("0x1002"))->second == uint256S("0x0a"));
+    for (auto const & stakeModifier : {uint256S("0x01"), uint256S("0x02"), uint256S("0x03")}) {
+        BOOST_CHECK(connected.CalcNextTeam(stakeModifier, ::ChainActive().Height()) == block.CalcNextTeam(stakeModifier));
+    }
+
+    // the same records written back by the undo bring the initial state back
+    block.Flush();
+    CCustomCSView undo(base);
+    for (auto const & id : {uint256S("0x0a"), uint256S("0xff")}) {
+        auto const created = connected.Get(id)->node;
+        undo.GetRaw().Erase(DbTypeToBytes(std::make_pair(CMasternodesView::ID::prefix, id)));
+        undo.GetRaw().Erase(DbTypeToBytes(std::make_pair(CMasternodesView::Operator::prefix, created.operatorAuthAddress)));
+        undo.GetRaw().Erase(DbTypeToBytes(std::make_pair(CMasternodesView::Owner::prefix, created.ownerAuthAddress)));
+    }
+    for (auto const & entry : initialNodes) {
+        if (!(connected.Get(entry.id)->node == entry.node)) {
+            undo.GetRaw().Write(DbTypeToBytes(std::make_pair(CMasternodesView::ID::prefix, entry.id)), DbTypeToBytes(entry.node));
+        }
+    }
+    CMasternodesRegistry const disconnected(connected, dynamic_cast<CFlushableStorageKV&>(undo.GetRaw()).GetRaw(), 0);
+    CheckSameRegistry(disconnected, initial);
+    CheckSameRegistry(disconnected, CMasternodesRegistry(undo, 0));
+
+    // resigned nodes leave the candidates once the resign delay is over
+    auto const later = connected.GetHeight() + GetMnResignDelay();
+    CMasternodesRegistry const aged(connected, MapKV{}, later);
+    BOOST_CHECK_EQUAL(aged.GetCandidates().size(), connected.GetCandidates().size() - 1);
+    BOOST_CHECK(aged.CalcNextTeam(uint256S("0x01"), later) == CMasternodesRegistry(block, 0).CalcNextTeam(uint256S("0x01"), later));
+    // by every height step or by a jump, back and forth across the final height
+    CMasternodesRegistry stepped(connected, MapKV{}, connected.GetHeight());
+    for (auto h = connected.GetHeight() + 1; h <= later + 1; ++h) {
+        stepped = CMasternodesRegistry(stepped, MapKV{}, h);
+    }
+    CheckSameRegistry(stepped, CMasternodesRegistry(block, later + 1));
+    CheckSameRegistry(CMasternodesRegistry(aged, MapKV{}, later + 1000), CMasternodesRegistry(block, later + 1000));
+    CheckSameRegistry(CMasternodesRegistry(stepped, MapKV{}, later - 1), CMasternodesRegistry(block, later - 1));
+    CheckSameRegistry(CMasternodesRegistry(aged, MapKV{}, 0), connected);
+}
+
+BOOST_AUTO_TEST_CASE(row_cache)
+{
+    CStorageLevelDB db(fs::path("row_cache"), 1 << 20, true);
+    db.EnableRowCache(1 << 20, {'a'});
+    auto const stats = [&db] () { return db.GetRowCache()->GetStats(); };
+
+    TBytes value;
+    BOOST_CHECK(!db.Read(ToBytes("a1"), value)); // absence is cached as well
+    BOOST_CHECK(!db.Exists(ToBytes("a1")));
+    BOOST_CHECK_EQUAL(stats().misses, 1);
+    BOOST_CHECK_EQUAL(stats().hits, 1);
+
+    // writes go through the cache
+    BOOST_CHECK(db.Write(ToBytes("a1"), ToBytes("v1")));
+    BOOST_CHECK(db.Write(ToBytes("b1"), ToBytes("v1")));
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.Read(ToBytes("a1"), value));
+    BOOST_CHECK(value == ToBytes("v1"));
+    BOOST_CHECK(db.Read(ToBytes("b1"), value)); // not a cached prefix
+    BOOST_CHECK_EQUAL(stats().hits, 2);
+    BOOST_CHECK_EQUAL(stats().entries, 1);
+
+    BOOST_CHECK(db.Erase(ToBytes("a1")));
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(!db.Read(ToBytes("a1"), value));
+    BOOST_CHECK_EQUAL(stats().hits, 3);
+
+    // evicted from the tail when the limit is exceeded
+    CStorageLevelDB small(fs::path("row_cache_small"), 1 << 20, true);
+    small.EnableRowCache(1000, {'a'});
+    for (int i = 0; i < 100; ++i) {
+        small.Write(ToBytes(("a" + std::to_string(i)).c_str()), ToBytes("value"));
+    }
+    auto const smallStats = small.GetRowCache()->GetStats();
+    BOOST_CHECK(smallStats.usage <= smallStats.limit);
+    BOOST_CHECK(smallStats.entries > 0 && smallStats.entries < 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
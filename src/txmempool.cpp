@@ -334,6 +334,8 @@ CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
     nCheckFrequency = 0;
 }
 
+CTxMemPool::~CTxMemPool() = default;
+
 bool CTxMemPool::isSpent(const COutPoint& outpoint) const
 {
     LOCK(cs);
@@ -408,6 +410,10 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
+    if (!customTxs.empty() && customTxDecodeCache.Decode(it->GetTx())->type != CustomTxType::None) {
+        customViewDirty = true;
+    }
+
     if (vTxHashes.size() > 1) {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
         vTxHashes[it->vTxHashesIdx].second->vTxHashesIdx = it->vTxHashesIdx;
@@ -586,6 +592,8 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    customTxs.clear();
+    customViewDirty = true;
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -896,6 +904,52 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
     return true;
 }
 
+CCustomCSView& CTxMemPool::GetCustomView(const Consensus::Params& consensus)
+{
+    AssertLockHeld(cs);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    const uint256 tipHash = tip ? tip->GetBlockHash() : uint256();
+    if (customView && !customViewDirty && customViewBase == pcustomcsview.get() && customViewTip == tipHash) {
+        return *customView;
+    }
+
+    if (customView) {
+        customView->Reset(*pcustomcsview);
+    } else {
+        customView = MakeUnique<CCustomCSView>(*pcustomcsview);
+    }
+    customViewBase = pcustomcsview.get();
+    customViewTip = tipHash;
+    customViewDirty = false;
+
+    // apply the remaining txs to the new tip, in the same order
+    CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), *this);
+    CCoinsViewCache coins(&viewMemPool);
+    const uint32_t height = ::ChainActive().Height() + 1;
+    size_t applied = 0;
+    for (const auto& tx : customTxs) {
+        if (exists(tx->GetHash()) && ApplyCustomTx(*customView, coins, *tx, consensus, height, 0, false).ok) {
+            customTxs[applied++] = tx;
+        }
+    }
+    if (applied != customTxs.size()) {
+        LogPrint(BCLog::MEMPOOL, "%s: %u custom txs left out of the view, %u applied\n", __func__, customTxs.size() - applied, applied);
+    }
+    customTxs.resize(applied);
+    return *customView;
+}
+
+void CTxMemPool::AddToCustomView(const CTransactionRef& tx, CCustomCSView* applied)
+{
+    AssertLockHeld(cs);
+    if (!applied) {
+        customViewDirty = true;
+    } else if (!customViewDirty) { // otherwise the view will be built anew anyway
+        applied->Flush();
+    }
+    customTxs.push_back(tx);
+}
+
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) { }
 
 bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
@@ -33,6 +33,10 @@ class CBlockIndex;
 class CCustomCSView;
 extern CCriticalSection cs_main;
 
+namespace Consensus {
+struct Params;
+}
+
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
@@ -458,6 +462,12 @@ private:
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    std::unique_ptr<CCustomCSView> customView GUARDED_BY(cs); //!< DeFi state of the tip with the pool's custom txs applied
+    std::vector<CTransactionRef> customTxs GUARDED_BY(cs); //!< custom txs applied to customView, in acceptance order
+    const CCustomCSView* customViewBase GUARDED_BY(cs){nullptr}; //!< tip view and block customView was built upon
+    uint256 customViewTip GUARDED_BY(cs);
+    bool customViewDirty GUARDED_BY(cs){true}; //!< some of customTxs left the pool
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -554,6 +564,7 @@ public:
     /** Create a new CTxMemPool.
      */
     explicit CTxMemPool(CBlockPolicyEstimator* estimator = nullptr);
+    ~CTxMemPool();
 
     /**
      * If sanity-checking is turned on, check makes sure the pool is
@@ -592,6 +603,15 @@ public:
      */
     bool HasNoInputsOf(const CTransaction& tx) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /**
+     * DeFi state of the tip with the custom txs of the pool applied in acceptance order.
+     * Once the tip changes or any of these txs leaves the pool, the view is built anew: the remaining txs are applied
+     * to the new tip again and those which fail now are left out of it (they stay in the pool).
+     */
+    CCustomCSView& GetCustomView(const Consensus::Params& consensus) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /** Adds the accepted custom tx to the view, 'applied' is the layer over GetCustomView() with the tx applied (or null to build the view anew) */
+    void AddToCustomView(const CTransactionRef& tx, CCustomCSView* applied) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+
     /** Affect CreateNewBlock prioritisation of transactions */
     void PrioritiseTransaction(const uint256& hash, const CAmount& nFeeDelta);
     void ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const;
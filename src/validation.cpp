@@ -120,6 +120,7 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 int nScriptCheckThreads = 0;
+bool fParallelCustomTx = DEFAULT_PARALLEL_CUSTOMTX;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -401,6 +402,7 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
     // remove affected MintTokenTxs
     /// @todo tokens: refactor to mempool method?
     if (possibleMintTokenAffected) {
+        auto const tokens = GetTokensTable();
         std::vector<uint256> mintTokensToRemove; // not sure about tx refs safety while recursive deletion, so hashes
         for (const CTxMemPoolEntry& e : mempool.mapTx) {
             auto tx = e.GetTx();
@@ -410,7 +412,7 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
                     if (pair.first == DCT_ID{0})
                         continue;
                     // remove only if token does not exist any more
-                    if (!pcustomcsview->GetToken(pair.first)) {
+                    if (!tokens->Get(pair.first)) {
                         mintTokensToRemove.push_back(tx.GetHash());
                     }
                 }
@@ -606,6 +608,21 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
         }
 
+        // custom tx has to apply on top of the pool's ones, otherwise the block would skip it and it just wastes the space.
+        // it's up to the pool's state, so this is the policy, not a consensus failure.
+        // replacement is checked against the tip only, as the pool's state includes the txs it replaces
+        const bool fReplacing = !setConflicts.empty();
+        // the overlay (and the pool's view behind it) is built for custom txs only
+        std::unique_ptr<CCustomCSViewLayer> customLayer;
+        const bool isCustomTx = customTxDecodeCache.Decode(tx)->type != CustomTxType::None;
+        if (isCustomTx) {
+            customLayer = MakeUnique<CCustomCSViewLayer>(fReplacing ? *pcustomcsview : pool.GetCustomView(chainparams.GetConsensus()));
+            auto res = ApplyCustomTx(**customLayer, view, tx, chainparams.GetConsensus(), GetSpendHeight(view), 0, false);
+            if (!res.ok) {
+                return state.Invalid(ValidationInvalidReason::TX_MEMPOOL_POLICY, false, REJECT_INVALID, "bad-txns-customtx", res.msg);
+            }
+        }
+
         // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
         view.SetBackend(dummy);
 
@@ -894,6 +911,9 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         // Store transaction in memory
         pool.addUnchecked(entry, setAncestors, validForFeeEstimation);
+        if (isCustomTx) {
+            pool.AddToCustomView(ptx, fReplacing ? nullptr : &**customLayer);
+        }
 
         // trim mempool and check if tx was trimmed
         if (!bypass_limits) {
@@ -1593,6 +1613,11 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         return DISCONNECT_FAILED;
     }
 
+    if ((uint32_t) pindex->nHeight < mnview.GetUndosPrunedHeight()) {
+        error("DisconnectBlock(): mnview: undo data for height %d is pruned (pruned height: %d)", pindex->nHeight, mnview.GetUndosPrunedHeight());
+        return DISCONNECT_FAILED;
+    }
+
     // special case: possible undo (first) of custom 'complex changes' for the whole block (expired orders and/or prices)
     mnview.OnUndoTx(uint256(), (uint32_t) pindex->nHeight); // undo for "zero hash"
 
@@ -1729,6 +1754,13 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CCustomTxSpeculator::Check> customtxqueue(16);
+
+void ThreadCustomTxSpeculation(int worker_num) {
+    util::ThreadRename(strprintf("customtx.%i", worker_num));
+    customtxqueue.Thread();
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2098,6 +2130,19 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     CBlockUndo blockundo;
 
+    // custom txs are applied speculatively against 'mnview' as it is now, then the loop below commits them in block order.
+    // everything the loop writes goes to 'blockview', so 'mnview' stays intact for the speculations and the conflicts are visible
+    CCustomCSView blockview(mnview);
+    CCustomTxSpeculator speculator(mnview, pindex->nHeight, chainparams.GetConsensus(), fJustCheck);
+    if (fParallelCustomTx && nScriptCheckThreads) {
+        auto speculations = speculator.Prepare(block, view);
+        if (speculations.size() >= PARALLEL_CUSTOMTX_MIN) {
+            CCheckQueueControl<CCustomTxSpeculator::Check> speculation(&customtxqueue);
+            speculation.Add(speculations);
+            speculation.Wait();
+        }
+    }
+
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
     std::vector<int> prevheights;
@@ -2116,7 +2161,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         if (!tx.IsCoinBase())
         {
             CAmount txfee = 0;
-            if (!Consensus::CheckTxInputs(tx, state, view, &mnview, pindex->nHeight, txfee)) {
+            if (!Consensus::CheckTxInputs(tx, state, view, &blockview, pindex->nHeight, txfee)) {
                 if (!IsBlockReason(state.GetReason())) {
                     // CheckTxInputs may return MISSING_INPUTS or
                     // PREMATURE_SPEND but we can't return that, as it's not
@@ -2176,7 +2221,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                     tx.GetHash().ToString(), FormatStateMessage(state));
             }
 
-            const auto res = ApplyCustomTx(mnview, view, tx, chainparams.GetConsensus(), pindex->nHeight, i, fJustCheck);
+            const auto res = speculator.Apply(blockview, view, tx, i);
             if (!res.ok && (res.code & CustomTxErrCodes::Fatal)) {
                 // we will never fail, but skip, unless transaction mints UTXOs
                 return error("ConnectBlock(): ApplyCustomTx on %s failed with %s",
@@ -2201,7 +2246,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                                                tx.GetValueOut()),
                                          REJECT_INVALID, "bad-cr-amount");
                 }
-                if (mnview.BanCriminal(tx.GetHash(), metadata, block.height)) {
+                if (blockview.BanCriminal(tx.GetHash(), metadata, block.height)) {
                     // already checked if we are here
                     /// @todo criminals: refactor
                     std::pair<CBlockHeader, CBlockHeader> criminal;
@@ -2215,7 +2260,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 if (!fJustCheck) {
                     LogPrintf("ConnectBlock(): connecting finalization tx: %s block: %d\n", tx.GetHash().GetHex(), block.height);
                 }
-                ResVal<uint256> res = ApplyAnchorRewardTx(mnview, tx, pindex->nHeight, pindex->pprev ? pindex->pprev->stakeModifier : uint256(), metadata, chainparams.GetConsensus());
+                ResVal<uint256> res = ApplyAnchorRewardTx(blockview, tx, pindex->nHeight, pindex->pprev ? pindex->pprev->stakeModifier : uint256(), metadata, chainparams.GetConsensus());
                 if (!res.ok) {
                     return state.Invalid(ValidationInvalidReason::CONSENSUS,
                                          error("ConnectBlock(): %s", res.msg),
@@ -2234,6 +2279,10 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
     }
+    blockview.Flush();
+    if (speculator.GetCommitted() + speculator.GetReapplied() > 0) {
+        LogPrint(BCLog::BENCH, "      - Custom txs speculation: %u committed, %u reapplied\n", speculator.GetCommitted(), speculator.GetReapplied());
+    }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
@@ -2559,8 +2608,23 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         std::map<uint256, CDoubleSignFact> disconnectedCriminals;
         if (DisconnectBlock(block, pindexDelete, view, mnview, disconnectedConfirms, disconnectedCriminals) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        auto const & changes = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw();
+        auto changedBalances = std::make_shared<const CAccounts>(mnview.GetChangedBalances(changes));
+        bool const tokensChanged = CTokensView::AreTokensChanged(changes);
+        bool const poolsChanged = IsPoolGraphChanged(mnview, changes);
+        UpdateMasternodesRegistry(mnview, changes);
         bool flushed = view.Flush() && mnview.Flush();
         assert(flushed);
+        if (tokensChanged) {
+            UpdateTokensTable(*pcustomcsview);
+        }
+        InvalidateViewSnapshot();
+        if (poolsChanged) {
+            UpdatePoolGraph(*pcustomcsview);
+        }
+        if (!changedBalances->empty()) {
+            GetMainSignals().AccountBalancesChanged(changedBalances);
+        }
 
         if (!disconnectedConfirms.empty()) {
             for (auto const & confirm : disconnectedConfirms) {
@@ -2572,6 +2636,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         for (auto const & cr : disconnectedCriminals) {
             pcriminals->AddCriminalProof(cr.first, cr.second.blockHeader, cr.second.conflictBlockHeader);
         }
+        pcriminals->Flush();
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2707,8 +2772,23 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        auto const & changes = dynamic_cast<CFlushableStorageKV&>(mnview.GetRaw()).GetRaw();
+        auto changedBalances = std::make_shared<const CAccounts>(mnview.GetChangedBalances(changes));
+        bool const tokensChanged = CTokensView::AreTokensChanged(changes);
+        bool const poolsChanged = IsPoolGraphChanged(mnview, changes);
+        UpdateMasternodesRegistry(mnview, changes);
         bool flushed = view.Flush() && mnview.Flush();
         assert(flushed);
+        if (tokensChanged) {
+            UpdateTokensTable(*pcustomcsview);
+        }
+        InvalidateViewSnapshot();
+        if (poolsChanged) {
+            UpdatePoolGraph(*pcustomcsview);
+        }
+        if (!changedBalances->empty()) {
+            GetMainSignals().AccountBalancesChanged(changedBalances);
+        }
 
         // anchor rewards re-voting etc...
         if (!rewardedAnchors.empty()) {
@@ -2721,6 +2801,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         for (auto const & nodeId : bannedCriminals) {
             pcriminals->RemoveCriminalProofs(nodeId);
         }
+        pcriminals->Flush();
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
@@ -3794,6 +3875,49 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
+static void RecordMintedHeader(const CBlockHeader& block, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    CKeyID minterKey;
+    assert(block.ExtractMinterKey(minterKey));
+    auto const registry = GetMasternodesRegistry();
+    auto const entry = registry->GetByOperator(minterKey);
+    if (entry) {
+        auto const & nodeId = entry->id;
+
+        std::map <uint256, CBlockHeader> blockHeaders{};
+        pcriminals->FetchMintedHeaders(nodeId, block.mintedBlocks, blockHeaders, fIsFakeNet);
+        if (blockHeaders.find(hash) == blockHeaders.end()) {
+            pcriminals->WriteMintedBlockHeader(nodeId, block.mintedBlocks, hash, block, fIsFakeNet);
+        }
+
+        auto state = entry->node.GetState(block.height);
+        if (state != CMasternode::PRE_BANNED && state != CMasternode::BANNED) { // deny check & addition if masternode was already punished
+            for (std::pair <uint256, CBlockHeader> const & blockHeader : blockHeaders) {
+                if (IsDoubleSignRestricted(block.height, blockHeader.second.height)) { // we already have equal minters and even mintedBlocks counter
+                    // this is the ONLY place
+                    pcriminals->AddCriminalProof(nodeId, block, blockHeader.second);
+                }
+            }
+        }
+    }
+}
+
+void ReplayMintedHeaders()
+{
+    AssertLockHeld(cs_main);
+    // the same depth is kept by the pruner
+    int const fromHeight = ::ChainActive().Height() - (int) MINTED_HEADERS_KEEP_DEPTH;
+    size_t count = 0;
+    for (auto const & entry : g_blockman.m_block_index) {
+        if (entry.second->pprev && entry.second->nHeight >= fromHeight) {
+            RecordMintedHeader(entry.second->GetBlockHeader(), entry.first);
+            ++count;
+        }
+    }
+    pcriminals->Flush();
+    LogPrintf("Criminals: replayed %d minted headers\n", count);
+}
+
 bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
@@ -3822,28 +3946,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState
 
         // Add MintedBlockHeader entity to DB and check for criminal (limited application for now due to possible "far future" of the header)
         if (fCriminals) {
-            CKeyID minterKey;
-            assert(block.ExtractMinterKey(minterKey));
-            auto it = pcustomcsview->GetMasternodeIdByOperator(minterKey);
-            if (it) {
-            	auto const & nodeId = *it;
-
-	        std::map <uint256, CBlockHeader> blockHeaders{};
-        	pcriminals->FetchMintedHeaders(nodeId, block.mintedBlocks, blockHeaders, fIsFakeNet);
-        	if (blockHeaders.find(hash) == blockHeaders.end()) {
-            	    pcriminals->WriteMintedBlockHeader(nodeId, block.mintedBlocks, hash, block, fIsFakeNet);
-            	}
-
-                auto state = pcustomcsview->GetMasternode(nodeId)->GetState(block.height);
-                if (state != CMasternode::PRE_BANNED && state != CMasternode::BANNED) { // deny check & addition if masternode was already punished
-                    for (std::pair <uint256, CBlockHeader> const & blockHeader : blockHeaders) {
-                        if (IsDoubleSignRestricted(block.height, blockHeader.second.height)) { // we already have equal minters and even mintedBlocks counter
-                            // this is the ONLY place
-                            pcriminals->AddCriminalProof(nodeId, block, blockHeader.second);
-                        }
-                    }
-                }
-            }
+            RecordMintedHeader(block, hash);
         }
 
         // Get prev block index
@@ -3922,6 +4025,7 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
+                pcriminals->Flush();
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3929,6 +4033,8 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
                 *ppindex = pindex;
             }
         }
+        // minted headers of the whole message are committed at once
+        pcriminals->Flush();
     }
     NotifyHeaderTip();
     {
@@ -4047,8 +4153,9 @@ bool AmISignerNow(CCustomCSView::CTeam const & team, CKeyID & operatorAuthAddres
 {
     AssertLockHeld(cs_main);
 
-    auto const mnId = pcustomcsview->AmIOperator();
-    if (mnId && pcustomcsview->GetMasternode(mnId->second)->IsActive() && team.find(mnId->first) != team.end()) { // this is safe due to prev call `AmIOperator`
+    auto const registry = GetMasternodesRegistry();
+    auto const mnId = registry->AmIOperator();
+    if (mnId && registry->Get(mnId->second)->node.IsActive() && team.find(mnId->first) != team.end()) { // this is safe due to prev call `AmIOperator`
         std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
         for (auto const & wallet : wallets) {
             if (wallet->GetKey(mnId->first, masternodeKey)) {
@@ -4117,7 +4224,7 @@ void ProcessAuthsIfTipChanged(CBlockIndex const * oldTip, CBlockIndex const * ti
         LogPrintf("Anchor auth prepare, block: %d\n", anchorHeight);
 
         // trying to create and sign new auth
-        CAnchorAuthMessage auth({topAnchor ? topAnchor->txHash : uint256(), static_cast<THeight>(anchorHeight), anchorBlock->GetBlockHash(), pcustomcsview->CalcNextTeam(anchorBlock->stakeModifier)});
+        CAnchorAuthMessage auth({topAnchor ? topAnchor->txHash : uint256(), static_cast<THeight>(anchorHeight), anchorBlock->GetBlockHash(), GetNextTeamCached(anchorBlock->stakeModifier)});
         if (!panchorauths->GetVote(auth.GetSignHash(), operatorAuthAddress))
         {
             auth.SignWithKey(masternodekey);
@@ -4161,6 +4268,7 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         if (ret) {
             // Store to disk
             ret = ::ChainstateActive().AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock);
+            pcriminals->Flush();
         }
         if (!ret) {
             GetMainSignals().BlockChecked(*pblock, state);
@@ -85,6 +85,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parallelcustomtx default (speculative application of the block's custom txs on -par threads) */
+static const bool DEFAULT_PARALLEL_CUSTOMTX = true;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -154,6 +156,7 @@ extern uint256 g_best_block;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern bool fParallelCustomTx;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -183,6 +186,9 @@ extern uint64_t nPruneTarget;
 extern bool fIsFakeNet;
 extern bool fCriminals;
 
+/** Rewrites the minted headers of the recent block index entries, which may be lost after an unclean shutdown */
+void ReplayMintedHeaders() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 namespace spv {
     class CSpvWrapper;
     extern std::unique_ptr<CSpvWrapper> pspv;
@@ -259,6 +265,8 @@ bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_m
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the custom txs speculation thread */
+void ThreadCustomTxSpeculation(int worker_num);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
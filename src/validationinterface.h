@@ -6,6 +6,7 @@
 #ifndef DEFI_VALIDATIONINTERFACE_H
 #define DEFI_VALIDATIONINTERFACE_H
 
+#include <masternodes/balances.h> // CAccounts
 #include <primitives/transaction.h> // CTransaction(Ref)
 #include <sync.h>
 
@@ -115,6 +116,13 @@ protected:
      * Called on a background thread.
      */
     virtual void BlockDisconnected(const std::shared_ptr<const CBlock> &block) {}
+    /**
+     * Notifies listeners of the account balances changed by connecting or disconnecting a block.
+     * Contains the resulting balances of every touched owner and token, zero for the erased ones.
+     *
+     * Called on a background thread.
+     */
+    virtual void AccountBalancesChanged(const CAccounts &balances) {}
     /**
      * Notifies listeners of the new active block chain on-disk.
      *
@@ -179,6 +187,7 @@ public:
     void TransactionAddedToMempool(const CTransactionRef &);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>> &);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &);
+    void AccountBalancesChanged(const std::shared_ptr<const CAccounts> &);
     void ChainStateFlushed(const CBlockLocator &);
     void BlockChecked(const CBlock&, const CValidationState&);
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
@@ -1439,6 +1439,63 @@ void CWallet::BlockDisconnected(const CBlock& block) {
     }
 }
 
+void CWallet::AccountBalancesChanged(const CAccounts& balances)
+{
+    LOCK(cs_wallet);
+    if (!m_account_balances_loaded) {
+        return; // built from scratch on first use
+    }
+    // balances are absolute, so a notification queued before the full load gets superseded by the following ones
+    for (const auto& account : balances) {
+        if (::IsMine(*this, account.first) == ISMINE_NO) {
+            continue;
+        }
+        auto& owned = m_account_balances[account.first].balances;
+        for (const auto& kv : account.second.balances) {
+            if (kv.second == 0) {
+                owned.erase(kv.first);
+            } else {
+                owned[kv.first] = kv.second;
+            }
+        }
+        if (owned.empty()) {
+            m_account_balances.erase(account.first);
+        }
+    }
+}
+
+CAccounts CWallet::GetAccountBalances(const isminefilter& filter)
+{
+    bool loaded;
+    {
+        LOCK(cs_wallet);
+        loaded = m_account_balances_loaded;
+    }
+    if (!loaded) {
+        auto locked_chain = chain().lock();
+        LOCK(cs_wallet);
+        if (!m_account_balances_loaded) {
+            m_account_balances.clear();
+            chain().forEachAccountBalance([&](CScript const & owner, CTokenAmount const & amount) {
+                if (::IsMine(*this, owner) != ISMINE_NO) {
+                    m_account_balances[owner].Add(amount);
+                }
+                return true;
+            });
+            m_account_balances_loaded = true;
+        }
+    }
+
+    LOCK(cs_wallet);
+    CAccounts result;
+    for (const auto& account : m_account_balances) {
+        if (::IsMine(*this, account.first) & filter) {
+            result.emplace(account);
+        }
+    }
+    return result;
+}
+
 void CWallet::UpdatedBlockTip()
 {
     m_best_block_time = GetTime();
@@ -1797,6 +1854,7 @@ bool CWallet::ImportScripts(const std::set<CScript> scripts, int64_t timestamp)
         UpdateTimeFirstKey(timestamp);
     }
 
+    m_account_balances_loaded = false; // imported scripts may already own balances
     return true;
 }
 
@@ -1820,6 +1878,7 @@ bool CWallet::ImportPrivKeys(const std::map<CKeyID, CKey>& privkey_map, const in
         }
         UpdateTimeFirstKey(timestamp);
     }
+    m_account_balances_loaded = false; // imported scripts may already own balances
     return true;
 }
 
@@ -1852,6 +1911,7 @@ bool CWallet::ImportPubKeys(const std::vector<CKeyID>& ordered_pubkeys, const st
             NotifyCanGetAddressesChanged();
         }
     }
+    m_account_balances_loaded = false; // imported scripts may already own balances
     return true;
 }
 
@@ -1870,6 +1930,7 @@ bool CWallet::ImportScriptPubKeys(const std::string& label, const std::set<CScri
             SetAddressBookWithDB(batch, dest, label, "receive");
         }
     }
+    m_account_balances_loaded = false; // imported scripts may already own balances
     return true;
 }
 
@@ -2035,6 +2096,10 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
 
     WalletLogPrintf("Rescan started from block %s...\n", start_block.ToString());
 
+    {
+        LOCK(cs_wallet);
+        m_account_balances_loaded = false;
+    }
     fAbortRescan = false;
     ShowProgress(strprintf("%s " + _("Rescanning...").translated, GetDisplayName()), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
     uint256 tip_hash;
@@ -836,6 +836,13 @@ private:
      */
     uint256 m_last_block_processed GUARDED_BY(cs_wallet);
 
+    /**
+     * Account balances of the wallet's own scripts, kept up to date by AccountBalancesChanged
+     * notifications. Built from the whole balances set on first use and again after imports and rescans.
+     */
+    CAccounts m_account_balances GUARDED_BY(cs_wallet);
+    bool m_account_balances_loaded GUARDED_BY(cs_wallet) = false;
+
     //! Fetches a key from the keypool
     bool GetKeyFromPool(CPubKey &key, bool internal = false);
 
@@ -1052,7 +1059,10 @@ public:
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const CBlock& block, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const CBlock& block) override;
+    void AccountBalancesChanged(const CAccounts& balances) override;
     void UpdatedBlockTip() override;
+    //! Account balances of the wallet's scripts matching the filter, doesn't touch the chain state once loaded
+    CAccounts GetAccountBalances(const isminefilter& filter = ISMINE_SPENDABLE) LOCKS_EXCLUDED(cs_wallet);
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
 
     struct ScanResult {
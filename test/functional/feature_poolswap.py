@@ -169,6 +169,15 @@ class PoolPairTest (DefiTestFramework):
             "tokenTo": symbolGOLD,
         })
 
+        # the pool of the pair is the only route
+        assert_equal(self.nodes[0].testpoolswap({
+            "from": accountGN0,
+            "tokenFrom": symbolSILVER,
+            "amountFrom": 10,
+            "to": accountSN1,
+            "tokenTo": symbolGOLD,
+        }, "auto"), testPoolSwapRes)
+
         # this acc will be
         goldCheckPS = self.nodes[2].getaccount(accountSN1, {}, True)[idGold]
         print("goldCheckPS:", goldCheckPS)